@@ -0,0 +1,330 @@
+// Copyright 2021 YHSPY. All rights reserved.
+#include <unistd.h>
+#include <chrono>
+#include <cstdio>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include "lib/include/decoder.hh"
+#include "lib/include/executor.hh"
+#include "lib/include/instantiator.hh"
+#include "lib/include/interpreter.hh"
+#include "lib/include/loader.hh"
+#include "lib/include/streaming_loader.hh"
+#include "lib/include/structs.hh"
+#include "lib/include/virtual_mem.hh"
+#include "lib/include/constants.hh"
+
+using namespace TWVM;
+
+#define CONCAT_PREFIX(X) Runtime:: X
+#define BENCH_ITERATIONS 10000000
+#define GROW_BENCH_BYTES (size_t { 1 } << 30)
+#define LOAD_BENCH_FUNCS 100000
+#define LOAD_BENCH_BODY_OPS 160  // About 48MiB of code in total.
+#define LOAD_BENCH_PATH "/tmp/twvm_bench_large.wasm"
+#define CACHE_BENCH_DIR "/tmp/twvm_bench_cache"
+#define STREAM_BENCH_BYTES_PER_MS (20 * 1024)  // About 20MB/s, as from a network download.
+#define LEB128_BENCH_VALUES 1000000
+#define LEB128_BENCH_ROUNDS 20
+#define LOOP_BENCH_PATH "/tmp/twvm_bench_loop.wasm"
+#define LOOP_BENCH_ITERATIONS 1000000000
+
+namespace {
+
+// The previous handler shape: one type-erased callable per executed instruction.
+template<typename T, typename U>
+void legacyOpHandlerFTRO(Executor& executor, std::function<U(T, T)> handler) {
+  auto& stack = executor.getEngineData()->stack;
+  const auto y = stack.back().as<T>();
+  stack.pop_back();
+  auto& x = stack.back();
+  x = Runtime::RTValue::from(handler(x.as<T>(), y));
+}
+
+template<typename T, typename H>
+double measure(Runtime& rt, H&& handler) {
+  const auto c1 = Runtime::RTValue::from(static_cast<T>(7));
+  const auto c2 = Runtime::RTValue::from(static_cast<T>(3));
+  rt.stack.clear();
+  const auto start = std::chrono::steady_clock::now();
+  for (auto i = 0; i < BENCH_ITERATIONS; ++i) {
+    rt.stack.push_back(c1);
+    rt.stack.push_back(c2);
+    handler();
+    rt.stack.pop_back();
+  }
+  const std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+  return elapsed.count() / BENCH_ITERATIONS;
+}
+
+// Kept out of line, as the interpreter handlers are.
+#define DECLARE_BINOP_BENCH_HANDLERS(NAME, VAL_TYPE, RET_TYPE, OP_CAST_TYPE, OP) \
+  __attribute__((noinline)) void legacy##NAME(Executor& executor) { \
+    legacyOpHandlerFTRO<CONCAT_PREFIX(VAL_TYPE), CONCAT_PREFIX(RET_TYPE)>(executor, [](auto x, auto y) { \
+      return static_cast<CONCAT_PREFIX(OP_CAST_TYPE)>(x) OP static_cast<CONCAT_PREFIX(OP_CAST_TYPE)>(y); \
+    }); \
+  }
+ITERATE_SIMPLE_BINOP(DECLARE_BINOP_BENCH_HANDLERS)
+
+// Grows a memory 1 page at a time, either reallocated on the heap or committed in a reservation.
+double measureGrow(bool reserved) {
+  const auto rt = std::make_shared<Runtime>(nullptr);
+  const auto reservedBytes = WASM_MAX_PAGES * WASM_PAGE_SIZE_IN_BYTE;
+  auto* ptr = reserved ? VirtualMem::reserve(reservedBytes, 0) : nullptr;
+  rt->rtMems.emplace_back(0, ptr, 0, ptr ? reservedBytes : 0);
+  Executor executor(nullptr, rt);
+  const auto start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < GROW_BENCH_BYTES / WASM_PAGE_SIZE_IN_BYTE; ++i) {
+    executor.resizeMem(1);
+  }
+  const std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+  return elapsed.count();
+}
+
+// Writes a module with `funcCount` functions of `bodyOps` `i32.const 1; drop` pairs each.
+void writeLargeModule(const std::string& path, size_t funcCount, size_t bodyOps) {
+  std::vector<uint8_t> out = { 0x00, 0x61, 0x73, 0x6d, 0x01, 0x00, 0x00, 0x00 };
+  const auto append = [&out](const std::vector<uint8_t>& bytes) {
+    out.insert(out.end(), bytes.begin(), bytes.end());
+  };
+  const auto section = [&](uint8_t id, const std::vector<uint8_t>& payload) {
+    out.push_back(id);
+    append(Decoder::encodeVaruint(payload.size()));
+    append(payload);
+  };
+  section(1, { 1, 0x60, 0, 1, 0x7f });  // () -> i32.
+  auto funcs = Decoder::encodeVaruint(funcCount);
+  funcs.insert(funcs.end(), funcCount, 0);
+  section(3, funcs);
+  section(7, { 1, 4, 'm', 'a', 'i', 'n', 0, 0 });
+  std::vector<uint8_t> body = { 0 };  // No locals.
+  for (size_t i = 0; i < bodyOps; ++i) {
+    body.insert(body.end(), { 0x41, 1, 0x1a });
+  }
+  body.insert(body.end(), { 0x41, 0, 0x0b });
+  auto code = Decoder::encodeVaruint(funcCount);
+  const auto bodySize = Decoder::encodeVaruint(body.size());
+  for (size_t i = 0; i < funcCount; ++i) {
+    code.insert(code.end(), bodySize.begin(), bodySize.end());
+    code.insert(code.end(), body.begin(), body.end());
+  }
+  section(10, code);
+  std::ofstream(path, std::ofstream::binary).write(reinterpret_cast<const char*>(out.data()), out.size());
+}
+
+// Writes a module whose `main` sums the counter of a single loop of `iterations`, called once.
+void writeLoopModule(const std::string& path, int32_t iterations) {
+  std::vector<uint8_t> out = { 0x00, 0x61, 0x73, 0x6d, 0x01, 0x00, 0x00, 0x00 };
+  const auto append = [&out](const std::vector<uint8_t>& bytes) {
+    out.insert(out.end(), bytes.begin(), bytes.end());
+  };
+  const auto section = [&](uint8_t id, const std::vector<uint8_t>& payload) {
+    out.push_back(id);
+    append(Decoder::encodeVaruint(payload.size()));
+    append(payload);
+  };
+  section(1, { 1, 0x60, 0, 1, 0x7f });  // () -> i32.
+  section(3, { 1, 0 });
+  section(7, { 1, 4, 'm', 'a', 'i', 'n', 0, 0 });
+  // (local i32 i32) loop: s += i; i += 1; br_if (i < iterations) end; s.
+  std::vector<uint8_t> body = { 1, 2, 0x7f, 0x03, 0x40,
+    0x20, 1, 0x20, 0, 0x6a, 0x21, 1,
+    0x20, 0, 0x41, 1, 0x6a, 0x22, 0, 0x41 };
+  std::vector<uint8_t> bound;
+  for (auto v = iterations; ; v >>= 7) {
+    const uint8_t byte = v & 0x7f;
+    if ((v >> 7) == 0 && !(byte & 0x40)) {
+      bound.push_back(byte);
+      break;
+    }
+    bound.push_back(byte | 0x80);
+  }
+  body.insert(body.end(), bound.begin(), bound.end());
+  body.insert(body.end(), { 0x48, 0x0d, 0, 0x0b, 0x20, 1, 0x0b });
+  auto code = Decoder::encodeVaruint(size_t { 1 });
+  const auto bodySize = Decoder::encodeVaruint(body.size());
+  code.insert(code.end(), bodySize.begin(), bodySize.end());
+  code.insert(code.end(), body.begin(), body.end());
+  section(10, code);
+  std::ofstream(path, std::ofstream::binary).write(reinterpret_cast<const char*>(out.data()), out.size());
+}
+
+// The previous decoder: the bytes of every value are collected into a vector first.
+uint32_t legacyDecodeVaruint(const uint8_t*& in) {
+  std::vector<uint8_t> v = {};
+  while (true) {
+    const auto byte = *in++;
+    v.emplace_back(byte);
+    if (!(byte & 0x80)) {
+      break;
+    }
+  }
+  uint32_t val = 0;
+  unsigned shift = 0;
+  for (auto byte : v) {
+    val |= (static_cast<uint32_t>(byte & 0x7f) << shift);
+    shift += 7;
+  }
+  return val;
+}
+
+// Encodes the values below `2 ^ bits` in turn, the encodings of them are 1 to 5 bytes.
+std::vector<uint8_t> writeLEB128s(unsigned bits) {
+  std::vector<uint8_t> out;
+  uint32_t x = 2463534242;
+  for (size_t i = 0; i < LEB128_BENCH_VALUES; ++i) {
+    x ^= x << 13, x ^= x >> 17, x ^= x << 5;
+    const auto bytes = Decoder::encodeVaruint(bits < 32 ? x & ((1u << bits) - 1) : x);
+    out.insert(out.end(), bytes.begin(), bytes.end());
+  }
+  return out;
+}
+
+// In ns per value.
+template<typename F>
+double measureDecode(const std::vector<uint8_t>& bytes, F&& decode) {
+  std::vector<uint32_t> out(LEB128_BENCH_VALUES);
+  uint64_t sum = 0;
+  const auto start = std::chrono::steady_clock::now();
+  for (auto round = 0; round < LEB128_BENCH_ROUNDS; ++round) {
+    const auto* in = bytes.data();
+    decode(in, bytes.data() + bytes.size(), out.data());
+    sum += out.back();
+  }
+  const std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+  if (sum == 0) {
+    std::printf("\n");  // Keeps the results alive.
+  }
+  return elapsed.count() / LEB128_BENCH_ROUNDS / LEB128_BENCH_VALUES;
+}
+
+void measureLEB128(unsigned bits) {
+  const auto bytes = writeLEB128s(bits);
+  const auto each = [](auto decode) {
+    return [=](const uint8_t*& in, const uint8_t* end, uint32_t* out) {
+      for (size_t i = 0; i < LEB128_BENCH_VALUES; ++i) {
+        out[i] = decode(in, end);
+      }
+    };
+  };
+  std::printf("%-10s %10.3f %10.3f %10.3f %10.3f\n", (std::to_string(bits) + " bits").c_str(),
+    measureDecode(bytes, each([](const uint8_t*& in, const uint8_t*) { return legacyDecodeVaruint(in); })),
+    measureDecode(bytes, each([](const uint8_t*& in, const uint8_t*) { return Decoder::decodeVaruint<uint32_t>(in); })),
+    measureDecode(bytes, each([](const uint8_t*& in, const uint8_t* end) {
+      return Decoder::decodeVaruint<uint32_t>(in, end);
+    })),
+    measureDecode(bytes, [](const uint8_t*& in, const uint8_t* end, uint32_t* out) {
+      Decoder::decodeVaruintRun(in, end, out, LEB128_BENCH_VALUES);
+    }));
+}
+
+// Loading validates every function, instantiating translates them.
+std::pair<double, double> measureLoad(const std::string& path, const EngineOptions& options) {
+  const auto start = std::chrono::steady_clock::now();
+  const auto mod = Loader::load(path, options);
+  const auto loaded = std::chrono::steady_clock::now();
+  const auto rt = Instantiator::instantiate(mod, options);
+  const std::chrono::duration<double, std::milli> loading = loaded - start;
+  const std::chrono::duration<double, std::milli> instantiating = std::chrono::steady_clock::now() - loaded;
+  return { loading.count(), instantiating.count() };
+}
+
+// The time from the first byte written into a pipe until the module is ready to execute.
+double measureFirstInstruction(const std::string& path, bool streaming) {
+  std::ifstream in {path, std::ifstream::binary};
+  const std::vector<char> bytes { std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>() };
+  int fds[2];
+  if (pipe(fds) != 0) {
+    return 0;
+  }
+  const auto start = std::chrono::steady_clock::now();
+  std::thread writer([&]() {
+    for (size_t i = 0; i < bytes.size(); i += STREAMING_CHUNK_BYTES) {
+      std::this_thread::sleep_until(start + std::chrono::microseconds(i * 1000 / STREAM_BENCH_BYTES_PER_MS));
+      const auto n = std::min(STREAMING_CHUNK_BYTES, bytes.size() - i);
+      for (size_t written = 0; written < n;) {
+        written += std::max<ssize_t>(write(fds[1], bytes.data() + i + written, n - written), 0);
+      }
+    }
+    close(fds[1]);
+  });
+  const auto rt = streaming ?
+    StreamingLoader::load(fds[0]) :
+    Instantiator::instantiate(Loader::load("/dev/fd/" + std::to_string(fds[0])));
+  const std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+  writer.join();
+  close(fds[0]);
+  return elapsed.count();
+}
+
+// A single call of the loop module, interpreted, or leaving the loop for the native code once hot.
+double measureLoop(const std::string& path, bool jit) {
+  EngineOptions options;
+  options.jitEnabled = jit;
+  const auto rt = Instantiator::instantiate(Loader::load(path, options), options);
+  const auto start = std::chrono::steady_clock::now();
+  const auto result = Executor::execute(rt);
+  const std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+  if (!result.has_value()) {
+    std::printf("\n");  // Keeps the result alive.
+  }
+  return elapsed.count();
+}
+
+}  // namespace
+
+#define DECLARE_BINOP_BENCH(NAME, VAL_TYPE, RET_TYPE, OP_CAST_TYPE, OP) \
+  { \
+    const auto before = measure<CONCAT_PREFIX(VAL_TYPE)>(*rt, [&]() { legacy##NAME(executor); }); \
+    const auto after = measure<CONCAT_PREFIX(VAL_TYPE)>(*rt, [&]() { Interpreter::do##NAME(executor); }); \
+    std::printf("%-10s %12.3f %12.3f %9.2fx\n", #NAME, before, after, before / after); \
+  }
+
+int main(int argc, const char **argv) {
+  const auto rt = std::make_shared<Runtime>(nullptr);
+  Executor executor(nullptr, rt);
+  std::printf("%-10s %12s %12s %10s\n", "op", "function/ns", "inlined/ns", "speedup");
+  ITERATE_SIMPLE_BINOP(DECLARE_BINOP_BENCH)
+  std::printf("\n%-10s %10s %10s %10s %10s\n", "varuint32", "vector/ns", "fast/ns", "checked/ns", "bulk/ns");
+  for (const auto bits : { 7, 14, 21, 32 }) {
+    measureLEB128(bits);
+  }
+  std::printf("\n%-10s %12s %12s\n", "grow", "realloc/ms", "reserved/ms");
+  std::printf("%-10s %12.3f %12.3f\n", "1GiB", measureGrow(false), measureGrow(true));
+  writeLargeModule(LOAD_BENCH_PATH, LOAD_BENCH_FUNCS, LOAD_BENCH_BODY_OPS);
+  std::printf("\n%-10s %12s %12s\n", "48MiB", "load/ms", "instance/ms");
+  EngineOptions options;
+  for (const auto threads : { 1, 2, 4, 8 }) {
+    options.threads = threads;
+    const auto [loading, instantiating] = measureLoad(LOAD_BENCH_PATH, options);
+    std::printf("%-10s %12.3f %12.3f\n", (std::to_string(threads) + " threads").c_str(), loading, instantiating);
+  }
+  options.threads = 1;
+  options.lazy = true;
+  const auto [loading, instantiating] = measureLoad(LOAD_BENCH_PATH, options);
+  std::printf("%-10s %12.3f %12.3f\n", "lazy", loading, instantiating);
+  // The first run stores the entry, the second one is a hit.
+  options.lazy = false;
+  options.cacheDir = CACHE_BENCH_DIR;
+  for (const auto name : { "cold cache", "warm cache" }) {
+    const auto [loading, instantiating] = measureLoad(LOAD_BENCH_PATH, options);
+    std::printf("%-10s %12.3f %12.3f\n", name, loading, instantiating);
+  }
+  std::printf("\n%-10s %12s %12s\n", "first op", "buffered/ms", "streamed/ms");
+  std::printf("%-10s %12.3f %12.3f\n", "48MiB",
+    measureFirstInstruction(LOAD_BENCH_PATH, false), measureFirstInstruction(LOAD_BENCH_PATH, true));
+  std::remove(LOAD_BENCH_PATH);
+  std::system("rm -rf " CACHE_BENCH_DIR);
+  writeLoopModule(LOOP_BENCH_PATH, LOOP_BENCH_ITERATIONS);
+  std::printf("\n%-10s %12s %12s\n", "loop", "interp/ms", "osr/ms");
+  std::printf("%-10s %12.3f %12.3f\n", "1e9 iters",
+    measureLoop(LOOP_BENCH_PATH, false), measureLoop(LOOP_BENCH_PATH, true));
+  std::remove(LOOP_BENCH_PATH);
+  return 0;
+}
@@ -0,0 +1,219 @@
+// Copyright 2021 YHSPY. All rights reserved.
+#include <cstdio>
+#include <cstring>
+#include <type_traits>
+#include "lib/include/code_cache.hh"
+#include "lib/include/constants.hh"
+#include "lib/include/util.hh"
+#include "lib/include/virtual_mem.hh"
+#if defined(VIRTUAL_MEM_SUPPORTED)
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
+
+namespace TWVM {
+
+static_assert(std::is_trivially_copyable_v<Runtime::RTCodeSlot> && sizeof(Runtime::RTCodeSlot) == 8);
+static_assert(std::is_trivially_copyable_v<Runtime::RTValue> && sizeof(Runtime::RTValue) == 8);
+
+std::string CodeCache::entryPath(const std::string& dir, const std::string& key) {
+  return dir + "/" + key + ".twc";
+}
+
+std::string CodeCache::moduleKey(const Module& mod) {
+  std::pair<uint64_t, uint64_t> hash;
+  if (mod.source.ptr != nullptr) {
+    hash = Util::hash128(mod.source.ptr, mod.source.size);
+  } else {
+    // Streamed, the same bytes as in a file.
+    std::vector<uint8_t> bytes = { 0x0, 0x61, 0x73, 0x6d, VALID_VERSION, 0x0, 0x0, 0x0 };
+    for (const auto& section : mod.source.sections) {
+      bytes.insert(bytes.end(), section.begin(), section.end());
+    }
+    hash = Util::hash128(bytes.data(), bytes.size());
+  }
+  std::string build = std::to_string(CODE_CACHE_FORMAT_VERSION);
+#if defined(BUILD_VERSION)
+  build += BUILD_VERSION;
+#endif
+  const auto buildHash = Util::hash128(reinterpret_cast<const uint8_t*>(build.data()), build.size()).first;
+  char name[48];
+  std::snprintf(name, sizeof(name), "%016llx%016llx-%08x",
+    static_cast<unsigned long long>(hash.first), static_cast<unsigned long long>(hash.second),
+    static_cast<uint32_t>(buildHash));
+  return name;
+}
+
+std::string CodeCache::key(const Module& mod, const EngineOptions& options) {
+  // The options changing the translated code.
+  const unsigned flags = (options.regEnabled ? 1 : 0) | (options.ngramSize == 0 ? 2 : 0);
+  return moduleKey(mod) + "-" + std::to_string(flags);
+}
+
+bool CodeCache::verify(const uint8_t* ptr, size_t size, const Module& mod) {
+  Header header;
+  if (size < sizeof(header)) {
+    return false;
+  }
+  std::memcpy(&header, ptr, sizeof(header));
+  if (header.magic != CODE_CACHE_MAGIC ||
+    header.formatVersion != CODE_CACHE_FORMAT_VERSION ||
+    header.moduleSize != mod.source.size ||
+    header.funcCount != mod.funcDefs.size() ||
+    header.funcCount != mod.funcTypesIndices.size() ||
+    header.payloadBytes != size - sizeof(header) ||
+    header.checksum != Util::hash128(ptr + sizeof(header), header.payloadBytes).first) {
+    return false;
+  }
+  size_t offset = sizeof(header);
+  for (uint64_t i = 0; i < header.funcCount; ++i) {
+    FuncRecord record;
+    if (size - offset < sizeof(record)) {
+      return false;
+    }
+    std::memcpy(&record, ptr + offset, sizeof(record));
+    offset += sizeof(record);
+    const auto slotBytes =
+      (static_cast<uint64_t>(record.codeSlots) + record.regCodeSlots + record.regConstCount) * sizeof(uint64_t);
+    if (size - offset < slotBytes || record.codeSlots == 0) {
+      return false;
+    }
+    offset += slotBytes;
+  }
+  return offset == size;
+}
+
+bool CodeCache::lookup(Module& mod, const EngineOptions& options) {
+  auto& cached = mod.cached;
+  cached.key = key(mod, options);
+  size_t size = 0;
+  const auto* ptr = VirtualMem::mapFile(entryPath(options.cacheDir, cached.key), size);
+  if (ptr == nullptr) {
+    return false;
+  }
+  if (!verify(ptr, size, mod)) {
+    VirtualMem::unmapFile(ptr, size);
+    return false;
+  }
+  cached.ptr = ptr;
+  cached.size = size;
+  // The module has passed validation before it was stored, only the metadata is left.
+  size_t offset = sizeof(Header);
+  for (auto& funcDef : mod.funcDefs) {
+    FuncRecord record;
+    std::memcpy(&record, ptr + offset, sizeof(record));
+    funcDef.maxStackDepth = record.maxStackDepth;
+    offset += sizeof(record) +
+      (static_cast<size_t>(record.codeSlots) + record.regCodeSlots + record.regConstCount) * sizeof(uint64_t);
+  }
+  return true;
+}
+
+std::vector<Runtime::RTFuncDescriptor> CodeCache::restore(const Module& mod) {
+  std::vector<Runtime::RTFuncDescriptor> descriptors;
+  descriptors.reserve(mod.funcDefs.size());
+  const auto* p = mod.cached.ptr + sizeof(Header);
+  for (uint32_t i = 0; i < mod.funcDefs.size(); ++i) {
+    FuncRecord record;
+    std::memcpy(&record, p, sizeof(record));
+    p += sizeof(record);
+    Runtime::code_seq_t code(record.codeSlots);
+    std::memcpy(code.data(), p, record.codeSlots * sizeof(uint64_t));
+    p += record.codeSlots * sizeof(uint64_t);
+    auto& descriptor = descriptors.emplace_back(&mod.funcTypes.at(mod.funcTypesIndices.at(i)), std::move(code));
+    descriptor.localsDefault.resize(record.localCount);
+    descriptor.maxStackDepth = record.maxStackDepth;
+    descriptor.regCode.resize(record.regCodeSlots);
+    std::memcpy(descriptor.regCode.data(), p, record.regCodeSlots * sizeof(uint64_t));
+    p += record.regCodeSlots * sizeof(uint64_t);
+    descriptor.regConsts.resize(record.regConstCount);
+    std::memcpy(descriptor.regConsts.data(), p, record.regConstCount * sizeof(uint64_t));
+    p += record.regConstCount * sizeof(uint64_t);
+    descriptor.regFrameSize = record.regFrameSize;
+  }
+  return descriptors;
+}
+
+void CodeCache::store(
+  const Module& mod, const EngineOptions& options, const std::vector<Runtime::RTFuncDescriptor>& descriptors) {
+  size_t size = sizeof(Header);
+  for (const auto& descriptor : descriptors) {
+    size += sizeof(FuncRecord) +
+      (descriptor.code.size() + descriptor.regCode.size() + descriptor.regConsts.size()) * sizeof(uint64_t);
+  }
+  std::vector<uint8_t> out(size);
+  auto* p = out.data() + sizeof(Header);
+  const auto append = [&p](const void* bytes, size_t n) {
+    if (n > 0) {
+      std::memcpy(p, bytes, n);
+      p += n;
+    }
+  };
+  for (const auto& descriptor : descriptors) {
+    const FuncRecord record {
+      descriptor.maxStackDepth,
+      static_cast<uint32_t>(descriptor.localsDefault.size()),
+      static_cast<uint32_t>(descriptor.code.size()),
+      static_cast<uint32_t>(descriptor.regCode.size()),
+      static_cast<uint32_t>(descriptor.regConsts.size()),
+      descriptor.regFrameSize,
+    };
+    append(&record, sizeof(record));
+    append(descriptor.code.data(), descriptor.code.size() * sizeof(uint64_t));
+    append(descriptor.regCode.data(), descriptor.regCode.size() * sizeof(uint64_t));
+    append(descriptor.regConsts.data(), descriptor.regConsts.size() * sizeof(uint64_t));
+  }
+  const auto payloadBytes = size - sizeof(Header);
+  const Header header {
+    CODE_CACHE_MAGIC,
+    CODE_CACHE_FORMAT_VERSION,
+    mod.source.size,
+    descriptors.size(),
+    payloadBytes,
+    Util::hash128(out.data() + sizeof(Header), payloadBytes).first,
+  };
+  std::memcpy(out.data(), &header, sizeof(header));
+  writeFile(entryPath(options.cacheDir, mod.cached.key), out.data(), out.size());
+}
+
+#if defined(VIRTUAL_MEM_SUPPORTED)
+
+bool CodeCache::writeFile(const std::string& path, const uint8_t* bytes, size_t size) {
+  const auto slash = path.find_last_of('/');
+  if (slash != std::string::npos) {
+    mkdir(path.substr(0, slash).c_str(), 0755);  // Fails harmlessly when it exists.
+  }
+  // Unique to the writer, and in the same directory so that the rename is atomic.
+  auto temp = path + ".XXXXXX";
+  const auto fd = mkstemp(temp.data());
+  if (fd < 0) {
+    return false;
+  }
+  fchmod(fd, 0644);
+  size_t written = 0;
+  while (written < size) {
+    const auto n = write(fd, bytes + written, size - written);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      break;
+    }
+    written += static_cast<size_t>(n);
+  }
+  const auto done = close(fd) == 0 && written == size && std::rename(temp.c_str(), path.c_str()) == 0;
+  if (!done) {
+    unlink(temp.c_str());
+  }
+  return done;
+}
+
+#else
+
+bool CodeCache::writeFile(const std::string&, const uint8_t*, size_t) { return false; }
+
+#endif
+
+}  // namespace TWVM
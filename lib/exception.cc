@@ -17,11 +17,16 @@ std::unordered_map<Exception::ErrorType, std::string> Exception::errorMsg = {
   { ErrorType::TBL_ELEM_EXCEED_MAX, "The amount of initialized elements exceeds the number of table entries. " },
   { ErrorType::MEM_ACCESS_OOB, "Memory address accessed out of bound. " },
   { ErrorType::TBL_ACCESS_OOB, "Table accessed out of bound. " },
+  { ErrorType::UNINITIALIZED_TBL_ELEM, "Uninitialized table element accessed. " },
   { ErrorType::MISSING_FUNC_PARAMS, "Insufficient values on stack for calling a function. " },
   { ErrorType::STACK_VAL_TYPE_MISMATCH, "Stack value type mismatch. " },
   { ErrorType::UNREACHABLE, "Unreachable. " },
   { ErrorType::ILLEGAL_LOCAL_IDX, "Illegal local index found. " },
+  { ErrorType::ILLEGAL_FUNC_IDX, "Illegal function index found. " },
+  { ErrorType::ILLEGAL_ALIGNMENT, "Alignment must not be larger than natural. " },
+  { ErrorType::INVALID_OPCODE, "Invalid opcode found. " },
   { ErrorType::EXHAUSTED_STACK_ACCESS, "No such available data on the stack. " },
+  { ErrorType::STACK_OVERFLOW, "Call stack exhausted. " },
   { ErrorType::ILLEGAL_BREAK_LVL, "Illegal Break level found. " },
   { ErrorType::ARITY_TYPE_MISMATCH, "Arity type(s) mismatch. " },
   { ErrorType::FUNC_TYPE_MISMATCH, "Function type mismatch. " },
@@ -39,6 +44,10 @@ std::unordered_map<Exception::ErrorType, std::string> Exception::errorMsg = {
   { ErrorType::INVALID_INPUT_PATH, "Invalid path of the input file found. " },
   { ErrorType::INSUFFICIENT_INPUT_ARGS, "Insufficient arguments for invoking the function." },
   { ErrorType::INVALID_VAL_TYPE, "Invalid WebAssembly value type found." },
+  { ErrorType::UNEXPECTED_END, "Unexpected end of the module binary found. " },
+  { ErrorType::INVALID_LEB128, "Invalid LEB128 encoding found, it is too long or has bad unused bits. " },
+  { ErrorType::INVALID_AOT_ARTIFACT, "Invalid AOT artifact found, it cannot be written or read, or is compiled from another module or build. " },
+  { ErrorType::INCOMPATIBLE_OPTIONS, "Incompatible options found, --ngram profiles the stack-based interpreter only and cannot be used with --reg. " },
 };
 
 }  // namespace TWVM
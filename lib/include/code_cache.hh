@@ -0,0 +1,61 @@
+// Copyright 2021 YHSPY. All rights reserved.
+#ifndef LIB_INCLUDE_CODE_CACHE_HH_
+#define LIB_INCLUDE_CODE_CACHE_HH_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "lib/include/structs.hh"
+
+namespace TWVM {
+
+/**
+ * A content-addressed directory of translated modules, so that the short-lived processes
+ * running the same module skip its validation and translation. An entry is keyed by the hash
+ * of the module binary, the build version of the VM, and the options changing the translated
+ * code. It holds the validation metadata and the translated code of every function, which is
+ * position independent, and is mapped read-only on loading.
+ *
+ * Entries are written to a temporary file and renamed into place, so concurrent writers and
+ * readers, from any number of processes, only ever see complete entries. An entry that fails
+ * its checksum is treated as a miss, and replaced. The objects compiled by the JIT are kept
+ * in the same directory, named after the key of the entry, see `JITCompiler`.
+ */
+struct CodeCache {
+ private:
+  struct Header {
+    uint32_t magic;
+    uint32_t formatVersion;
+    uint64_t moduleSize;
+    uint64_t funcCount;
+    uint64_t payloadBytes;  // Following the header.
+    uint64_t checksum;  // Of the payload.
+  };
+  // Followed by the slots of `code`, `regCode`, then `regConsts`.
+  struct FuncRecord {
+    uint32_t maxStackDepth;
+    uint32_t localCount;  // Params included.
+    uint32_t codeSlots;
+    uint32_t regCodeSlots;
+    uint32_t regConstCount;
+    uint32_t regFrameSize;
+  };
+  static std::string entryPath(const std::string&, const std::string&);
+  static bool verify(const uint8_t*, size_t, const Module&);
+ public:
+  // Of the module binary and the build of the VM, also identifying the artifacts of `--compile`.
+  static std::string moduleKey(const Module&);
+  static std::string key(const Module&, const EngineOptions&);
+  // Maps the entry of the module, and restores the validation metadata on a hit. The key is
+  // recorded into `Module::cached` either way, for `store` and the JIT.
+  static bool lookup(Module&, const EngineOptions&);
+  static std::vector<Runtime::RTFuncDescriptor> restore(const Module&);
+  static void store(const Module&, const EngineOptions&, const std::vector<Runtime::RTFuncDescriptor>&);
+  // Replaces the file at the path atomically, false on any failure, which callers may ignore.
+  static bool writeFile(const std::string&, const uint8_t*, size_t);
+};
+
+}  // namespace TWVM
+
+#endif  // LIB_INCLUDE_CODE_CACHE_HH_
@@ -17,10 +17,23 @@ constexpr uint32_t VALID_MAGIC = 0x6D736100;
 constexpr uint8_t VALID_VERSION = 0x1;
 constexpr size_t WASM_PAGE_SIZE_IN_BYTE = 64 * 1024;
 constexpr size_t WASM_MAX_PAGES = 1 << 16;
+// A 32-bit address plus a 32-bit offset, and the widest access past them.
+constexpr size_t GUARDED_MEM_RESERVED_BYTES = (size_t { 1 } << 33) + WASM_PAGE_SIZE_IN_BYTE;
 constexpr uint8_t EXT_KIND_FUNC = 0x0;
 constexpr uint8_t EXT_KIND_TAB = 0x1;
 constexpr uint8_t EXT_KIND_MEM = 0x2;
 constexpr uint8_t EXT_KIND_GLB = 0x3;
+constexpr int8_t CODE_SECTION_ID = 10;
+constexpr size_t STREAMING_CHUNK_BYTES = 1 << 16;
+constexpr uint32_t CODE_CACHE_MAGIC = 0x43435754;  // "TWCC".
+// Bumped whenever the translated code, or the calling convention of the native code, changes.
+constexpr uint32_t CODE_CACHE_FORMAT_VERSION = 4;
+constexpr uint32_t JIT_CALL_THRESHOLD = 100;
+constexpr uint32_t JIT_LOOP_THRESHOLD = 1000;
+constexpr uint32_t JIT_TABLE_ELEM_UNINITIALIZED = UINT32_MAX;
+constexpr size_t REG_STACK_SLOTS = 1 << 20;
+constexpr size_t STACK_RESERVED_SLOTS = 1 << 16;
+constexpr size_t CALL_STACK_RESERVED_FRAMES = 1 << 12;
 constexpr uint32_t OPTIONAL_SYM_BOOL_TRUE = 1;
 constexpr uint32_t OPTIONAL_SYM_BOOL_FALSE = 0;
 
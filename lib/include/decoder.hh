@@ -2,32 +2,63 @@
 #ifndef LIB_INCLUDE_DECODER_HH_
 #define LIB_INCLUDE_DECODER_HH_
 
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+#include <cstddef>
 #include <cstdint>
-#include <fstream>
 #include <vector>
 #include <type_traits>
-#include <utility>
+#include "lib/include/exception.hh"
 
 namespace TWVM {
 
 class Decoder {
-  template<typename U>
-  static std::vector<uint8_t> retrievePackedLEB128Bytes(U&& in) {
-    std::vector<uint8_t> v = {};
-    while (true) {
-      uint8_t byte;
-      if constexpr (std::is_same_v<typename std::decay<U>::type, uint8_t*>) {
-        byte = *in++;
-      } else {
-        byte = static_cast<uint8_t>(in.get());
+  // Fills the bits above the `bits` decoded ones with the copies of the sign bit.
+  static uint64_t signExtend(uint64_t val, unsigned bits) {
+    return bits < 64 && (val >> (bits - 1)) & 1 ? val | (~uint64_t { 0 } << bits) : val;
+  }
+  // The general case of the unchecked decoding, after the first two bytes have been folded into `val`.
+  template<typename P>
+  static uint64_t decodeTail(P*& in, uint64_t val, unsigned& shift) {
+    uint8_t byte;
+    do {
+      byte = *in++;
+      if (shift < 64) {
+        val |= static_cast<uint64_t>(byte & 0x7f) << shift;
+      }
+      shift += 7;
+    } while (byte & 0x80);
+    return val;
+  }
+  // The checked decoding of an encoding that is not a single byte, or ends at `end`.
+  template<typename T>
+  static uint64_t decodeChecked(const uint8_t*& in, const uint8_t* end, ssize_t pos, unsigned& bits) {
+    constexpr unsigned maxBits = sizeof(T) * 8;
+    constexpr unsigned maxBytes = (maxBits + 6) / 7;
+    uint64_t val = 0;
+    for (unsigned i = 0; ; ++i) {
+      if (in + i >= end) {
+        Exception::terminate(Exception::ErrorType::UNEXPECTED_END, pos ? pos + i : 0);
+      }
+      const uint8_t byte = in[i];
+      val |= static_cast<uint64_t>(byte & 0x7f) << (i * 7);
+      if (i + 1 == maxBytes) {
+        // The unused bits of the last byte, zeros or the copies of the sign bit.
+        const unsigned used = maxBits - i * 7;
+        const uint8_t unused = (byte & 0x7f) >> (std::is_signed_v<T> ? used - 1 : used);
+        if ((byte & 0x80) || (unused != 0 && !(std::is_signed_v<T> && unused == (0x7f >> (used - 1))))) {
+          Exception::terminate(Exception::ErrorType::INVALID_LEB128, pos ? pos + i : 0);
+        }
       }
-      v.emplace_back(byte);
       if (!(byte & 0x80)) {
-        break;
+        in += i + 1;
+        bits = (i + 1) * 7;
+        return val;
       }
     }
-    return v;
   }
+
  public:
   template<typename T>
   static std::vector<uint8_t> encodeVaruint(T in) {
@@ -40,35 +71,123 @@ class Decoder {
     } while (in != 0);
     return v;
   }
-  template<typename T, typename U>
-  static T decodeVaruint(U&& in) {
-    const auto v = retrievePackedLEB128Bytes(
-      std::forward<U>(in));
-    T val = 0;
-    unsigned shift = 0;
-    for (auto byte : v) {
-      val |= (static_cast<T>(byte & 0x7f) << shift);
-      shift += 7;
+  // Unchecked, for the bytes that have been validated, e.g. the function bodies in translation.
+  template<typename T, typename P>
+  static T decodeVaruint(P*& in) {
+    static_assert(sizeof(P) == 1);
+    uint64_t val = in[0];
+    if (val < 0x80) {
+      in += 1;
+      return static_cast<T>(val);
     }
-    return val;
+    const uint8_t second = in[1];
+    val = (val & 0x7f) | (static_cast<uint64_t>(second & 0x7f) << 7);
+    in += 2;
+    if (second < 0x80) {
+      return static_cast<T>(val);
+    }
+    unsigned shift = 14;
+    return static_cast<T>(decodeTail(in, val, shift));
   }
-  template<typename T, typename U>
-  static T decodeVarint(U&& in) {
-    const auto v = retrievePackedLEB128Bytes(
-      std::forward<U>(in));
-    T val = 0;
-    unsigned shift = 0;
-    uint8_t b = 0;
-    for (auto byte : v) {
-      b = byte;
-      val |= (static_cast<T>(byte & 0x7f) << shift);
-      shift += 7;
+  template<typename T, typename P>
+  static T decodeVarint(P*& in) {
+    static_assert(sizeof(P) == 1);
+    uint64_t val = in[0];
+    if (val < 0x80) {
+      in += 1;
+      return static_cast<T>(signExtend(val, 7));
     }
-    if ((shift < sizeof(T) * 8) && (b & 0x40)) {
-      // Sign extend.
-      val |= (~0 << shift);
+    const uint8_t second = in[1];
+    val = (val & 0x7f) | (static_cast<uint64_t>(second & 0x7f) << 7);
+    in += 2;
+    if (second < 0x80) {
+      return static_cast<T>(signExtend(val, 14));
+    }
+    unsigned shift = 14;
+    val = decodeTail(in, val, shift);
+    return static_cast<T>(signExtend(val, shift));
+  }
+  // Bounds-checked, an encoding running past `end` or longer than ceil(N / 7) bytes is rejected.
+  // `pos` is the index of `in` in the module binary for error reporting, none where it is zero.
+  template<typename T>
+  static T decodeVaruint(const uint8_t*& in, const uint8_t* end, ssize_t pos = 0) {
+    static_assert(std::is_unsigned_v<T>);
+    const auto avail = end - in;
+    if (avail >= 1 && in[0] < 0x80) {
+      return static_cast<T>(*in++);
+    }
+    if (sizeof(T) > 1 && avail >= 2 && in[1] < 0x80) {
+      const auto val = (in[0] & 0x7f) | (in[1] << 7);
+      in += 2;
+      return static_cast<T>(val);
+    }
+    unsigned bits;
+    return static_cast<T>(decodeChecked<T>(in, end, pos, bits));
+  }
+  template<typename T>
+  static T decodeVarint(const uint8_t*& in, const uint8_t* end, ssize_t pos = 0) {
+    static_assert(std::is_signed_v<T>);
+    const auto avail = end - in;
+    if (avail >= 1 && in[0] < 0x80) {
+      return static_cast<T>(signExtend(*in++, 7));
+    }
+    if (sizeof(T) > 1 && avail >= 2 && in[1] < 0x80) {
+      const auto val = (in[0] & 0x7f) | (in[1] << 7);
+      in += 2;
+      return static_cast<T>(signExtend(val, 14));
+    }
+    unsigned bits;
+    const auto val = decodeChecked<T>(in, end, pos, bits);
+    return static_cast<T>(signExtend(val, bits));
+  }
+  // Decodes `count` u32 values into `out`, which are mostly single bytes in the vectors of indices.
+  // A vector of bytes without any continuation bit is widened in one go.
+  static void decodeVaruintRun(
+    const uint8_t*& in, const uint8_t* end, uint32_t* out, size_t count, ssize_t pos = 0) {
+    const auto* const begin = in;
+    size_t i = 0;
+#if defined(__AVX2__)
+    while (count - i >= 32 && end - in >= 32) {
+      const auto bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in));
+      if (_mm256_movemask_epi8(bytes) == 0) {
+        for (int k = 0; k < 4; ++k) {
+          const auto lane = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(in + k * 8));
+          _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i + k * 8), _mm256_cvtepu8_epi32(lane));
+        }
+        in += 32;
+        i += 32;
+        continue;
+      }
+      // Backs off to the scalar decoding for a while, so that a mix of longer encodings is not slower.
+      for (const auto* const next = in + 32 * 8; in < next && i < count; ++i) {
+        out[i] = decodeVaruint<uint32_t>(in, end, pos + (in - begin));
+      }
+    }
+#endif
+#if defined(__SSE2__)
+    const auto zero = _mm_setzero_si128();
+    while (count - i >= 16 && end - in >= 16) {
+      const auto bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in));
+      if (_mm_movemask_epi8(bytes) == 0) {
+        const auto lo = _mm_unpacklo_epi8(bytes, zero);
+        const auto hi = _mm_unpackhi_epi8(bytes, zero);
+        auto* const dst = reinterpret_cast<__m128i*>(out + i);
+        _mm_storeu_si128(dst, _mm_unpacklo_epi16(lo, zero));
+        _mm_storeu_si128(dst + 1, _mm_unpackhi_epi16(lo, zero));
+        _mm_storeu_si128(dst + 2, _mm_unpacklo_epi16(hi, zero));
+        _mm_storeu_si128(dst + 3, _mm_unpackhi_epi16(hi, zero));
+        in += 16;
+        i += 16;
+        continue;
+      }
+      for (const auto* const next = in + 16 * 8; in < next && i < count; ++i) {
+        out[i] = decodeVaruint<uint32_t>(in, end, pos + (in - begin));
+      }
+    }
+#endif
+    for (; i < count; ++i) {
+      out[i] = decodeVaruint<uint32_t>(in, end, pos + (in - begin));
     }
-    return val;
   }
 };
 
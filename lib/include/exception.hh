@@ -30,11 +30,16 @@ class Exception {
     TBL_EXCEED_MAX,
     TBL_ELEM_EXCEED_MAX,
     TBL_ACCESS_OOB,
+    UNINITIALIZED_TBL_ELEM,
     MISSING_FUNC_PARAMS,
     STACK_VAL_TYPE_MISMATCH,
     UNREACHABLE,
     ILLEGAL_LOCAL_IDX,
+    ILLEGAL_FUNC_IDX,
+    ILLEGAL_ALIGNMENT,
+    INVALID_OPCODE,
     EXHAUSTED_STACK_ACCESS,
+    STACK_OVERFLOW,
     ILLEGAL_BREAK_LVL,
     ARITY_TYPE_MISMATCH,
     NO_ACTIV_ON_STACK,
@@ -52,12 +57,25 @@ class Exception {
     INVALID_INPUT_PATH,
     INSUFFICIENT_INPUT_ARGS,
     INVALID_VAL_TYPE,
+    UNEXPECTED_END,
+    INVALID_LEB128,
+    INVALID_AOT_ARTIFACT,
+    INCOMPATIBLE_OPTIONS,
   };
+  // Thrown instead of exiting on the worker threads of `Util::parallelFor`.
+  struct Deferred {
+    ErrorType type;
+    ssize_t pos;
+  };
+  static inline thread_local bool deferred = false;
   const static auto& getErrorMsg(ErrorType type) {
     return errorMsg.at(type);
   }
   [[noreturn]]
   static void terminate(ErrorType type, ssize_t pos = 0) {
+    if (deferred) {
+      throw Deferred { type, pos };
+    }
     std::stringstream ss;
     ss << std::hex << std::showbase
       << COLOR_ERR
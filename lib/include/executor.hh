@@ -4,28 +4,18 @@
 
 #include <cstddef>
 #include <optional>
-#include <exception>
 #include <type_traits>
-#include <variant>
-#include <functional>
 #include <cstdlib>
 #include <utility>
 #include <vector>
 #include <cstring>
-#include <unordered_map>
-#include <tuple>
+#include <algorithm>
 #include "lib/include/structs.hh"
 #include "lib/include/exception.hh"
 #include "lib/include/decoder.hh"
 #include "lib/include/util.hh"
 #include "lib/include/constants.hh"
 
-template<> struct std::hash<uint8_t*> {
-  size_t operator()(const uint8_t* ptr) const {
-    return reinterpret_cast<size_t>(ptr);
-  }
-};
-
 namespace TWVM {
 
 // Forward declaration
@@ -37,155 +27,106 @@ class Executor {
  public:
   enum class EngineStatus : uint8_t {
     EXECUTING,
-    CRAWLING,  // Crawling continuation (for labels).
     STOPPED,
   };
  private:
-  struct FrameOffset {
-    Runtime::stack_frame_t* ptr;
-    uint32_t offset;
-  };
   struct MemImme {
     uint32_t flags;
     uint32_t offset;
   };
-  uint8_t* pc;
-  uint8_t* storedPC;
+  Runtime::RTCodeSlot* pc;
+  Runtime::RTValue* locals = nullptr;  // Window of the top activation frame, moved on call and return.
   shared_module_runtime_t rtIns;
   EngineStatus status = EngineStatus::EXECUTING;
-  std::optional<Runtime::relative_depth_t> brIfDepth;
-  std::vector<std::vector<uint32_t>> frameBitmap = { {}, {}, {} };
-  size_t labelAboveActivFrameCount = 0;
-  struct {
-    std::unordered_map<uint8_t*, std::tuple<Runtime::runtime_value_t, uint8_t*>> rtValStore;
-    // Since we only use uint32_t for now, here we get rid of variant.
-    std::unordered_map<uint8_t*, std::tuple<Runtime::imme_u32_t, uint8_t*>> immeValStore;
-    std::unordered_map<uint8_t*, std::vector<uint8_t*>> contStore;
-  } store;
+  size_t baseDepth = 0;  // Of the frames below, run by the executors the native code was called from.
  public:
-  Executor(uint8_t* pc, shared_module_runtime_t rtIns) : pc(pc), rtIns(rtIns) {}
+  Executor(Runtime::RTCodeSlot* pc, shared_module_runtime_t rtIns) : pc(pc), rtIns(rtIns) {}
   const auto getCurrentStatus() const { return status; }
   const void stopEngine();
-  auto getEngineData() { return rtIns; }
-  std::optional<uint32_t> getTopFrameIdx(Runtime::STVariantIndex, uint32_t = 0);
-  void setInFrameBitmap(Runtime::STVariantIndex type, uint32_t idx) {
-    frameBitmap.at(Util::asInteger(type)).push_back(idx);
-  }
-  void eraseFromFrameBitmap(Runtime::STVariantIndex type, uint32_t n) {
-    auto& v = frameBitmap.at(Util::asInteger(type));
-    v.erase(v.end() - n, v.end());
+  const auto& getEngineData() const { return rtIns; }
+  auto& refTopActivFrame() { return rtIns->callStack.back(); }
+  Runtime::RTValue* refLocals() { return locals; }
+  size_t getLabelAboveActivFrameCount() {
+    return rtIns->labelStack.size() - refTopActivFrame().labelBase;
   }
-  Executor::FrameOffset refTrackedTopFrameByType(Runtime::STVariantIndex, uint32_t = 0);
-  auto getLabelAboveActivFrameCount() { return labelAboveActivFrameCount; }
   // PC-related methods.
   auto getPC() { return pc; }
-  void setPC(uint8_t* addr) { pc = addr; }
+  void setPC(Runtime::RTCodeSlot* addr) { pc = addr; }
   auto movPC(size_t steps = 1) { pc += steps; return pc; }
-  const std::vector<uint8_t*>& lookupLabelContFromPC();
-  auto decodeByteFromPC() {
-    return *reinterpret_cast<uint8_t*>(pc++);
-  }
+  // Immediates have already been decoded by the translator.
   template<typename T>
-  decltype(auto) decodeVaruintFromPC() {
-    const auto entryPC = pc;
-    auto& st = store.immeValStore;
-    const auto& iter = st.find(entryPC);
-    if (iter == st.end()) {
-      const auto v = Decoder::decodeVaruint<T>(pc);
-      st[entryPC] = std::make_tuple(v, pc);
-      const auto& [rtVal, newPC] = st[entryPC];
-      return rtVal;
-    } else {
-      const auto& [rtVal, newPC] = iter->second;
-      pc = newPC;
-      return rtVal;
-    }
+  T decodeImmeFromPC() {
+    return (pc++)->as<T>();
   }
-  template<typename T, typename U = T>
-  decltype(auto) decodeVarintFromPC() {
-    const auto entryPC = pc;
-    auto& st = store.rtValStore;
-    const auto& iter = st.find(entryPC);
-    if (iter == st.end()) {
-      const auto v = Decoder::decodeVarint<T>(pc);
-      st[entryPC] = std::make_tuple(v, pc);
-      const auto& [rtVal, newPC] = st[entryPC];
-      if constexpr (std::is_same_v<U, Runtime::runtime_value_t>) {
-        return rtVal;
-      } else {
-        return std::get<T>(rtVal);
-      }
-    } else {
-      const auto& [rtVal, newPC] = iter->second;
-      pc = newPC;
-      if constexpr (std::is_same_v<U, Runtime::runtime_value_t>) {
-        return rtVal;
-      } else {
-        return std::get<T>(rtVal);
-      }
-    }
-  }
-  template<typename T>
-  T decodeFloatingPointFromPC() {
-    static_assert(std::is_same_v<T, float> || std::is_same_v<T, double>, "Invalid de-referenced type.");
-    const auto fv = *reinterpret_cast<T*>(pc);
-    movPC(sizeof(T));
-    return fv;
+  // Continuations are encoded as offsets relative to the immediate slot.
+  Runtime::RTCodeSlot* decodeTargetFromPC() {
+    const auto slot = pc++;
+    return slot + slot->as<int32_t>();
   }
   // Stack-related methods.
-  template<typename T>
-  auto& refFrameFromStack(size_t pos = 0) {
-    try {
-      return std::get<T>(
-        rtIns->stack.at(rtIns->stack.size() - 1 - pos));
-    } catch (...) {
-      Exception::terminate(Exception::ErrorType::STACK_VAL_TYPE_MISMATCH);
-    }
+  auto& refStackVal(size_t pos = 0) {
+    return rtIns->stack[rtIns->stack.size() - 1 - pos];
   }
   template<typename T>
-  void pushToStack(T&& frame) {
-    rtIns->stack.emplace_back(std::forward<T>(frame));
-    const auto updateIdx = rtIns->stack.size() - 1;
-    if constexpr (std::is_same_v<T, Runtime::RTActivFrame>) {
-      labelAboveActivFrameCount = 0;
-      setInFrameBitmap(Runtime::STVariantIndex::ACTIVATION, updateIdx);
-    }
-    if constexpr (std::is_same_v<T, Runtime::RTLabelFrame>) {
-      labelAboveActivFrameCount++;
-      setInFrameBitmap(Runtime::STVariantIndex::LABEL, updateIdx);
-    }
+  void pushToStack(T v) {
+    rtIns->stack.push_back(Runtime::RTValue::from(v));
   }
-  void eraseRangeFromStack(uint32_t startIdx, uint32_t posToTop) {
-    rtIns->stack.erase(rtIns->stack.begin() + startIdx, rtIns->stack.end() - posToTop);
-  }
-  void eraseFrameFromStack(uint32_t IdxFromTop) {
-    rtIns->stack.erase(rtIns->stack.end() - IdxFromTop - 1, rtIns->stack.end() - IdxFromTop);
+  void pushToStack(Runtime::RTValue v) {
+    rtIns->stack.push_back(v);
   }
   void popFromStack() { rtIns->stack.pop_back(); }
-  template<typename T>
-  auto retStackValOfRTType(bool pop = true) {
-    try {
-      const T v = std::get<T>(
-        std::get<Runtime::RTValueFrame>(rtIns->stack.back()).value);
-      if (pop) rtIns->stack.pop_back();
-      return v;
-    } catch (...) {
-      Exception::terminate(Exception::ErrorType::STACK_VAL_TYPE_MISMATCH);
+  // Make room for the validated maximum depth of the callee, so that its pushes never reallocate.
+  void reserveStack(size_t depth) {
+    auto& stack = rtIns->stack;
+    const auto required = stack.size() + depth;
+    if (stack.capacity() < required) {
+      stack.reserve(std::max(required, stack.capacity() * 2));
     }
   }
-  void validateArity(const Module::type_seq_t& arity) {
-    if (arity.size() > 0) {
-      for (auto i = 0; i < arity.size(); ++i) {
-        try {
-          const auto& frame = std::get<Runtime::RTValueFrame>(*(rtIns->stack.rbegin() + i));
-          if ((frame.value.index() + arity.at(i)) != MAGIC_VAR_INDEX_PLUS_TYPE) {
-            Exception::terminate(Exception::ErrorType::ARITY_TYPE_MISMATCH);
-          }
-        } catch (...) {
-          Exception::terminate(Exception::ErrorType::STACK_VAL_TYPE_MISMATCH);
-        }
-      }
-    }
+  template<typename T>
+  T retStackValOfRTType(bool pop = true) {
+    const auto v = rtIns->stack.back().as<T>();
+    if (pop) rtIns->stack.pop_back();
+    return v;
+  }
+  void pushLabel(Runtime::RTCodeSlot* cont, uint32_t arity) {
+    rtIns->labelStack.push_back({ cont, arity, static_cast<uint32_t>(rtIns->stack.size()) });
+  }
+  // The operand stack only grows on calls, before the window of the callee is taken here.
+  void pushActiv(uint32_t localsBase, uint32_t funcIdx, const Module::type_seq_t* returnArity) {
+    locals = rtIns->stack.data() + localsBase;
+    rtIns->callStack.emplace_back(
+      localsBase,
+      funcIdx,
+      pc,
+      returnArity,
+      static_cast<uint32_t>(rtIns->labelStack.size()));
+  }
+  // Keep the top `arity` values and drop the others above `height`.
+  void unwindStack(uint32_t height, uint32_t arity) {
+    auto& stack = rtIns->stack;
+    std::copy(stack.end() - arity, stack.end(), stack.begin() + height);
+    stack.resize(height + arity);
+  }
+  Runtime::RTCodeSlot* retFromLabelWithCont(uint32_t depth = 0) {
+    auto& labelStack = rtIns->labelStack;
+    const auto label = *(labelStack.rbegin() + depth);
+    unwindStack(label.height, label.arity);
+    labelStack.resize(labelStack.size() - depth - 1);
+    return label.cont;
+  }
+  Runtime::RTCodeSlot* retFromActivWithCont() {
+    auto& frame = refTopActivFrame();
+    const auto cont = frame.cont;
+    unwindStack(frame.localsBase, frame.returnArity->size());  // Results replace the locals window.
+    rtIns->labelStack.resize(frame.labelBase);
+    rtIns->callStack.pop_back();
+    reloadLocals();
+    return cont;
+  }
+  // Also after the calls back into the VM, which may have reallocated the operand stack.
+  void reloadLocals() {
+    locals = rtIns->callStack.empty() ? nullptr : rtIns->stack.data() + rtIns->callStack.back().localsBase;
   }
   void validateTypeWithFuncIdx(const Module::func_type_t& type, Runtime::index_t funcIdx) {
     const auto& modFuncTypes = rtIns->module->funcTypes;
@@ -194,60 +135,30 @@ class Executor {
       Exception::terminate(Exception::ErrorType::FUNC_TYPE_MISMATCH);
     }
   }
-  auto collectArities() {
-    /* Using `std::vector` here for future use. */
-    auto returnArityTypes = std::vector<uint8_t>{};
-    const auto returnTypeByte = decodeByteFromPC();  // at most one.
-    if (static_cast<LangTypes>(returnTypeByte) != LangTypes::Void) {
-      returnArityTypes.push_back(returnTypeByte);
-    }
-    return returnArityTypes;
-  }
-  template<typename T>
-  uint8_t* retFromFrameWithCont(uint32_t depth = 0) {
-    if constexpr (std::is_same_v<T, Runtime::RTActivFrame>) {
-      const auto& frameOffset = refTrackedTopFrameByType(Runtime::STVariantIndex::ACTIVATION);
-      const auto& frame = std::get<T>(*frameOffset.ptr);
-      const auto& returnArity = frame.returnArity;
-      const auto cont = frame.cont;
-      validateArity(*returnArity);
-      eraseRangeFromStack(frameOffset.offset, returnArity->size());
-      eraseFromFrameBitmap(Runtime::STVariantIndex::LABEL, depth);
-      eraseFromFrameBitmap(Runtime::STVariantIndex::ACTIVATION, 1);
-      labelAboveActivFrameCount -= depth;
-      return cont;
-    }
-    if constexpr (std::is_same_v<T, Runtime::RTLabelFrame>) {
-      // Idx starts from zero.
-      const auto& frameOffset = refTrackedTopFrameByType(Runtime::STVariantIndex::LABEL, depth);
-      const auto& frame = std::get<T>(*frameOffset.ptr);
-      const auto& returnArity = frame.returnArity;
-      const auto cont = frame.cont;
-      validateArity(returnArity);  // May throw.
-      eraseRangeFromStack(frameOffset.offset, returnArity.size());
-      eraseFromFrameBitmap(Runtime::STVariantIndex::LABEL, depth + 1);  // Erase count.
-      labelAboveActivFrameCount -= (depth + 1);
-      return cont;
-    }
-  }
-  auto parseBrTableInfo() {
-    std::vector<uint32_t> brTableEntries = {};
-    const auto targetCount = decodeVaruintFromPC<Runtime::imme_u32_t>();
-    for (auto i = 0; i <= targetCount; ++i) {
-      brTableEntries.push_back(decodeVaruintFromPC<Runtime::imme_u32_t>());  // entries.
-    }
-    return brTableEntries;
+  uint32_t collectArity() {
+    // Block types are restricted to at most one result in MVP.
+    return static_cast<LangTypes>(decodeImmeFromPC<uint8_t>()) == LangTypes::Void ? 0 : 1;
   }
   MemImme parseMemImmeInfo() {
-    const auto flags = decodeVaruintFromPC<Runtime::imme_u32_t>();
-    const auto offset = decodeVaruintFromPC<Runtime::imme_u32_t>();
-    return { flags, offset };
+    // The alignment hint has been dropped by the translator.
+    const auto offset = decodeImmeFromPC<Runtime::imme_u32_t>();
+    return { 0, offset };
   }
-  size_t resizeMem(int32_t pages, uint32_t memIdx = 0) {
+  size_t resizeMem(uint32_t pages, uint32_t memIdx = 0) {
     if (rtIns->rtMems.size() > 0) {
       auto& rtMem = rtIns->rtMems.at(memIdx);
       const auto totalPages = rtMem.size + pages;
       if (totalPages <= WASM_MAX_PAGES && (rtMem.maximumPages == 0 || totalPages <= rtMem.maximumPages)) {
+        if (rtMem.reservedBytes > 0) {
+          // Committed in place, the base and the pages already in use never move.
+          if (totalPages * WASM_PAGE_SIZE_IN_BYTE > rtMem.reservedBytes ||
+            !VirtualMem::commit(rtMem.ptr, rtMem.size, totalPages)) {
+            return -1;
+          }
+          const auto prevPages = rtMem.size;
+          rtMem.size = totalPages;
+          return prevPages;
+        }
         const size_t totalBytes = totalPages * WASM_PAGE_SIZE_IN_BYTE;
         const auto ptr = static_cast<uint8_t*>(std::realloc(rtMem.ptr, totalBytes));
         if (ptr) {
@@ -267,31 +178,22 @@ class Executor {
       return -1;
     }
   }
-  // (T, T) -> U.
-  template<typename T, typename U>
-  void opHandlerFTRO(std::function<U(T, T)> handler) {
-    try {
-      auto& x = std::get<Runtime::RTValueFrame>(rtIns->stack.back());  // "c2".
-      auto& y = std::get<Runtime::RTValueFrame>(rtIns->stack.at(rtIns->stack.size() - 2));  // "c1".
-      auto ret = handler(std::get<T>(y.value), std::get<T>(x.value));
-      rtIns->stack.pop_back();  // Keep "c1" on the stage.
-      y.value = ret;
-    } catch (...) {
-      Exception::terminate(Exception::ErrorType::STACK_VAL_TYPE_MISMATCH);
-    }
+  // (T, T) -> U, kernels are passed by type so that they can be fully inlined.
+  template<typename T, typename U, typename F>
+  void opHandlerFTRO(F&& handler) {
+    auto& stack = rtIns->stack;
+    const auto y = stack.back().as<T>();  // "c2".
+    stack.pop_back();  // Keep "c1" on the stage.
+    auto& x = stack.back();  // "c1".
+    x = Runtime::RTValue::from(static_cast<U>(handler(x.as<T>(), y)));
   }
   // (T) -> U.
-  template<typename T, typename U>
-  void opHandlerFORO(std::function<U(T)> handler) {
-    try {
-      auto& v = std::get<Runtime::RTValueFrame>(rtIns->stack.back());
-      auto ret = handler(std::get<T>(v.value));
-      v.value = ret;
-    } catch (...) {
-      Exception::terminate(Exception::ErrorType::STACK_VAL_TYPE_MISMATCH);
-    }
+  template<typename T, typename U, typename F>
+  void opHandlerFORO(F&& handler) {
+    auto& v = rtIns->stack.back();
+    v = Runtime::RTValue::from(static_cast<U>(handler(v.as<T>())));
   }
-  engine_result_t postProcess();
+  engine_result_t postProcess(uint32_t);
   static engine_result_t execute(shared_module_runtime_t, std::optional<uint32_t> = {});
 };
 
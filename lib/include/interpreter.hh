@@ -6,10 +6,13 @@
 #include <optional>
 #include "lib/include/opcodes.hh"
 #include "lib/include/structs.hh"
+#include "lib/include/kernels.hh"
 
 #define DECLARE_OPCODE_HANDLER_VALID(NAME) \
   static void do##NAME(Executor&, op_handler_info_t = std::nullopt);
 #define DECLARE_OPCODE_HANDLER_INVALID(NAME)
+#define DECLARE_OPCODE_HANDLER_FUSED(NAME) \
+  DECLARE_OPCODE_HANDLER_VALID(NAME)
 #define DECLARE_OPCODE_HANDLER(NAME, OP, VALDITI) \
   DECLARE_OPCODE_HANDLER_##VALDITI(NAME)
 
@@ -25,8 +28,23 @@ struct Interpreter {
 
   // Main execution engine with direct threading support
   static void executeDirectThreaded(Executor& executor);
+  // Token-threaded loop recording every executed opcode, for `--ngram`.
+  static void executeProfiled(Executor& executor);
+  // Called by the JIT-compiled code, with the arguments in `RTValue` slots. Runs the function
+  // natively if compiled, otherwise interprets it on top of the frames of `caller`. Returns the
+  // bits of the result, if any.
+  static uint64_t callFromNative(Executor& caller, uint32_t funcIdx, const Runtime::RTValue* args);
+  // Counts the call towards the compilation of the callee with the JIT, and returns its native
+  // entry, see `JITCompiler::entry_t`, or null to interpret it, which is translated by then.
+  static void* prepareCall(Executor& executor, uint32_t funcIdx);
+  // Runs the native entry with the arguments in `RTValue` slots, returning the bits of the result.
+  static uint64_t callNative(Executor& executor, void* nativeEntry, const Runtime::RTValue* args);
+  // Counts the entries of a loop header, and runs the rest of the function natively from it once
+  // compiled with the JIT. True if the function has returned.
+  static bool enterLoopNatively(Executor& executor, uint32_t loopIdx, Runtime::RTCodeSlot& count);
 
   ITERATE_ALL_OPCODE(DECLARE_OPCODE_HANDLER)
+  ITERATE_FUSED_OPCODE(DECLARE_OPCODE_HANDLER)
 };
 
 }  // namespace TWVM
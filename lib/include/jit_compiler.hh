@@ -2,8 +2,15 @@
 #ifndef LIB_INCLUDE_JIT_COMPILER_HH_
 #define LIB_INCLUDE_JIT_COMPILER_HH_
 
+#include <atomic>
+#include <condition_variable>
+#include <iostream>
 #include <memory>
+#include <mutex>
+#include <optional>
 #include <string>
+#include <thread>
+#include <vector>
 #include "llvm/ExecutionEngine/Orc/LLJIT.h"
 #include "llvm/IR/LLVMContext.h"
 #include "llvm/IR/Module.h"
@@ -14,19 +21,62 @@ namespace TWVM {
 
 class JITCompiler {
  public:
+  // Of every compiled function, taking the arguments in `RTValue` slots and returning the bits of
+  // the result. Compiled functions take the context followed by their parameters, and call the
+  // others directly within the module, or through `Interpreter::callFromNative`.
+  using entry_t = uint64_t(*)(Runtime::RTJITContext*, const Runtime::RTValue*);
+  // Of the loop headers of a compiled function, for the on-stack replacement of its interpreted
+  // frame. Takes the locals followed by the operands of the frame, and the index of the loop, see
+  // `Translator`, and runs the function from there to its return as `entry_t` does.
+  using osr_entry_t = uint64_t(*)(Runtime::RTJITContext*, const Runtime::RTValue*, uint32_t);
+
+  // Of a function compiled, for tuning the thresholds and the pipeline against a workload.
+  struct CompileStats {
+    uint32_t funcIdx;
+    JITOptLevel optLevel;
+    bool cached;  // The object of a previous run was linked, without code generation.
+    uint32_t irInsts;  // After the pipeline, the entries included.
+    uint64_t codeBytes;  // Of the text sections of the object.
+    double translateMs;
+    double optimizeMs;
+    double codegenMs;  // Linking included.
+  };
+
   // Singleton pattern for global JIT instance
   static JITCompiler& getInstance();
 
   // Initialize LLVM ORC JIT engine
   bool initialize();
 
-  // Compile a WebAssembly function to native code
+  // Compile a WebAssembly function to native code, and publish it to the descriptor.
   bool compileFunction(uint32_t funcIdx, Runtime::RTFuncDescriptor& descriptor,
                       shared_module_runtime_t rtIns);
 
+  // Compiles the function on the threads of `EngineOptions::jitThreads`, or right away without
+  // any. The function queued with the most calls is compiled first, while the interpreter keeps
+  // running it until its native entry is published.
+  void schedule(uint32_t funcIdx, shared_module_runtime_t rtIns);
+
+  // Blocks until the functions scheduled have been compiled, or failed to.
+  void drain();
+
+  // The functions compiled so far, in the order they were published.
+  std::vector<CompileStats> stats();
+  void reportStats(std::ostream&);
+
   // Lookup compiled function pointer
   void* lookupCompiledFunction(const std::string& funcName);
 
+  // Compile every function the translation supports into a relocatable object at the path ahead
+  // of time, with a table of their addresses and the key of the module, see `CodeCache::moduleKey`,
+  // which also tells whether the memory accesses are left to the guard pages.
+  // Returns the number of functions compiled.
+  std::optional<uint32_t> compileModule(shared_module_runtime_t rtIns, const std::string& path);
+
+  // Link an object written by `compileModule` and attach its functions, without any compilation.
+  // False if it is unreadable or was compiled from another module or build.
+  bool loadModule(shared_module_runtime_t rtIns, const std::string& path);
+
   // Check if JIT is initialized
   bool isInitialized() const { return jitInitialized; }
 
@@ -38,16 +88,45 @@ class JITCompiler {
   JITCompiler(const JITCompiler&) = delete;
   JITCompiler& operator=(const JITCompiler&) = delete;
 
-  // LLVM JIT infrastructure
+  // Objects of the functions compiled, kept with the entries of the `CodeCache`.
+  class ObjectFileCache;
+
+  // LLVM JIT infrastructure, every compilation has a context of its own.
+  std::unique_ptr<ObjectFileCache> objectCache;
   std::unique_ptr<llvm::orc::LLJIT> jit;
-  std::unique_ptr<llvm::LLVMContext> context;
   bool jitInitialized = false;
+  std::atomic<uint32_t> libCount = 0;
+
+  // The compile queue, kept alive with the instances of its functions.
+  struct CompileTask {
+    shared_module_runtime_t rtIns;
+    uint32_t funcIdx;
+  };
+  std::mutex queueMutex;
+  std::condition_variable idle;  // On the last thread leaving.
+  std::vector<CompileTask> queue;
+  uint32_t workers = 0;  // Threads draining the queue.
+  bool stopping = false;
+  void work();
 
-  // Translate WebAssembly bytecode to LLVM IR
+  std::mutex statsMutex;
+  std::vector<CompileStats> compiled;
+
+  // Of its own, so that the same symbols compiled for several instances or artifacts never clash.
+  llvm::Expected<llvm::orc::JITDylib&> createLib(const std::string& prefix);
+
+  // Translate WebAssembly bytecode to LLVM IR, or to the `osr_entry_t` named "wasm_osr_<index>".
+  // Null on failure, which leaves no OSR entry in the module, and for the OSR entry of a function
+  // without loops, which sets `noLoops`.
   llvm::Function* translateToIR(uint32_t funcIdx,
                                 const Runtime::RTFuncDescriptor& descriptor,
                                 shared_module_runtime_t rtIns,
-                                llvm::Module* module);
+                                llvm::Module* module,
+                                bool osr = false,
+                                bool* noLoops = nullptr);
+
+  // Build the `entry_t` of a translated function, named "wasm_entry_<index>".
+  llvm::Function* createEntry(uint32_t funcIdx, llvm::Function* func, llvm::Module* module);
 
   // Helper: Create LLVM function signature from WebAssembly function type
   llvm::FunctionType* createFunctionType(const Module::func_type_t& funcType,
@@ -0,0 +1,298 @@
+// Copyright 2021 YHSPY. All rights reserved.
+#ifndef LIB_INCLUDE_KERNELS_HH_
+#define LIB_INCLUDE_KERNELS_HH_
+
+#include <cmath>
+#include <cfenv>
+#include <cstring>
+#include <limits>
+#include <algorithm>
+#include <type_traits>
+#include "lib/include/structs.hh"
+#include "lib/include/exception.hh"
+#include "lib/include/util.hh"
+
+// Binary operators sharing the same handler pattern (NAME, VAL_TYPE, RET_TYPE, OP_CAST_TYPE, OP).
+#define ITERATE_SIMPLE_BINOP(V) \
+  V(I32Mul, rt_i32_t, rt_i32_t, rt_i32_t, *) \
+  V(I32Add, rt_i32_t, rt_i32_t, rt_i32_t, +) \
+  V(I32Sub, rt_i32_t, rt_i32_t, rt_i32_t, -) \
+  V(I32And, rt_i32_t, rt_i32_t, rt_i32_t, &) \
+  V(I32Or, rt_i32_t, rt_i32_t, rt_i32_t, |) \
+  V(I32Xor, rt_i32_t, rt_i32_t, rt_i32_t, ^) \
+  V(I32Eq, rt_i32_t, rt_i32_t, rt_i32_t, ==) \
+  V(I32Ne, rt_i32_t, rt_i32_t, rt_i32_t, !=) \
+  V(I32LtU, rt_i32_t, rt_i32_t, imme_u32_t, <) \
+  V(I32LeU, rt_i32_t, rt_i32_t, imme_u32_t, <=) \
+  V(I32GtU, rt_i32_t, rt_i32_t, imme_u32_t, >) \
+  V(I32GeU, rt_i32_t, rt_i32_t, imme_u32_t, >=) \
+  V(I32LtS, rt_i32_t, rt_i32_t, rt_i32_t, <) \
+  V(I32LeS, rt_i32_t, rt_i32_t, rt_i32_t, <=) \
+  V(I32GtS, rt_i32_t, rt_i32_t, rt_i32_t, >) \
+  V(I32GeS, rt_i32_t, rt_i32_t, rt_i32_t, >=) \
+  V(I64Mul, rt_i64_t, rt_i64_t, rt_i64_t, *) \
+  V(I64Add, rt_i64_t, rt_i64_t, rt_i64_t, +) \
+  V(I64Sub, rt_i64_t, rt_i64_t, rt_i64_t, -) \
+  V(I64And, rt_i64_t, rt_i64_t, rt_i64_t, &) \
+  V(I64Or, rt_i64_t, rt_i64_t, rt_i64_t, |) \
+  V(I64Xor, rt_i64_t, rt_i64_t, rt_i64_t, ^) \
+  V(I64Eq, rt_i64_t, rt_i32_t, rt_i64_t, ==) \
+  V(I64Ne, rt_i64_t, rt_i32_t, rt_i64_t, !=) \
+  V(I64LtU, rt_i64_t, rt_i32_t, imme_u64_t, <) \
+  V(I64LeU, rt_i64_t, rt_i32_t, imme_u64_t, <=) \
+  V(I64GtU, rt_i64_t, rt_i32_t, imme_u64_t, >) \
+  V(I64GeU, rt_i64_t, rt_i32_t, imme_u64_t, >=) \
+  V(I64LtS, rt_i64_t, rt_i32_t, rt_i64_t, <) \
+  V(I64LeS, rt_i64_t, rt_i32_t, rt_i64_t, <=) \
+  V(I64GtS, rt_i64_t, rt_i32_t, rt_i64_t, >) \
+  V(I64GeS, rt_i64_t, rt_i32_t, rt_i64_t, >=) \
+  V(F32Mul, rt_f32_t, rt_f32_t, rt_f32_t, *) \
+  V(F32Add, rt_f32_t, rt_f32_t, rt_f32_t, +) \
+  V(F32Sub, rt_f32_t, rt_f32_t, rt_f32_t, -) \
+  V(F32Div, rt_f32_t, rt_f32_t, rt_f32_t, /) \
+  V(F32Eq, rt_f32_t, rt_i32_t, rt_f32_t, ==) \
+  V(F32Ne, rt_f32_t, rt_i32_t, rt_f32_t, !=) \
+  V(F32Lt, rt_f32_t, rt_i32_t, rt_f32_t, <) \
+  V(F32Le, rt_f32_t, rt_i32_t, rt_f32_t, <=) \
+  V(F32Gt, rt_f32_t, rt_i32_t, rt_f32_t, >) \
+  V(F32Ge, rt_f32_t, rt_i32_t, rt_f32_t, >=) \
+  V(F64Mul, rt_f64_t, rt_f64_t, rt_f64_t, *) \
+  V(F64Add, rt_f64_t, rt_f64_t, rt_f64_t, +) \
+  V(F64Sub, rt_f64_t, rt_f64_t, rt_f64_t, -) \
+  V(F64Div, rt_f64_t, rt_f64_t, rt_f64_t, /) \
+  V(F64Eq, rt_f64_t, rt_i32_t, rt_f64_t, ==) \
+  V(F64Ne, rt_f64_t, rt_i32_t, rt_f64_t, !=) \
+  V(F64Lt, rt_f64_t, rt_i32_t, rt_f64_t, <) \
+  V(F64Le, rt_f64_t, rt_i32_t, rt_f64_t, <=) \
+  V(F64Gt, rt_f64_t, rt_i32_t, rt_f64_t, >) \
+  V(F64Ge, rt_f64_t, rt_i32_t, rt_f64_t, >=)
+
+// Binary operators computed by a `Kernels` method (NAME, VAL_TYPE, RET_TYPE, KERNEL).
+#define ITERATE_BINOP(V) \
+  V(I32DivS, rt_i32_t, rt_i32_t, divS) \
+  V(I32DivU, rt_i32_t, rt_i32_t, divU) \
+  V(I32RemS, rt_i32_t, rt_i32_t, remS) \
+  V(I32RemU, rt_i32_t, rt_i32_t, remU) \
+  V(I32Shl, rt_i32_t, rt_i32_t, shl) \
+  V(I32ShrS, rt_i32_t, rt_i32_t, shrS) \
+  V(I32ShrU, rt_i32_t, rt_i32_t, shrU) \
+  V(I32Rotl, rt_i32_t, rt_i32_t, rotl) \
+  V(I32Rotr, rt_i32_t, rt_i32_t, rotr) \
+  V(I64DivS, rt_i64_t, rt_i64_t, divS) \
+  V(I64DivU, rt_i64_t, rt_i64_t, divU) \
+  V(I64RemS, rt_i64_t, rt_i64_t, remS) \
+  V(I64RemU, rt_i64_t, rt_i64_t, remU) \
+  V(I64Shl, rt_i64_t, rt_i64_t, shl) \
+  V(I64ShrS, rt_i64_t, rt_i64_t, shrS) \
+  V(I64ShrU, rt_i64_t, rt_i64_t, shrU) \
+  V(I64Rotl, rt_i64_t, rt_i64_t, rotl) \
+  V(I64Rotr, rt_i64_t, rt_i64_t, rotr) \
+  V(F32Min, rt_f32_t, rt_f32_t, min) \
+  V(F32Max, rt_f32_t, rt_f32_t, max) \
+  V(F32CopySign, rt_f32_t, rt_f32_t, copySign) \
+  V(F64Min, rt_f64_t, rt_f64_t, min) \
+  V(F64Max, rt_f64_t, rt_f64_t, max) \
+  V(F64CopySign, rt_f64_t, rt_f64_t, copySign)
+
+// Unary operators computed by a `Kernels` method (NAME, PARAM_TYPE, RET_TYPE, KERNEL), so are the lists below.
+#define ITERATE_UNOP(V) \
+  V(I32Eqz, rt_i32_t, rt_i32_t, eqz) \
+  V(I64Eqz, rt_i64_t, rt_i32_t, eqz) \
+  V(I32Clz, rt_i32_t, rt_i32_t, clz) \
+  V(I32Ctz, rt_i32_t, rt_i32_t, ctz) \
+  V(I32Popcnt, rt_i32_t, rt_i32_t, popcnt) \
+  V(I64Clz, rt_i64_t, rt_i64_t, clz) \
+  V(I64Ctz, rt_i64_t, rt_i64_t, ctz) \
+  V(I64Popcnt, rt_i64_t, rt_i64_t, popcnt) \
+  V(F32Abs, rt_f32_t, rt_f32_t, abs) \
+  V(F32Neg, rt_f32_t, rt_f32_t, neg) \
+  V(F32Ceil, rt_f32_t, rt_f32_t, ceil) \
+  V(F32Floor, rt_f32_t, rt_f32_t, floor) \
+  V(F32Trunc, rt_f32_t, rt_f32_t, trunc) \
+  V(F32NearestInt, rt_f32_t, rt_f32_t, nearest) \
+  V(F32Sqrt, rt_f32_t, rt_f32_t, sqrt) \
+  V(F64Abs, rt_f64_t, rt_f64_t, abs) \
+  V(F64Neg, rt_f64_t, rt_f64_t, neg) \
+  V(F64Ceil, rt_f64_t, rt_f64_t, ceil) \
+  V(F64Floor, rt_f64_t, rt_f64_t, floor) \
+  V(F64Trunc, rt_f64_t, rt_f64_t, trunc) \
+  V(F64NearestInt, rt_f64_t, rt_f64_t, nearest) \
+  V(F64Sqrt, rt_f64_t, rt_f64_t, sqrt) \
+  V(I32WrapI64, rt_i64_t, rt_i32_t, wrap) \
+  V(F32DemoteF64, rt_f64_t, rt_f32_t, identity) \
+  V(F64PromoteF32, rt_f32_t, rt_f64_t, identity)
+
+#define ITERATE_TRUNCOP(V) \
+  V(I32TruncF32S, rt_f32_t, rt_i32_t, truncTo<int32_t>) \
+  V(I32TruncF32U, rt_f32_t, rt_i32_t, truncTo<uint32_t>) \
+  V(I32TruncF64S, rt_f64_t, rt_i32_t, truncTo<int32_t>) \
+  V(I32TruncF64U, rt_f64_t, rt_i32_t, truncTo<uint32_t>) \
+  V(I64TruncF32S, rt_f32_t, rt_i64_t, truncTo<int64_t>) \
+  V(I64TruncF32U, rt_f32_t, rt_i64_t, truncTo<uint64_t>) \
+  V(I64TruncF64S, rt_f64_t, rt_i64_t, truncTo<int64_t>) \
+  V(I64TruncF64U, rt_f64_t, rt_i64_t, truncTo<uint64_t>)
+
+#define ITERATE_CONVERTOP(V) \
+  V(I64ExtendI32S, rt_i32_t, rt_i64_t, asSigned) \
+  V(I64ExtendI32U, rt_i32_t, rt_i64_t, asUnsigned) \
+  V(F32SConvertI32, rt_i32_t, rt_f32_t, asSigned) \
+  V(F32UConvertI32, rt_i32_t, rt_f32_t, asUnsigned) \
+  V(F32SConvertI64, rt_i64_t, rt_f32_t, asSigned) \
+  V(F32UConvertI64, rt_i64_t, rt_f32_t, asUnsigned) \
+  V(F64SConvertI32, rt_i32_t, rt_f64_t, asSigned) \
+  V(F64UConvertI32, rt_i32_t, rt_f64_t, asUnsigned) \
+  V(F64SConvertI64, rt_i64_t, rt_f64_t, asSigned) \
+  V(F64UConvertI64, rt_i64_t, rt_f64_t, asUnsigned)
+
+#define ITERATE_REINTERPRETOP(V) \
+  V(I32ReinterpretF32, rt_f32_t, rt_i32_t, reinterpret<Runtime::rt_i32_t>) \
+  V(I64ReinterpretF64, rt_f64_t, rt_i64_t, reinterpret<Runtime::rt_i64_t>) \
+  V(F32ReinterpretI32, rt_i32_t, rt_f32_t, reinterpret<Runtime::rt_f32_t>) \
+  V(F64ReinterpretI64, rt_i64_t, rt_f64_t, reinterpret<Runtime::rt_f64_t>)
+
+// Memory operators (NAME, VAL_TYPE, MEM_TYPE), `MEM_TYPE` is the type of the accessed bytes.
+#define ITERATE_LOAD_MEMOP(V) \
+  V(I32LoadMem, rt_i32_t, Runtime::rt_i32_t) \
+  V(I64LoadMem, rt_i64_t, Runtime::rt_i64_t) \
+  V(F32LoadMem, rt_f32_t, Runtime::rt_f32_t) \
+  V(F64LoadMem, rt_f64_t, Runtime::rt_f64_t) \
+  V(I32LoadMem8S, rt_i32_t, int8_t) \
+  V(I32LoadMem8U, rt_i32_t, uint8_t) \
+  V(I32LoadMem16S, rt_i32_t, int16_t) \
+  V(I32LoadMem16U, rt_i32_t, uint16_t) \
+  V(I64LoadMem8S, rt_i64_t, int8_t) \
+  V(I64LoadMem8U, rt_i64_t, uint8_t) \
+  V(I64LoadMem16S, rt_i64_t, int16_t) \
+  V(I64LoadMem16U, rt_i64_t, uint16_t) \
+  V(I64LoadMem32S, rt_i64_t, int32_t) \
+  V(I64LoadMem32U, rt_i64_t, uint32_t)
+
+#define ITERATE_STORE_MEMOP(V) \
+  V(I32StoreMem, rt_i32_t, Runtime::rt_i32_t) \
+  V(I64StoreMem, rt_i64_t, Runtime::rt_i64_t) \
+  V(F32StoreMem, rt_f32_t, Runtime::rt_f32_t) \
+  V(F64StoreMem, rt_f64_t, Runtime::rt_f64_t) \
+  V(I32StoreMem8, rt_i32_t, uint8_t) \
+  V(I32StoreMem16, rt_i32_t, uint16_t) \
+  V(I64StoreMem8, rt_i64_t, uint8_t) \
+  V(I64StoreMem16, rt_i64_t, uint16_t) \
+  V(I64StoreMem32, rt_i64_t, uint32_t)
+
+namespace TWVM {
+
+// Numeric kernels shared by the interpreter tiers, the result is casted to `RET_TYPE` by the caller.
+struct Kernels {
+  template<typename T>
+  static constexpr auto mask() { return static_cast<std::make_unsigned_t<T>>(sizeof(T) * 8 - 1); }
+  template<typename T>
+  static auto divS(T x, T y) {
+    if (y == 0) {
+      Exception::terminate(Exception::ErrorType::DIVISION_BY_ZERO);
+    }
+    if (y == -1 && x == std::numeric_limits<T>::min()) {
+      Exception::terminate(Exception::ErrorType::VAL_NOT_REPRESENTABLE);
+    }
+    return x / y;
+  }
+  template<typename T>
+  static auto divU(T x, T y) {
+    if (y == 0) {
+      Exception::terminate(Exception::ErrorType::DIVISION_BY_ZERO);
+    }
+    return static_cast<std::make_unsigned_t<T>>(x) / static_cast<std::make_unsigned_t<T>>(y);
+  }
+  template<typename T>
+  static T remS(T x, T y) {
+    if (y == 0) {
+      Exception::terminate(Exception::ErrorType::DIVISION_BY_ZERO);
+    }
+    return y == -1 ? 0 : x % y;  // Avoid the overflowing `min % -1`.
+  }
+  template<typename T>
+  static auto remU(T x, T y) {
+    if (y == 0) {
+      Exception::terminate(Exception::ErrorType::DIVISION_BY_ZERO);
+    }
+    return static_cast<std::make_unsigned_t<T>>(x) % static_cast<std::make_unsigned_t<T>>(y);
+  }
+  template<typename T>
+  static auto shl(T x, T y) {
+    return static_cast<std::make_unsigned_t<T>>(x) << (y & mask<T>());
+  }
+  template<typename T>
+  static T shrS(T x, T y) { return x >> (y & mask<T>()); }
+  template<typename T>
+  static auto shrU(T x, T y) {
+    return static_cast<std::make_unsigned_t<T>>(x) >> (y & mask<T>());
+  }
+  template<typename T>
+  static auto rotl(T x, T y) {
+    const auto ux = static_cast<std::make_unsigned_t<T>>(x);
+    const auto k = static_cast<std::make_unsigned_t<T>>(y) & mask<T>();
+    return (ux << k) | (ux >> ((sizeof(T) * 8 - k) & mask<T>()));
+  }
+  template<typename T>
+  static auto rotr(T x, T y) {
+    const auto ux = static_cast<std::make_unsigned_t<T>>(x);
+    const auto k = static_cast<std::make_unsigned_t<T>>(y) & mask<T>();
+    return (ux >> k) | (ux << ((sizeof(T) * 8 - k) & mask<T>()));
+  }
+  template<typename T>
+  static T min(T x, T y) { return std::min(x, y); }
+  template<typename T>
+  static T max(T x, T y) { return std::max(x, y); }
+  template<typename T>
+  static T copySign(T x, T y) { return std::copysign(x, y); }
+  template<typename T>
+  static bool eqz(T v) { return v == 0; }
+  template<typename T>
+  static auto clz(T v) { return Util::countLeadingZeros(v); }
+  template<typename T>
+  static auto ctz(T v) { return Util::countTrailingZeros(v); }
+  template<typename T>
+  static auto popcnt(T v) { return Util::countPopulation(v); }
+  template<typename T>
+  static T abs(T v) { return std::abs(v); }
+  template<typename T>
+  static T neg(T v) { return -v; }
+  template<typename T>
+  static T ceil(T v) { return std::ceil(v); }
+  template<typename T>
+  static T floor(T v) { return std::floor(v); }
+  template<typename T>
+  static T trunc(T v) { return std::trunc(v); }
+  template<typename T>
+  static T nearest(T v) {
+    std::fesetround(FE_TONEAREST);
+    return std::nearbyint(v);
+  }
+  template<typename T>
+  static T sqrt(T v) { return std::sqrt(v); }
+  template<typename T>
+  static auto wrap(T v) { return v & 0xffffffff; }
+  template<typename T>
+  static T identity(T v) { return v; }
+  template<typename CAST, typename T>
+  static CAST truncTo(T v) {
+    v = std::trunc(v);
+    if (!std::isnan(v) && !std::isinf(v) && Util::floatInRange<CAST>(v)) {
+      return static_cast<CAST>(v);
+    }
+    Exception::terminate(Exception::ErrorType::FLOAT_UNREPRESENTABLE);
+  }
+  template<typename T>
+  static auto asSigned(T v) { return static_cast<std::make_signed_t<T>>(v); }
+  template<typename T>
+  static auto asUnsigned(T v) { return static_cast<std::make_unsigned_t<T>>(v); }
+  template<typename R, typename T>
+  static R reinterpret(T v) {
+    static_assert(sizeof(R) == sizeof(T));
+    R r;
+    std::memcpy(&r, &v, sizeof(R));
+    return r;
+  }
+};
+
+}  // namespace TWVM
+
+#endif  // LIB_INCLUDE_KERNELS_HH_
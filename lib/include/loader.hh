@@ -4,7 +4,6 @@
 
 #include <vector>
 #include <functional>
-#include <fstream>
 #include <string>
 #include "lib/include/structs.hh"
 #include "lib/include/reader.hh"
@@ -25,12 +24,13 @@ struct Loader {
   static void parseGlobalSection(Reader&, shared_module_t);
   static void parseExportSection(Reader&, shared_module_t);
   static void parseCodeSection(Reader&, shared_module_t);
+  static void parseFuncDef(Reader&, shared_module_t);
   static void parseElementSection(Reader&, shared_module_t);
   static void parseDataSection(Reader&, shared_module_t);
-  static void preamble(std::ifstream&, shared_module_t);
-  static void parse(std::ifstream&, shared_module_t);
+  static void preamble(ByteSpan&, shared_module_t);
+  static void parse(ByteSpan&, shared_module_t, size_t);
   static void walkExtMeta(Reader&, Module::external_kind_t&, uint8_t);
-  static shared_module_t load(const std::string&);
+  static shared_module_t load(const std::string&, const EngineOptions& = {});
 };
 
 }  // namespace TWVM
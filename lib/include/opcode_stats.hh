@@ -0,0 +1,55 @@
+// Copyright 2021 YHSPY. All rights reserved.
+#ifndef LIB_INCLUDE_OPCODE_STATS_HH_
+#define LIB_INCLUDE_OPCODE_STATS_HH_
+
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <unordered_map>
+#include "lib/include/opcodes.hh"
+
+#define OPCODE_STATS_MAX_N 8
+#define OPCODE_STATS_REPORT_LIMIT 20
+
+namespace TWVM {
+
+/**
+ * Counts the sequences of 2 to `n` opcodes executed in a row, as candidates for the fused
+ * instructions of `Translator::fuse`. A sequence never spans a control instruction, since
+ * the fused ones can not contain branch targets.
+ */
+class OpcodeStats {
+  size_t n;
+  size_t filled = 0;
+  uint64_t window = 0;  // The most recent opcode is in the lowest byte.
+  std::unordered_map<uint64_t, size_t> counts[OPCODE_STATS_MAX_N + 1];
+ public:
+  explicit OpcodeStats(size_t n) : n(n) {}
+  void record(uint8_t op) {
+    window = (window << 8) | op;
+    filled = filled < n ? filled + 1 : n;
+    for (size_t len = 2; len <= filled; ++len) {
+      counts[len][window & (~0ULL >> (64 - len * 8))]++;
+    }
+    switch (static_cast<OpCodes>(op)) {
+      case OpCodes::Unreachable:
+      case OpCodes::Block:
+      case OpCodes::Loop:
+      case OpCodes::If:
+      case OpCodes::Else:
+      case OpCodes::End:
+      case OpCodes::Br:
+      case OpCodes::BrIf:
+      case OpCodes::BrTable:
+      case OpCodes::Return:
+      case OpCodes::Call:
+      case OpCodes::CallIndirect: filled = 0; break;
+      default: break;
+    }
+  }
+  void report(std::ostream&, size_t = OPCODE_STATS_REPORT_LIMIT) const;
+};
+
+}  // namespace TWVM
+
+#endif  // LIB_INCLUDE_OPCODE_STATS_HH_
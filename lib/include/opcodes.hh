@@ -198,6 +198,14 @@
   V(F32ReinterpretI32, 0xbe, VALID) \
   V(F64ReinterpretI64, 0xbf, VALID)
 
+// Superinstructions produced by `Translator::fuse`, never accepted from a module.
+#define ITERATE_FUSED_OPCODE(V) \
+  V(LocalGetI32ConstI32Add, 0xe0, FUSED) \
+  V(LocalGetI32ConstI32Sub, 0xe1, FUSED) \
+  V(LocalGetI32ConstI32LtS, 0xe2, FUSED) \
+  V(LocalGetLocalGetI32LtSBrIf, 0xe3, FUSED) \
+  V(I32ConstI32LoadMem, 0xe4, FUSED)
+
 #define DECLARE_NAMED_ENUM(NAME, OP, _) \
   NAME = OP,
 
@@ -205,6 +213,7 @@ namespace TWVM {
 
 enum class OpCodes : uint8_t {
   ITERATE_ALL_OPCODE(DECLARE_NAMED_ENUM)
+  ITERATE_FUSED_OPCODE(DECLARE_NAMED_ENUM)
 };
 
 }  // namespace TWVM
@@ -2,12 +2,12 @@
 #ifndef LIB_INCLUDE_READER_HH_
 #define LIB_INCLUDE_READER_HH_
 
+#include <algorithm>
 #include <cstddef>
 #include <vector>
-#include <fstream>
 #include <iostream>
 #include <iterator>
-#include <string>
+#include <string_view>
 #include "lib/include/structs.hh"
 #include "lib/include/decoder.hh"
 #include "lib/include/constants.hh"
@@ -15,7 +15,10 @@
 
 #define WALK_FUNC_DEF(name, type, suffix) \
     type walk##name() { \
-      return Decoder::decodeVar##suffix<type>(in); \
+      const auto* p = in.data(); \
+      const auto v = Decoder::decodeVar##suffix<type>(p, in.data() + in.size(), pos()); \
+      in.removePrefix(p - in.data()); \
+      return v; \
     }
 #define DEFINE_WALK_FUNCS(V) \
   V(U8, uint8_t, uint) \
@@ -24,42 +27,66 @@
   V(I8, int8_t, int) \
   V(I16, int16_t, int) \
   V(I32, int32_t, int)
+#define READER_LEB128_MAX_BYTES 5  // Of the 32-bit values walked by the reader.
 
 namespace TWVM {
 
+// Walks the module binary in memory, `in` holds the bytes not read yet.
 class Reader {
   int8_t sectionId = 0;
-  std::ifstream& in;
+  ByteSpan& in;
+  const uint8_t* const start;
+  const size_t startPos;  // Of `start` in the module binary, for error reporting.
+  void require(size_t n) {
+    if (n > in.size()) {
+      Exception::terminate(Exception::ErrorType::UNEXPECTED_END, pos());
+    }
+  }
  public:
   auto currentSectionId() const { return sectionId; }
-  Reader(std::ifstream& in, shared_module_t mod) : in(in) {
+  // Walks inside a section.
+  Reader(ByteSpan& in, size_t startPos) : in(in), start(in.data()), startPos(startPos) {}
+  // Starts at a section, whose id is read first once the module header has been seen.
+  Reader(ByteSpan& in, shared_module_t mod, size_t startPos) : Reader(in, startPos) {
     if (mod->hasValidHeader) {
       // Check next section id.
-      const auto parsedSectionId = static_cast<int8_t>(in.get());
+      const auto parsedSectionId = static_cast<int8_t>(walkByte());
       // To make sure the sections are organized in ASC sequence.
       if (parsedSectionId > 0 && parsedSectionId <= mod->lastParsedSectionId) {
-        Exception::terminate(Exception::ErrorType::INVALID_SECTION_ID, in.tellg());
+        Exception::terminate(Exception::ErrorType::INVALID_SECTION_ID, pos());
       }
       mod->lastParsedSectionId = parsedSectionId;
       sectionId = parsedSectionId;
     }
   }
   // Member functions.
-  std::vector<uint8_t> retrieveBytes(size_t);
+  ByteSpan retrieveBytes(size_t);
   std::vector<uint8_t> getBytesTillDelim(uint8_t);
-  size_t pos() {
-    return in.tellg();
+  size_t pos() const {
+    return startPos + (in.data() - start);
   }
   uint8_t walkByte() {
-    return static_cast<uint8_t>(in.get());
+    require(1);
+    const auto byte = *in.data();
+    in.removePrefix(1);
+    return byte;
   }
-  std::string walkStringByBytes(size_t n) {
-    std::vector<char> str(n);
-    in.read(str.data(), n);
-    return std::string(str.data(), n);
+  std::string_view walkStringByBytes(size_t n) {
+    const auto bytes = retrieveBytes(n);
+    return std::string_view(reinterpret_cast<const char*>(bytes.data()), n);
   }
   void skipBytes(size_t n) {
-    in.seekg(n, std::ios_base::cur);
+    require(n);
+    in.removePrefix(n);
+  }
+  // Appends a vector of `count` u32 values to `out`.
+  void walkU32s(std::vector<uint32_t>& out, size_t count) {
+    require(count);  // Every value takes at least a byte.
+    const auto offset = out.size();
+    out.resize(offset + count);
+    const auto* p = in.data();
+    Decoder::decodeVaruintRun(p, in.data() + in.size(), out.data() + offset, count, pos());
+    in.removePrefix(p - in.data());
   }
   DEFINE_WALK_FUNCS(WALK_FUNC_DEF)
 };
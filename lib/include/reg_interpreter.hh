@@ -0,0 +1,29 @@
+// Copyright 2021 YHSPY. All rights reserved.
+#ifndef LIB_INCLUDE_REG_INTERPRETER_HH_
+#define LIB_INCLUDE_REG_INTERPRETER_HH_
+
+#include <cstdint>
+#include "lib/include/structs.hh"
+
+namespace TWVM {
+
+class Executor;  // forward declaration.
+
+/**
+ * Executes the register stream produced by the `RegTranslator`. Frames are carved out of
+ * `Runtime::regStack`, and the result of the invoked function is left in its first slot.
+ */
+struct RegInterpreter {
+ private:
+  struct CallFrame {
+    const Runtime::RTCodeSlot* cont;
+    Runtime::RTValue* fp;
+  };
+  static const Runtime::RTCodeSlot* enterFrame(Runtime&, uint32_t, Runtime::RTValue*, const Runtime::RTValue*);
+ public:
+  static void execute(Executor&, uint32_t);
+};
+
+}  // namespace TWVM
+
+#endif  // LIB_INCLUDE_REG_INTERPRETER_HH_
@@ -0,0 +1,108 @@
+// Copyright 2021 YHSPY. All rights reserved.
+#ifndef LIB_INCLUDE_REG_TRANSLATOR_HH_
+#define LIB_INCLUDE_REG_TRANSLATOR_HH_
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+#include "lib/include/structs.hh"
+#include "lib/include/opcodes.hh"
+#include "lib/include/kernels.hh"
+
+// Register-only instructions, operands are listed after the opcode.
+#define ITERATE_REG_CONTROL_OPCODE(V) \
+  V(Unreachable) /* [] */ \
+  V(Br) /* [target] */ \
+  V(BrIfEqz) /* [cond, target] */ \
+  V(BrIfNez) /* [cond, target] */ \
+  V(BrTable) /* [idx, count, target * (count + 1)] */ \
+  V(Return) /* [src] */ \
+  V(ReturnVoid) /* [] */ \
+  V(Call) /* [funcIdx, argBase] */ \
+  V(CallIndirect) /* [typeIdx, idx, argBase] */ \
+  V(Mov) /* [dst, src] */ \
+  V(Select) /* [dst, x, y, cond] */ \
+  V(GlobalGet) /* [dst, globalIdx] */ \
+  V(GlobalSet) /* [globalIdx, src] */ \
+  V(MemorySize) /* [dst] */ \
+  V(MemoryGrow) /* [dst, src] */
+
+#define DECLARE_REG_OPCODE(NAME, ...) NAME,
+
+namespace TWVM {
+
+// Numeric instructions take [dst, src] or [dst, x, y], loads take [dst, addr, offset] and stores [addr, src, offset].
+enum class RegOpCodes : uint32_t {
+  ITERATE_REG_CONTROL_OPCODE(DECLARE_REG_OPCODE)
+  ITERATE_SIMPLE_BINOP(DECLARE_REG_OPCODE)
+  ITERATE_BINOP(DECLARE_REG_OPCODE)
+  ITERATE_UNOP(DECLARE_REG_OPCODE)
+  ITERATE_TRUNCOP(DECLARE_REG_OPCODE)
+  ITERATE_CONVERTOP(DECLARE_REG_OPCODE)
+  ITERATE_REINTERPRETOP(DECLARE_REG_OPCODE)
+  ITERATE_LOAD_MEMOP(DECLARE_REG_OPCODE)
+  ITERATE_STORE_MEMOP(DECLARE_REG_OPCODE)
+  Count,
+};
+
+/**
+ * Converts the translated stack-machine stream of a validated function into a register
+ * style stream, where operands directly address slots of the function frame:
+ *   [params | locals | constants | temporaries]
+ * Temporaries are the operand stack made addressable, the value at stack height `h` lives
+ * in the temporary slot `h` (its canonical slot).
+ *
+ * The operand stack is simulated at translation time, so `local.get` and constants emit no
+ * instruction and only push a reference to their slot, and the destination of an instruction
+ * followed by `local.set` / `local.tee` is retargeted to the local, which collapses
+ * `local.get; local.get; i32.add; local.set` into a single `I32Add`.
+ *
+ * A call passes its arguments in the canonical slots of the caller, on which the frame of
+ * the callee starts, so arguments need no copy and the result lands in its canonical slot.
+ */
+struct RegTranslator {
+ private:
+  struct CtrlFrame {
+    OpCodes op;
+    uint32_t arity;  // Carried by a branch to this label.
+    uint32_t resultArity;  // Left by the fallthrough of `End`.
+    uint32_t height;
+    size_t loopEntry;
+    std::vector<size_t> patchSlots;
+    std::optional<size_t> elseSlot;
+  };
+  struct FuncState {
+    const Module& module;
+    Runtime::RTFuncDescriptor& descriptor;
+    Runtime::code_seq_t code;
+    std::vector<uint32_t> opds;  // Virtual operand stack, holds untranslated slot references.
+    std::vector<CtrlFrame> ctrls;
+    std::vector<size_t> regSlots;  // Operands to be rebased once the constant count is known.
+    std::unordered_map<uint64_t, uint32_t> constIndices;
+    std::optional<size_t> lastDstSlot;  // Destination of the last instruction, for retargeting.
+    FuncState(const Module& module, Runtime::RTFuncDescriptor& descriptor)
+      : module(module), descriptor(descriptor) {}
+  };
+  static void emitOp(FuncState&, RegOpCodes);
+  static void emitReg(FuncState&, uint32_t);
+  static void emitDst(FuncState&);
+  static size_t emitTarget(FuncState&);
+  static void patchTarget(FuncState&, size_t, size_t);
+  static uint32_t popOpd(FuncState&);
+  static uint32_t refConst(FuncState&, Runtime::RTValue);
+  static void spill(FuncState&, size_t, bool);
+  static void assignLocal(FuncState&, uint32_t, uint32_t);
+  static void moveResult(FuncState&, const CtrlFrame&, uint32_t);
+  static void emitReturn(FuncState&);
+  static void emitBranch(FuncState&, uint32_t);
+  static bool isDirectBranch(FuncState&, uint32_t);
+  static void linkBranch(FuncState&, uint32_t, size_t);
+ public:
+  static void translate(const Module&, Runtime::RTFuncDescriptor&);
+};
+
+}  // namespace TWVM
+
+#endif  // LIB_INCLUDE_REG_TRANSLATOR_HH_
@@ -0,0 +1,62 @@
+// Copyright 2021 YHSPY. All rights reserved.
+#ifndef LIB_INCLUDE_STREAMING_LOADER_HH_
+#define LIB_INCLUDE_STREAMING_LOADER_HH_
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+#include "lib/include/structs.hh"
+#include "lib/include/exception.hh"
+
+namespace TWVM {
+
+/**
+ * Loads a module from chunks of any size pushed as they arrive, e.g. read from a pipe. Each
+ * section is parsed once its bytes are complete, except the code section, whose function
+ * bodies are handed one by one to a compile thread for validation and translation while the
+ * rest of the module is still streaming. `finish` then instantiates the module with the
+ * translated functions, so little work is left between the last byte and execution. In the
+ * lazy mode the bodies are only parsed, and left to their first calls.
+ */
+class StreamingLoader {
+  enum class Stage : uint8_t { Preamble, SectionHeader, SectionBody };
+  EngineOptions options;
+  shared_module_t mod = std::make_shared<Module>();
+  Stage stage = Stage::Preamble;
+  size_t streamPos = 0;  // Bytes pushed so far.
+  std::vector<uint8_t> header;  // The module header, or the id and size of the next section.
+  int8_t sectionId = 0;
+  size_t sectionPos = 0;  // Of the section being filled, which is `mod->source.sections.back()`.
+  size_t sectionFilled = 0;
+  size_t codeParsed = 0;  // Bytes of the code section parsed so far.
+  std::optional<uint32_t> funcDefCount;
+  // Shared with the compile thread.
+  std::vector<Runtime::RTFuncDescriptor> translated;
+  std::thread compiler;
+  std::mutex mutex;
+  std::condition_variable arrived;
+  size_t ready = 0;  // Function bodies complete so far.
+  bool closed = false;
+  std::optional<Exception::Deferred> failure;
+  void consume(const uint8_t*, size_t);
+  void beginSection();
+  void parseFuncDefs();
+  void endSection();
+  void compile();
+  void stopCompiler();
+ public:
+  explicit StreamingLoader(const EngineOptions& options = {}) : options(options) {}
+  ~StreamingLoader() { stopCompiler(); }
+  void push(const uint8_t*, size_t);
+  shared_module_runtime_t finish();
+  // Streams a whole module from a file descriptor, such as stdin.
+  static shared_module_runtime_t load(int, const EngineOptions& = {});
+};
+
+}  // namespace TWVM
+
+#endif  // LIB_INCLUDE_STREAMING_LOADER_HH_
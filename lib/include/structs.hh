@@ -2,17 +2,22 @@
 #ifndef LIB_INCLUDE_STRUCTS_HH_
 #define LIB_INCLUDE_STRUCTS_HH_
 
+#include <atomic>
 #include <cstddef>
 #include <cstdint>
+#include <cstring>
 #include <memory>
 #include <map>
 #include <string>
+#include <string_view>
 #include <vector>
 #include <optional>
 #include <type_traits>
 #include <variant>
 #include <algorithm>
 #include <utility>
+#include "lib/include/constants.hh"
+#include "lib/include/virtual_mem.hh"
 
 #define SET_STRUCT_DISABLE_COPY_CONSTUCT(TypeName) \
   TypeName(const TypeName&) = delete; \
@@ -25,6 +30,8 @@
 
 namespace TWVM {
 
+class Executor;  // forward declaration.
+
 /* Basic Types */
 enum class LangTypes : uint8_t {
   Void = 0x40,
@@ -44,6 +51,21 @@ enum class LimitFlags : uint8_t {
   MAX_EXIST,
 };
 
+// A range of bytes inside the module binary, which stays alive as long as the module does.
+struct ByteSpan {
+  const uint8_t* ptr = nullptr;
+  size_t len = 0;
+  const uint8_t* data() const { return ptr; }
+  size_t size() const { return len; }
+  bool empty() const { return len == 0; }
+  const uint8_t* begin() const { return ptr; }
+  const uint8_t* end() const { return ptr + len; }
+  void removePrefix(size_t n) {
+    ptr += n;
+    len -= n;
+  }
+};
+
 class Module {
  public:
   struct TableType {
@@ -84,26 +106,27 @@ class Module {
   };
   struct ExportSeg {
     SET_STRUCT_MOVE_ONLY(ExportSeg)
-    std::string name;
+    std::string_view name;
     uint8_t extKind;
     uint32_t extIdx;
-    ExportSeg(std::string name, uint8_t extKind, uint32_t extIdx)
+    ExportSeg(std::string_view name, uint8_t extKind, uint32_t extIdx)
       : name(name), extKind(extKind), extIdx(extIdx) {}
   };
   struct FuncDefSeg {
     SET_STRUCT_MOVE_ONLY(FuncDefSeg)
     std::vector<uint8_t> locals;
-    std::vector<uint8_t> body;
-    FuncDefSeg(std::vector<uint8_t>& locals, std::vector<uint8_t>& body)
+    ByteSpan body;
+    uint32_t maxStackDepth = 0;  // Filled by the validator.
+    FuncDefSeg(std::vector<uint8_t>& locals, ByteSpan body)
       : locals(locals), body(body) {}
   };
   struct ImportSeg {
     SET_STRUCT_MOVE_ONLY(ImportSeg)
-    std::string modName;
-    std::string name;
+    std::string_view modName;
+    std::string_view name;
     uint8_t extKind;
     external_kind_t extMeta;
-    ImportSeg(std::string modName, std::string name, uint8_t extKind)
+    ImportSeg(std::string_view modName, std::string_view name, uint8_t extKind)
       : modName(modName), name(name), extKind(extKind) {}
   };
   struct ElemSeg {
@@ -118,11 +141,42 @@ class Module {
     SET_STRUCT_MOVE_ONLY(DataSeg)
     uint32_t memIdx;
     std::vector<uint8_t> initOpCodes;
-    std::vector<uint8_t> dataBytes;
-    DataSeg(uint32_t memIdx, std::vector<uint8_t>& initOpCodes, std::vector<uint8_t>& dataBytes)
+    ByteSpan dataBytes;
+    DataSeg(uint32_t memIdx, std::vector<uint8_t>& initOpCodes, ByteSpan dataBytes)
       : memIdx(memIdx), initOpCodes(initOpCodes), dataBytes(dataBytes) {}
   };
+  // The binary the spans and names point into, either mapped from the file or read into `buffer`,
+  // or held section by section when streamed.
+  struct Source {
+    SET_STRUCT_DISABLE_COPY_CONSTUCT(Source);
+    const uint8_t* ptr = nullptr;
+    size_t size = 0;
+    bool mapped = false;
+    std::vector<uint8_t> buffer;
+    std::vector<std::vector<uint8_t>> sections;
+    Source() = default;
+    ~Source() {
+      if (mapped) {
+        VirtualMem::unmapFile(ptr, size);
+      }
+    }
+  };
+  // The entry of the `CodeCache` found for the module, mapped read-only.
+  struct CacheEntry {
+    SET_STRUCT_DISABLE_COPY_CONSTUCT(CacheEntry);
+    std::string key;  // Empty when the cache is disabled.
+    const uint8_t* ptr = nullptr;  // Null on a miss.
+    size_t size = 0;
+    CacheEntry() = default;
+    ~CacheEntry() {
+      if (ptr) {
+        VirtualMem::unmapFile(ptr, size);
+      }
+    }
+  };
  public:
+  Source source;
+  CacheEntry cached;
   bool hasValidHeader = false;
   size_t lastParsedSectionId = 0;
   uint32_t version = 1;
@@ -141,14 +195,27 @@ class Module {
 using shared_module_t = std::shared_ptr<Module>;
 
 /* Runtime Types */
+// The IR passes run on the functions compiled by the `JITCompiler`, before code generation.
+enum class JITOptLevel : uint8_t {
+  None,  // As translated, with the locals in stack slots.
+  Baseline,  // Promoted to SSA values and simplified, for a fraction of the time of code generation.
+  Optimizing,  // With GVN and the loop optimizations on top.
+};
+// Execution settings collected from the command line.
+struct EngineOptions {
+  bool jitEnabled = false;  // Tiered JIT compilation.
+  uint32_t jitThreshold = JIT_CALL_THRESHOLD;  // Calls before a function is compiled, on the first one by 0.
+  uint32_t jitThreads = 1;  // Compiling in the background, or on the executing thread by 0.
+  uint32_t jitLoopThreshold = JIT_LOOP_THRESHOLD;  // Entries of a loop header before its function is compiled.
+  JITOptLevel jitOptLevel = JITOptLevel::Baseline;  // Also of the objects written by `--compile`.
+  bool regEnabled = false;  // Register-based interpreter tier.
+  uint32_t ngramSize = 0;  // Collect opcode n-grams up to this length, disabled by 0.
+  bool guardedMem = false;  // Bounds check linear memory with guard pages.
+  uint32_t threads = 0;  // Validating and translating functions in parallel, one per core by 0.
+  bool lazy = false;  // Validate and translate each function on its first call.
+  std::string cacheDir;  // Of the `CodeCache`, disabled when empty.
+};
 struct Runtime {
-  enum class STVariantIndex : int8_t {
-    // The order of types here should be consistent with the below stack definition, -
-    // and this will be used to test the type of the stack frame.
-    VALUE = 0,
-    LABEL,
-    ACTIVATION,
-  };
   using rt_i32_t = int32_t;
   using rt_i64_t = int64_t;
   using rt_f32_t = float;
@@ -159,63 +226,155 @@ struct Runtime {
   using index_t = uint32_t;
   using runtime_value_t = std::variant<rt_i32_t, rt_i64_t, rt_f32_t, rt_f64_t>;
 
+  // One word of the translated instruction stream, holds either an opcode or a decoded immediate.
+  struct RTCodeSlot {
+    uint64_t bits = 0;
+    template<typename T>
+    static RTCodeSlot from(T v) {
+      static_assert(sizeof(T) <= sizeof(uint64_t), "Immediate does not fit into a code slot.");
+      RTCodeSlot slot;
+      std::memcpy(&slot.bits, &v, sizeof(T));
+      return slot;
+    }
+    template<typename T>
+    T as() const {
+      T v;
+      std::memcpy(&v, &bits, sizeof(T));
+      return v;
+    }
+  };
+  using code_seq_t = std::vector<RTCodeSlot>;
+  // Untagged operand stack slot, value types are tracked by the code instead of the slot.
+  struct RTValue {
+    uint64_t bits = 0;
+    template<typename T>
+    static RTValue from(T v) {
+      static_assert(sizeof(T) <= sizeof(uint64_t), "Value does not fit into a stack slot.");
+      RTValue value;
+      std::memcpy(&value.bits, &v, sizeof(T));
+      return value;
+    }
+    static RTValue from(const runtime_value_t& v) {
+      return std::visit([](auto x) { return from(x); }, v);
+    }
+    template<typename T>
+    T as() const {
+      T v;
+      std::memcpy(&v, &bits, sizeof(T));
+      return v;
+    }
+    runtime_value_t as(uint8_t valType) const {
+      switch (static_cast<ValueTypes>(valType)) {
+        case ValueTypes::I64: return as<rt_i64_t>();
+        case ValueTypes::F32: return as<rt_f32_t>();
+        case ValueTypes::F64: return as<rt_f64_t>();
+        default: return as<rt_i32_t>();
+      }
+    }
+  };
+
+  // Moved as a plain value, before any other thread shares it.
+  template<typename T>
+  struct MovableAtomic : std::atomic<T> {
+    MovableAtomic(T v = T {}) : std::atomic<T>(v) {}
+    MovableAtomic(MovableAtomic&& other) noexcept : std::atomic<T>(other.load(std::memory_order_relaxed)) {}
+    MovableAtomic& operator=(MovableAtomic&& other) noexcept {
+      this->store(other.load(std::memory_order_relaxed), std::memory_order_relaxed);
+      return *this;
+    }
+  };
   struct RTFuncDescriptor {
     SET_STRUCT_MOVE_ONLY(RTFuncDescriptor)
     const Module::func_type_t* funcType;
-    uint8_t* codeEntry;
-    std::vector<runtime_value_t> localsDefault;
+    code_seq_t code;  // Translated body.
+    RTCodeSlot* codeEntry;  // Null for a stub of the lazy mode, whose body is still the bytes in the module.
+    std::vector<RTValue> localsDefault;
+    uint32_t maxStackDepth = 0;
 
-    // JIT compilation support
-    uint32_t executionCount = 0;
-    void* jitCompiledPtr = nullptr;  // Native function pointer after JIT compilation
-    bool isJitCompiled = false;
+    // JIT compilation support, shared with the compile threads.
+    MovableAtomic<uint32_t> executionCount = 0;  // Written by the executing thread only.
+    MovableAtomic<void*> jitCompiledPtr = nullptr;  // Native entry after JIT compilation, see `JITCompiler::entry_t`.
+    MovableAtomic<void*> osrEntryPtr = nullptr;  // At the loop headers, published first, see `JITCompiler::osr_entry_t`.
+    bool jitScheduled = false;  // Handed to the `JITCompiler`, which is never done twice.
 
-    RTFuncDescriptor(const Module::func_type_t* funcType, uint8_t* codeEntry)
-      : funcType(funcType), codeEntry(codeEntry) {}
-  };
-  struct RTValueFrame {
-    SET_STRUCT_MOVE_ONLY(RTValueFrame)
-    runtime_value_t value;
-    RTValueFrame(const runtime_value_t& value)
-      : value(value) {}
+    // Register tier, filled by the `RegTranslator` only when enabled.
+    code_seq_t regCode;
+    std::vector<RTValue> regConsts;
+    uint32_t regFrameSize = 0;  // Locals + constants + temporaries.
+
+    RTFuncDescriptor(const Module::func_type_t* funcType, code_seq_t&& code)
+      : funcType(funcType), code(std::move(code)), codeEntry(this->code.data()) {}
+    explicit RTFuncDescriptor(const Module::func_type_t* funcType) : funcType(funcType), codeEntry(nullptr) {}
+    bool isJitCompiled() const { return jitCompiledPtr.load(std::memory_order_acquire) != nullptr; }
   };
   struct RTLabelFrame {
-    SET_STRUCT_MOVE_ONLY(RTLabelFrame)
-    uint8_t* cont;
-    Module::type_seq_t returnArity;
-    RTLabelFrame(uint8_t* cont, const Module::type_seq_t& returnArity = {})
-      : cont(cont), returnArity(returnArity) {}
+    RTCodeSlot* cont;
+    uint32_t arity;
+    uint32_t height;  // Operand stack height on entering.
   };
   struct RTActivFrame {
-    SET_STRUCT_MOVE_ONLY(RTActivFrame)
-    std::vector<runtime_value_t> locals;
-    uint8_t* cont;
+    uint32_t localsBase;  // Locals live in a window of the operand stack, arguments first.
+    uint32_t funcIdx;
+    RTCodeSlot* cont;
     const Module::type_seq_t* returnArity;
-    RTActivFrame(std::vector<runtime_value_t>& locals, uint8_t* cont, const Module::type_seq_t* returnArity)
-      : locals(locals), cont(cont), returnArity(returnArity) {}
+    uint32_t labelBase;  // Label stack height on entering.
+    RTActivFrame(
+      uint32_t localsBase,
+      uint32_t funcIdx,
+      RTCodeSlot* cont,
+      const Module::type_seq_t* returnArity,
+      uint32_t labelBase)
+      : localsBase(localsBase), funcIdx(funcIdx), cont(cont), returnArity(returnArity), labelBase(labelBase) {}
   };
   struct RTMemHolder {
     SET_STRUCT_MOVE_ONLY(RTMemHolder)
     size_t size;  // Pages.
     uint8_t* ptr;
     uint32_t maximumPages;
-    RTMemHolder(size_t size, uint8_t* ptr, uint32_t maximumPages)
-      : size(size), ptr(ptr), maximumPages(maximumPages) {}
+    size_t reservedBytes = 0;  // Address space reserved by `VirtualMem`, or 0 if allocated on the heap.
+    bool guarded = false;  // Accesses are not bounds checked, the reservation traps instead.
+    RTMemHolder(size_t size, uint8_t* ptr, uint32_t maximumPages, size_t reservedBytes = 0, bool guarded = false)
+      : size(size), ptr(ptr), maximumPages(maximumPages), reservedBytes(reservedBytes), guarded(guarded) {}
+  };
+  // An element of the default table as seen by `call_indirect` in the JIT-compiled code, whose
+  // signature check is a single comparison of the canonical type indices.
+  struct RTJITTableEntry {
+    uint32_t typeIdx;  // `JIT_TABLE_ELEM_UNINITIALIZED` for the elements never initialized.
+    uint32_t funcIdx;
+  };
+  // Reached by the JIT-compiled code through the first argument of every function, refreshed on
+  // each entry from the interpreter.
+  struct RTJITContext {
+    uint8_t* memBase = nullptr;
+    uint64_t memBytes = 0;
+    RTValue* globals = nullptr;
+    const RTJITTableEntry* table = nullptr;
+    uint64_t tableSize = 0;
+    Runtime* runtime = nullptr;
+    Executor* caller = nullptr;  // Of the calls back into the VM.
   };
   shared_module_t module;
   std::vector<RTMemHolder> rtMems;
   std::vector<std::vector<std::optional<uint32_t>>> rtTables;  // Func idx inside.
-  std::vector<runtime_value_t> rtGlobals;
-  using stack_frame_t = std::variant<RTValueFrame, RTLabelFrame, RTActivFrame>;
-  std::vector<stack_frame_t> stack;
+  std::vector<RTValue> rtGlobals;
+  std::vector<RTValue> stack;  // Operands.
+  std::vector<RTLabelFrame> labelStack;
+  std::vector<RTActivFrame> callStack;
   std::optional<uint32_t> rtEntryIdx;
   std::vector<RTFuncDescriptor> rtFuncDescriptor;
-  bool jitEnabled = false;  // JIT compilation flag
+  EngineOptions options;
+  std::vector<RTValue> regStack;  // Register frames, allocated on the first invocation.
+  RTJITContext jitContext;
+  std::vector<RTJITTableEntry> jitTable;  // Built on the first native call, MVP tables never change.
   explicit Runtime(shared_module_t module) : module(module) {}
   ~Runtime() {
     // Free allocated mem.
     std::for_each(rtMems.begin(), rtMems.end(), [](RTMemHolder& mem) {
-      std::free(mem.ptr);
+      if (mem.reservedBytes > 0) {
+        VirtualMem::release(mem.ptr, mem.reservedBytes);
+      } else {
+        std::free(mem.ptr);
+      }
     });
   }
 };
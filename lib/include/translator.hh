@@ -0,0 +1,48 @@
+// Copyright 2021 YHSPY. All rights reserved.
+#ifndef LIB_INCLUDE_TRANSLATOR_HH_
+#define LIB_INCLUDE_TRANSLATOR_HH_
+
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <optional>
+#include <vector>
+#include "lib/include/structs.hh"
+#include "lib/include/opcodes.hh"
+
+namespace TWVM {
+
+/**
+ * Rewrites the Wasm bytecode of a function body into a fixed-width instruction stream,
+ * each opcode and each of its immediates occupies one `RTCodeSlot`, with all the LEB128
+ * immediates decoded once ahead of execution.
+ *
+ * Structured instructions carry their continuations as slot offsets relative to the
+ * immediate itself:
+ *   Block: [op, blocktype, end]
+ *   Loop:  [op, blocktype, loop, count]
+ *   If:    [op, blocktype, else, end]
+ * where `else` points to the first instruction of the else arm, or to the `End` opcode
+ * if there is no else arm, and `end` points to the instruction following `End`. `loop` is
+ * the index of the loop among those of the function in order, as seen by the JIT, and
+ * `count` the entries of its header so far, updated in place by the interpreter.
+ *
+ * `fuse` then replaces the opcode heading a frequent instruction sequence with the one of
+ * its superinstruction (see `ITERATE_FUSED_OPCODE`), the remaining slots are left intact.
+ */
+struct Translator {
+ private:
+  struct CtrlEntry {
+    std::vector<size_t> endSlots;
+    std::optional<size_t> elseSlot;
+  };
+  static size_t immeCount(const Runtime::code_seq_t&, size_t);
+  static size_t matchSeq(const Runtime::code_seq_t&, size_t, std::initializer_list<OpCodes>);
+ public:
+  static Runtime::code_seq_t translate(const ByteSpan&);
+  static void fuse(Runtime::code_seq_t&);
+};
+
+}  // namespace TWVM
+
+#endif  // LIB_INCLUDE_TRANSLATOR_HH_
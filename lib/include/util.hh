@@ -2,15 +2,24 @@
 #ifndef LIB_INCLUDE_UTIL_HH_
 #define LIB_INCLUDE_UTIL_HH_
 
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
 #include <cstdint>
+#include <optional>
+#include <thread>
 #include <type_traits>
 #include <limits>
+#include <utility>
+#include <vector>
+#include "lib/include/exception.hh"
 
 #if defined(LINUX)
 #include <sys/sysinfo.h>
 #endif
 
 #define DEFAULT_CPU_CORE 4
+#define PARALLEL_FOR_CHUNK 16
 
 namespace TWVM {
 
@@ -28,6 +37,59 @@ struct Util {
     return DEFAULT_CPU_CORE;
 #endif
   }
+  /**
+   * Runs `fn(i)` for every i in [0, count) on up to `threads` threads, one per core for 0.
+   * Each index is handled exactly once, so results written per index are deterministic, and
+   * an error is reported for the lowest failing index, as a sequential loop would do.
+   */
+  template<typename F>
+  static void parallelFor(size_t count, uint32_t threads, F&& fn) {
+#if defined(OPT_PAR_LOADING)
+    const auto workers = std::min(count, static_cast<size_t>(threads > 0 ? threads : getNprocs()));
+#else
+    const size_t workers = 1;
+#endif
+    if (workers <= 1) {
+      for (size_t i = 0; i < count; ++i) {
+        fn(i);
+      }
+      return;
+    }
+    std::atomic<size_t> next = 0;
+    std::atomic<size_t> firstFailed = count;  // Indices past a failure need not be run.
+    std::vector<std::optional<std::pair<size_t, Exception::Deferred>>> failures(workers);
+    const auto work = [&](size_t w) {
+      Exception::deferred = true;
+      for (size_t begin; (begin = next.fetch_add(PARALLEL_FOR_CHUNK)) < count;) {
+        const auto end = std::min(begin + PARALLEL_FOR_CHUNK, count);
+        for (auto i = begin; i < end && i < firstFailed.load(std::memory_order_relaxed); ++i) {
+          try {
+            fn(i);
+          } catch (const Exception::Deferred& e) {
+            // Chunks are taken in increasing order, so this is the lowest failure of the worker.
+            failures[w] = std::make_pair(i, e);
+            for (auto cur = firstFailed.load(); i < cur && !firstFailed.compare_exchange_weak(cur, i);) {}
+            return;
+          }
+        }
+      }
+    };
+    std::vector<std::thread> pool;
+    for (size_t w = 0; w < workers; ++w) {
+      pool.emplace_back(work, w);
+    }
+    for (auto& t : pool) {
+      t.join();
+    }
+    const auto failure = std::min_element(failures.begin(), failures.end(), [](auto& x, auto& y) {
+      return x && (!y || x->first < y->first);
+    });
+    if (*failure) {
+      Exception::terminate((*failure)->second.type, (*failure)->second.pos);
+    }
+  }
+  // A fast non-cryptographic hash, e.g. for the content-addressed keys of `CodeCache`.
+  static std::pair<uint64_t, uint64_t> hash128(const uint8_t*, size_t, uint64_t = 0);
   template<typename T, typename U>
   static constexpr bool floatInRange(U u) {
     if constexpr (std::is_unsigned_v<T>) {
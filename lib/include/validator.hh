@@ -0,0 +1,52 @@
+// Copyright 2021 YHSPY. All rights reserved.
+#ifndef LIB_INCLUDE_VALIDATOR_HH_
+#define LIB_INCLUDE_VALIDATOR_HH_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "lib/include/structs.hh"
+#include "lib/include/opcodes.hh"
+
+namespace TWVM {
+
+/**
+ * Type-checks every function body once, right after loading (or on its first call in the lazy
+ * mode, see `EngineOptions::lazy`), following the validation
+ * algorithm of the spec (an operand type stack plus a control stack). A module passing
+ * validation can be executed without any dynamic type, arity or index checks.
+ *
+ * As a by-product, the maximum operand stack depth of each function is recorded into
+ * `Module::FuncDefSeg::maxStackDepth`. Functions are validated independently of each other,
+ * across threads when built with `OPT_PAR_LOADING`.
+ */
+struct Validator {
+ private:
+  struct CtrlFrame {
+    OpCodes op;
+    uint8_t resultType;  // `LangTypes::Void` for no result.
+    size_t height;
+    bool unreachable;
+  };
+  struct FuncState {
+    std::vector<uint8_t> opds;
+    std::vector<CtrlFrame> ctrls;
+    size_t maxDepth = 0;
+  };
+  static void pushOpd(FuncState&, uint8_t);
+  static uint8_t popOpd(FuncState&);
+  static uint8_t popOpd(FuncState&, uint8_t);
+  static void pushCtrl(FuncState&, OpCodes, uint8_t);
+  static CtrlFrame popCtrl(FuncState&);
+  static uint8_t labelType(const CtrlFrame&);
+  static void markUnreachable(FuncState&);
+ public:
+  // Range-checks the function and type indices used outside the function bodies.
+  static void validateModule(shared_module_t);
+  static void validateFunc(shared_module_t, uint32_t);
+  static void validate(shared_module_t, const EngineOptions& = {});
+};
+
+}  // namespace TWVM
+
+#endif  // LIB_INCLUDE_VALIDATOR_HH_
@@ -0,0 +1,42 @@
+// Copyright 2021 YHSPY. All rights reserved.
+#ifndef LIB_INCLUDE_VIRTUAL_MEM_HH_
+#define LIB_INCLUDE_VIRTUAL_MEM_HH_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define VIRTUAL_MEM_SUPPORTED 1
+#endif
+#define GUARDED_MEM_MAX_REGIONS 16
+
+namespace TWVM {
+
+/**
+ * Linear memory backed by reserved address space. The reservation is inaccessible and only
+ * the pages of the current memory size are committed, so growing never moves the base.
+ *
+ * A guarded memory reserves the whole range reachable by a 32-bit address plus a 32-bit
+ * offset, and registers it with the fault handler, which turns an out-of-bounds access
+ * into a `MEM_ACCESS_OOB` trap instead of relying on explicit bounds checks.
+ */
+struct VirtualMem {
+ private:
+  static void installTrapHandler();
+ public:
+  // Returns nullptr when the range can not be reserved, callers fall back to `calloc`.
+  static uint8_t* reserve(size_t reservedBytes, size_t pages);
+  // Returns false when no more guarded regions can be registered.
+  static bool trapFaults(uint8_t* base, size_t reservedBytes);
+  // Commits the pages in [prevPages, pages), which are zero-filled by the kernel.
+  static bool commit(uint8_t* base, size_t prevPages, size_t pages);
+  static void release(uint8_t* base, size_t reservedBytes);
+  // Maps a file read-only, returns nullptr when it can not be mapped or is empty.
+  static const uint8_t* mapFile(const std::string& path, size_t& size);
+  static void unmapFile(const uint8_t* base, size_t size);
+};
+
+}  // namespace TWVM
+
+#endif  // LIB_INCLUDE_VIRTUAL_MEM_HH_
@@ -10,6 +10,10 @@
 #include "lib/include/exception.hh"
 #include "lib/include/constants.hh"
 #include "lib/include/decoder.hh"
+#include "lib/include/translator.hh"
+#include "lib/include/reg_translator.hh"
+#include "lib/include/validator.hh"
+#include "lib/include/code_cache.hh"
 #if __has_include(<lib/include/state.hh>)
 #include <string_view>
 #include <string>
@@ -47,29 +51,70 @@ Runtime::runtime_value_t Instantiator::evalInitExpr(uint8_t valType, std::vector
     Exception::terminate(Exception::ErrorType::INVALID_GLOBAL_SIG);
   }
 }
-shared_module_runtime_t Instantiator::instantiate(shared_module_t mod, bool jitEnabled) {
+Runtime::RTFuncDescriptor Instantiator::translateFunc(const Module& mod, uint32_t funcIdx, const EngineOptions& options) {
+  const auto& funcDef = mod.funcDefs[funcIdx];
+  // Wasm bytecode -> fixed-width instruction stream.
+  Runtime::RTFuncDescriptor descriptor(
+    &mod.funcTypes.at(mod.funcTypesIndices.at(funcIdx)), Translator::translate(funcDef.body));
+  // Params and locals are zero-initialized untagged slots.
+  descriptor.localsDefault.resize(descriptor.funcType->first.size() + funcDef.locals.size());
+  descriptor.maxStackDepth = funcDef.maxStackDepth;
+  if (options.regEnabled) {
+    RegTranslator::translate(mod, descriptor);
+  }
+  // Opcode statistics are collected over the unfused stream.
+  if (options.ngramSize == 0) {
+    Translator::fuse(descriptor.code);
+  }
+  return descriptor;
+}
+Runtime::RTFuncDescriptor& Instantiator::translateLazily(Runtime& rt, uint32_t funcIdx) {
+  auto& descriptor = rt.rtFuncDescriptor[funcIdx];
+  if (descriptor.codeEntry == nullptr) {
+    Validator::validateFunc(rt.module, funcIdx);
+    descriptor = translateFunc(*rt.module, funcIdx, rt.options);
+  }
+  return descriptor;
+}
+shared_module_runtime_t Instantiator::instantiate(
+  shared_module_t mod, const EngineOptions& options, std::vector<Runtime::RTFuncDescriptor>&& translated) {
   auto executableIns = std::make_shared<Runtime>(mod);
-  executableIns->jitEnabled = jitEnabled;
+  executableIns->options = options;
+  // Calls take their frames from these, so that only very deep recursions ever reallocate.
+  executableIns->stack.reserve(STACK_RESERVED_SLOTS);
+  executableIns->stack.emplace_back();  // The bottom slot, see `Interpreter::executeDirectThreaded`.
+  executableIns->callStack.reserve(CALL_STACK_RESERVED_FRAMES);
+  executableIns->labelStack.reserve(CALL_STACK_RESERVED_FRAMES);
   /* imports - type / num */
   // TODO(Jason Yu): after MVP.
 
   /* globals - init */
   for (auto &i : mod->globals) {
     executableIns->rtGlobals.push_back(
-      evalInitExpr(i.globalType.valType, i.initOpCodes));
+      Runtime::RTValue::from(evalInitExpr(i.globalType.valType, i.initOpCodes)));
   }
 
   /* func */
-  for (auto i = 0; i < mod->funcDefs.size(); ++i) {
-    const auto typeIdx = mod->funcTypesIndices.at(i);
-    const auto& funcType = mod->funcTypes.at(typeIdx);
-    const auto codeEntry = mod->funcDefs.at(i).body.data();
-    // Wasm types -> RT types (value).
-    executableIns->rtFuncDescriptor.emplace_back(&funcType, codeEntry);
-    expandWasmTypesToRTValues(
-      executableIns->rtFuncDescriptor.back().localsDefault,
-      funcType.first,
-      mod->funcDefs.at(i).locals);
+  auto& descriptors = executableIns->rtFuncDescriptor;
+  if (!translated.empty()) {
+    descriptors = std::move(translated);
+  } else if (mod->cached.ptr != nullptr) {
+    descriptors = CodeCache::restore(*mod);
+  } else if (options.lazy) {
+    // Only the signatures are needed up front, e.g. by `call_indirect` and the entry arguments.
+    descriptors.reserve(mod->funcDefs.size());
+    for (uint32_t i = 0; i < mod->funcDefs.size(); ++i) {
+      descriptors.emplace_back(&mod->funcTypes.at(mod->funcTypesIndices.at(i)));
+    }
+  } else {
+    descriptors.resize(mod->funcDefs.size());
+    // Each function is translated into its own descriptor, so this runs across threads.
+    Util::parallelFor(descriptors.size(), options.threads, [&](size_t i) {
+      descriptors[i] = translateFunc(*mod, static_cast<uint32_t>(i), options);
+    });
+    if (!mod->cached.key.empty()) {
+      CodeCache::store(*mod, options, descriptors);
+    }
   }
 
   /* mem */
@@ -77,9 +122,22 @@ shared_module_runtime_t Instantiator::instantiate(shared_module_t mod, bool jitE
     const auto memType = i.memType;
     if (memType.maximum == 0 ||
       (memType.maximum > 0 && memType.initial <= memType.maximum)) {
-      const auto size = memType.initial * WASM_PAGE_SIZE_IN_BYTE;
-      executableIns->rtMems.emplace_back(
-        memType.initial, static_cast<uint8_t*>(std::calloc(size, sizeof(uint8_t))), memType.maximum);
+      // Reserve for the maximum size up front, so that growing never moves the memory.
+      const auto reservedBytes = options.guardedMem ?
+        GUARDED_MEM_RESERVED_BYTES :
+        (memType.maximum > 0 ? memType.maximum : WASM_MAX_PAGES) * WASM_PAGE_SIZE_IN_BYTE;
+      auto* ptr = VirtualMem::reserve(reservedBytes, memType.initial);
+      if (ptr && options.guardedMem && !VirtualMem::trapFaults(ptr, reservedBytes)) {
+        VirtualMem::release(ptr, reservedBytes);
+        ptr = nullptr;
+      }
+      if (ptr) {
+        executableIns->rtMems.emplace_back(memType.initial, ptr, memType.maximum, reservedBytes, options.guardedMem);
+      } else {
+        const auto size = memType.initial * WASM_PAGE_SIZE_IN_BYTE;
+        executableIns->rtMems.emplace_back(
+          memType.initial, static_cast<uint8_t*>(std::calloc(size, sizeof(uint8_t))), memType.maximum);
+      }
     } else {
       Exception::terminate(Exception::ErrorType::MEM_EXCEED_MAX);
     }
@@ -165,15 +223,13 @@ shared_module_runtime_t Instantiator::instantiate(shared_module_t mod, bool jitE
         const auto comma = argView.find_first_of(',');
         if (comma != std::string_view::npos) {
           executableIns->stack.push_back(
-            Runtime::RTValueFrame {
-              convertStrToRTVal(std::string(argView.substr(0, comma)), inputFuncArgTypes[i])
-            });
+            Runtime::RTValue::from(
+              convertStrToRTVal(std::string(argView.substr(0, comma)), inputFuncArgTypes[i])));
           argView.remove_prefix(comma + 1);
         } else {
           executableIns->stack.push_back(
-            Runtime::RTValueFrame {
-              convertStrToRTVal((*inputArgs)->toStr(), inputFuncArgTypes[i])
-            });
+            Runtime::RTValue::from(
+              convertStrToRTVal((*inputArgs)->toStr(), inputFuncArgTypes[i])));
         }
       }
     }
@@ -2,137 +2,28 @@
 #include <array>
 #include <iostream>
 #include <algorithm>
-#include <type_traits>
 #include <cstdlib>
-#include <cmath>
-#include <cfenv>
-#include <limits>
+#include <cstring>
+#include <utility>
 #include "lib/include/interpreter.hh"
+#include "lib/include/kernels.hh"
 #include "lib/include/structs.hh"
 #include "lib/include/executor.hh"
+#include "lib/include/instantiator.hh"
 #include "lib/include/exception.hh"
 #include "lib/include/opcodes.hh"
 #include "lib/include/util.hh"
 #include "lib/include/jit_compiler.hh"
+#include "lib/include/opcode_stats.hh"
 
-#define ITERATE_LOAD_MEMOP(V) \
-  V(I32LoadMem, rt_i32_t, Runtime::rt_i32_t) \
-  V(I64LoadMem, rt_i64_t, Runtime::rt_i64_t) \
-  V(F32LoadMem, rt_f32_t, Runtime::rt_f32_t) \
-  V(F64LoadMem, rt_f64_t, Runtime::rt_f64_t) \
-  V(I32LoadMem8S, rt_i32_t, int8_t) \
-  V(I32LoadMem8U, rt_i32_t, uint8_t) \
-  V(I32LoadMem16S, rt_i32_t, int16_t) \
-  V(I32LoadMem16U, rt_i32_t, uint16_t) \
-  V(I64LoadMem8S, rt_i64_t, int8_t) \
-  V(I64LoadMem8U, rt_i64_t, uint8_t) \
-  V(I64LoadMem16S, rt_i64_t, int16_t) \
-  V(I64LoadMem16U, rt_i64_t, uint16_t) \
-  V(I64LoadMem32S, rt_i64_t, int32_t) \
-  V(I64LoadMem32U, rt_i64_t, uint32_t)
-
-#define ITERATE_STORE_MEMOP(V) \
-  V(I32StoreMem, rt_i32_t, Runtime::rt_i32_t) \
-  V(I64StoreMem, rt_i64_t, Runtime::rt_i64_t) \
-  V(F32StoreMem, rt_f32_t, Runtime::rt_f32_t) \
-  V(F64StoreMem, rt_f64_t, Runtime::rt_f64_t) \
-  V(I32StoreMem8, rt_i32_t, uint8_t) \
-  V(I32StoreMem16, rt_i32_t, uint16_t) \
-  V(I64StoreMem8, rt_i64_t, uint8_t) \
-  V(I64StoreMem16, rt_i64_t, uint16_t) \
-  V(I64StoreMem32, rt_i64_t, uint32_t)
-
-#define ITERATE_TRUNCOP(V) \
-  V(I32TruncF32S, rt_f32_t, rt_i32_t, int32_t) \
-  V(I32TruncF32U, rt_f32_t, rt_i32_t, uint32_t) \
-  V(I32TruncF64S, rt_f64_t, rt_i32_t, int32_t) \
-  V(I32TruncF64U, rt_f64_t, rt_i32_t, uint32_t) \
-  V(I64TruncF32S, rt_f32_t, rt_i64_t, int64_t) \
-  V(I64TruncF32U, rt_f32_t, rt_i64_t, uint64_t) \
-  V(I64TruncF64S, rt_f64_t, rt_i64_t, int64_t) \
-  V(I64TruncF64U, rt_f64_t, rt_i64_t, uint64_t)
-
-#define ITERATE_CONVERTOP(V) \
-  V(I64ExtendI32S, rt_i32_t, rt_i64_t, SIGNED) \
-  V(I64ExtendI32U, rt_i32_t, rt_i64_t, UNSIGNED) \
-  V(F32SConvertI32, rt_i32_t, rt_f32_t, SIGNED) \
-  V(F32UConvertI32, rt_i32_t, rt_f32_t, UNSIGNED) \
-  V(F32SConvertI64, rt_i64_t, rt_f32_t, SIGNED) \
-  V(F32UConvertI64, rt_i64_t, rt_f32_t, UNSIGNED) \
-  V(F64SConvertI32, rt_i32_t, rt_f64_t, SIGNED) \
-  V(F64UConvertI32, rt_i32_t, rt_f64_t, UNSIGNED) \
-  V(F64SConvertI64, rt_i64_t, rt_f64_t, SIGNED) \
-  V(F64UConvertI64, rt_i64_t, rt_f64_t, UNSIGNED)
-
-#define ITERATE_REINTERPRETOP(V) \
-  V(I32ReinterpretF32, rt_f32_t, rt_i32_t) \
-  V(I64ReinterpretF64, rt_f64_t, rt_i64_t) \
-  V(F32ReinterpretI32, rt_i32_t, rt_f32_t) \
-  V(F64ReinterpretI64, rt_i64_t, rt_f64_t) \
-
-#define ITERATE_SIMPLE_BINOP(V) \
-  V(I32Mul, rt_i32_t, rt_i32_t, rt_i32_t, *) \
-  V(I32Add, rt_i32_t, rt_i32_t, rt_i32_t, +) \
-  V(I32Sub, rt_i32_t, rt_i32_t, rt_i32_t, -) \
-  V(I32And, rt_i32_t, rt_i32_t, rt_i32_t, &) \
-  V(I32Or, rt_i32_t, rt_i32_t, rt_i32_t, |) \
-  V(I32Xor, rt_i32_t, rt_i32_t, rt_i32_t, ^) \
-  V(I32Eq, rt_i32_t, rt_i32_t, rt_i32_t, ==) \
-  V(I32Ne, rt_i32_t, rt_i32_t, rt_i32_t, !=) \
-  V(I32LtU, rt_i32_t, rt_i32_t, imme_u32_t, <) \
-  V(I32LeU, rt_i32_t, rt_i32_t, imme_u32_t, <=) \
-  V(I32GtU, rt_i32_t, rt_i32_t, imme_u32_t, >) \
-  V(I32GeU, rt_i32_t, rt_i32_t, imme_u32_t, >=) \
-  V(I32LtS, rt_i32_t, rt_i32_t, rt_i32_t, <) \
-  V(I32LeS, rt_i32_t, rt_i32_t, rt_i32_t, <=) \
-  V(I32GtS, rt_i32_t, rt_i32_t, rt_i32_t, >) \
-  V(I32GeS, rt_i32_t, rt_i32_t, rt_i32_t, >=) \
-  V(I64Mul, rt_i64_t, rt_i64_t, rt_i64_t, *) \
-  V(I64Add, rt_i64_t, rt_i64_t, rt_i64_t, +) \
-  V(I64Sub, rt_i64_t, rt_i64_t, rt_i64_t, -) \
-  V(I64And, rt_i64_t, rt_i64_t, rt_i64_t, &) \
-  V(I64Or, rt_i64_t, rt_i64_t, rt_i64_t, |) \
-  V(I64Xor, rt_i64_t, rt_i64_t, rt_i64_t, ^) \
-  V(I64Eq, rt_i64_t, rt_i32_t, rt_i64_t, ==) \
-  V(I64Ne, rt_i64_t, rt_i32_t, rt_i64_t, !=) \
-  V(I64LtU, rt_i64_t, rt_i32_t, imme_u64_t, <) \
-  V(I64LeU, rt_i64_t, rt_i32_t, imme_u64_t, <=) \
-  V(I64GtU, rt_i64_t, rt_i32_t, imme_u64_t, >) \
-  V(I64GeU, rt_i64_t, rt_i32_t, imme_u64_t, >=) \
-  V(I64LtS, rt_i64_t, rt_i32_t, rt_i64_t, <) \
-  V(I64LeS, rt_i64_t, rt_i32_t, rt_i64_t, <=) \
-  V(I64GtS, rt_i64_t, rt_i32_t, rt_i64_t, >) \
-  V(I64GeS, rt_i64_t, rt_i32_t, rt_i64_t, >=) \
-  V(F32Mul, rt_f32_t, rt_f32_t, rt_f32_t, *) \
-  V(F32Add, rt_f32_t, rt_f32_t, rt_f32_t, +) \
-  V(F32Sub, rt_f32_t, rt_f32_t, rt_f32_t, -) \
-  V(F32Div, rt_f32_t, rt_f32_t, rt_f32_t, /) \
-  V(F32Eq, rt_f32_t, rt_i32_t, rt_f32_t, ==) \
-  V(F32Ne, rt_f32_t, rt_i32_t, rt_f32_t, !=) \
-  V(F32Lt, rt_f32_t, rt_i32_t, rt_f32_t, <) \
-  V(F32Le, rt_f32_t, rt_i32_t, rt_f32_t, <=) \
-  V(F32Gt, rt_f32_t, rt_i32_t, rt_f32_t, >) \
-  V(F32Ge, rt_f32_t, rt_i32_t, rt_f32_t, >=) \
-  V(F64Mul, rt_f64_t, rt_f64_t, rt_f64_t, *) \
-  V(F64Add, rt_f64_t, rt_f64_t, rt_f64_t, +) \
-  V(F64Sub, rt_f64_t, rt_f64_t, rt_f64_t, -) \
-  V(F64Div, rt_f64_t, rt_f64_t, rt_f64_t, /) \
-  V(F64Eq, rt_f64_t, rt_i32_t, rt_f64_t, ==) \
-  V(F64Ne, rt_f64_t, rt_i32_t, rt_f64_t, !=) \
-  V(F64Lt, rt_f64_t, rt_i32_t, rt_f64_t, <) \
-  V(F64Le, rt_f64_t, rt_i32_t, rt_f64_t, <=) \
-  V(F64Gt, rt_f64_t, rt_i32_t, rt_f64_t, >) \
-  V(F64Ge, rt_f64_t, rt_i32_t, rt_f64_t, >=)
-
-#define REF_OPCODE_HANDLER_PTR_VALID(NAME) \
-  Interpreter::do##NAME,
-#define REF_OPCODE_HANDLER_PTR_INVALID(NAME) \
-  nullptr,
+#define REF_OPCODE_HANDLER_PTR_VALID(NAME, OP) \
+  handlers[OP] = Interpreter::do##NAME;
+#define REF_OPCODE_HANDLER_PTR_INVALID(NAME, OP)
+#define REF_OPCODE_HANDLER_PTR_FUSED(NAME, OP) \
+  REF_OPCODE_HANDLER_PTR_VALID(NAME, OP)
 #define REF_OPCODE_HANDLER_PTR(NAME, OP, VALIDITY) \
-  REF_OPCODE_HANDLER_PTR_##VALIDITY(NAME)
+  REF_OPCODE_HANDLER_PTR_##VALIDITY(NAME, OP)
 #define CONCAT_PREFIX(X) Runtime:: X
-#define MAKE_UNSIGNED() std::make_unsigned_t
-#define MAKE_SIGNED() std::make_signed_t
 #define DECLARE_BASIC_BINOP_METHOD(NAME, VAL_TYPE, RET_TYPE, OP_CAST_TYPE, OP) \
   void Interpreter::do##NAME(Executor& executor, op_handler_info_t _) { \
     executor.opHandlerFTRO<CONCAT_PREFIX(VAL_TYPE), CONCAT_PREFIX(RET_TYPE)>([](auto x, auto y) { \
@@ -143,11 +34,10 @@
   void Interpreter::do##NAME(Executor& executor, op_handler_info_t _) { \
     const auto& defaultMem = executor.getEngineData()->rtMems.front(); \
     const auto [flags, offset] = executor.parseMemImmeInfo(); \
-    const auto ea = executor.retStackValOfRTType<Runtime::rt_i32_t>(false) + offset; \
-    const auto n = sizeof(CONCAT_PREFIX(T)); \
-    if (ea + n / 8 <= defaultMem.size) { \
-      executor.refFrameFromStack<Runtime::RTValueFrame>().value = \
-        static_cast<CONCAT_PREFIX(T)>(*reinterpret_cast<C*>(defaultMem.ptr + ea)); \
+    const auto ea = static_cast<uint64_t>(executor.retStackValOfRTType<uint32_t>(false)) + offset; \
+    if (ea + sizeof(C) <= defaultMem.size * WASM_PAGE_SIZE_IN_BYTE) { \
+      executor.refStackVal() = Runtime::RTValue::from( \
+        static_cast<CONCAT_PREFIX(T)>(*reinterpret_cast<C*>(defaultMem.ptr + ea))); \
     } else { \
       Exception::terminate(Exception::ErrorType::MEM_ACCESS_OOB); \
     } \
@@ -157,260 +47,296 @@
     const auto& defaultMem = executor.getEngineData()->rtMems.front(); \
     const auto [flags, offset] = executor.parseMemImmeInfo(); \
     const auto c = executor.retStackValOfRTType<CONCAT_PREFIX(T)>(); \
-    const auto ea = executor.retStackValOfRTType<Runtime::rt_i32_t>() + offset; \
-    const auto n = sizeof(CONCAT_PREFIX(T)); \
-    if (ea + n / 8 <= defaultMem.size) { \
+    const auto ea = static_cast<uint64_t>(executor.retStackValOfRTType<uint32_t>()) + offset; \
+    if (ea + sizeof(C) <= defaultMem.size * WASM_PAGE_SIZE_IN_BYTE) { \
       *reinterpret_cast<C*>(defaultMem.ptr + ea) = static_cast<C>(c); \
     } else { \
       Exception::terminate(Exception::ErrorType::MEM_ACCESS_OOB); \
     } \
   }
-#define DECLARE_TRUNC_OP_METHOD(NAME, PARAM_TYPE, RET_TYPE, CAST) \
-  void Interpreter::do##NAME(Executor& executor, op_handler_info_t _) { \
-    executor.opHandlerFORO<CONCAT_PREFIX(PARAM_TYPE), CONCAT_PREFIX(RET_TYPE)>([](auto v) { \
-      v = std::trunc(v); \
-      if (!std::isnan(v) && \
-          !std::isinf(v) && \
-          Util::floatInRange<CAST>(v)) { \
-          return static_cast<CAST>(v); \
-        } else { \
-          Exception::terminate(Exception::ErrorType::FLOAT_UNREPRESENTABLE); \
-        } \
-    }); \
-  }
-#define DECLARE_CONVERT_OP_METHOD(NAME, PARAM_TYPE, RET_TYPE, SIGNESS_METHOD) \
+#define DECLARE_BINOP_METHOD(NAME, VAL_TYPE, RET_TYPE, KERNEL) \
   void Interpreter::do##NAME(Executor& executor, op_handler_info_t _) { \
-    executor.opHandlerFORO<CONCAT_PREFIX(PARAM_TYPE), CONCAT_PREFIX(RET_TYPE)>([](auto v) { \
-      return static_cast<MAKE_##SIGNESS_METHOD()<decltype(v)>>(v); \
+    executor.opHandlerFTRO<CONCAT_PREFIX(VAL_TYPE), CONCAT_PREFIX(RET_TYPE)>([](auto x, auto y) { \
+      return Kernels::KERNEL(x, y); \
     }); \
   }
-#define DECLARE_REINTERPRET_OP_METHOD(NAME, PARAM_TYPE, RET_TYPE) \
+#define DECLARE_UNOP_METHOD(NAME, PARAM_TYPE, RET_TYPE, KERNEL) \
   void Interpreter::do##NAME(Executor& executor, op_handler_info_t _) { \
     executor.opHandlerFORO<CONCAT_PREFIX(PARAM_TYPE), CONCAT_PREFIX(RET_TYPE)>([](auto v) { \
-      return *reinterpret_cast<CONCAT_PREFIX(RET_TYPE)*>(static_cast<CONCAT_PREFIX(PARAM_TYPE)*>(&v)); \
+      return Kernels::KERNEL(v); \
     }); \
   }
 
 namespace TWVM {
 
-std::array<Interpreter::op_handler_proto_t, sizeof(uint8_t) * 1 << 8> Interpreter::opTokenHandlers = {
+std::array<Interpreter::op_handler_proto_t, sizeof(uint8_t) * 1 << 8> Interpreter::opTokenHandlers = []() {
+  std::array<op_handler_proto_t, sizeof(uint8_t) * 1 << 8> handlers = {};
   ITERATE_ALL_OPCODE(REF_OPCODE_HANDLER_PTR)
-};
+  ITERATE_FUSED_OPCODE(REF_OPCODE_HANDLER_PTR)
+  return handlers;
+}();
 
 ITERATE_SIMPLE_BINOP(DECLARE_BASIC_BINOP_METHOD)
 ITERATE_LOAD_MEMOP(DECLARE_MEM_LOAD_OP_METHOD)
 ITERATE_STORE_MEMOP(DECLARE_MEM_STORE_OP_METHOD)
-ITERATE_TRUNCOP(DECLARE_TRUNC_OP_METHOD)
-ITERATE_CONVERTOP(DECLARE_CONVERT_OP_METHOD)
-ITERATE_REINTERPRETOP(DECLARE_REINTERPRET_OP_METHOD)
+ITERATE_BINOP(DECLARE_BINOP_METHOD)
+ITERATE_UNOP(DECLARE_UNOP_METHOD)
+ITERATE_TRUNCOP(DECLARE_UNOP_METHOD)
+ITERATE_CONVERTOP(DECLARE_UNOP_METHOD)
+ITERATE_REINTERPRETOP(DECLARE_UNOP_METHOD)
 
 void Interpreter::doUnreachable(Executor& executor, op_handler_info_t _) {
   Exception::terminate(Exception::ErrorType::UNREACHABLE);
 }
 void Interpreter::doNop(Executor& executor, op_handler_info_t _) {}
 void Interpreter::doBlock(Executor& executor, op_handler_info_t _) {
-  const auto returnArityTypes = executor.collectArities();
-  const auto cont = executor.lookupLabelContFromPC();
-  if (cont.size() > 0) {
-    executor.pushToStack(Runtime::RTLabelFrame(cont.back(), returnArityTypes));
-  } else  {
-    Exception::terminate(Exception::ErrorType::ILLFORMED_STRUCTURE);
-  }
+  const auto arity = executor.collectArity();
+  executor.pushLabel(executor.decodeTargetFromPC(), arity);
 }
 void Interpreter::doLoop(Executor& executor, op_handler_info_t _) {
   auto* cont = executor.getPC() - 1;
-  const auto returnArityTypes = executor.collectArities();
-  executor.pushToStack(Runtime::RTLabelFrame(cont, returnArityTypes));
+  executor.collectArity();
+  const auto loopIdx = executor.decodeImmeFromPC<Runtime::index_t>();
+  auto& count = *executor.getPC();
+  executor.movPC();
+  if (executor.getEngineData()->options.jitEnabled && enterLoopNatively(executor, loopIdx, count)) {
+    return;  // The function has returned.
+  }
+  executor.pushLabel(cont, 0);  // Branching to a loop carries no values in MVP.
 }
 void Interpreter::doIf(Executor& executor, op_handler_info_t _) {
-  const auto returnArityTypes = executor.collectArities();
-  const auto conts = executor.lookupLabelContFromPC();
-  if (conts.size() > 1) {
-    const auto v = executor.retStackValOfRTType<Runtime::rt_i32_t>();
-    executor.pushToStack(Runtime::RTLabelFrame(conts.back(), returnArityTypes));
-    if (v == 0) {
-      executor.setPC(conts.front());
-    }
-  } else  {
-    Exception::terminate(Exception::ErrorType::ILLFORMED_STRUCTURE);
+  const auto arity = executor.collectArity();
+  auto* elseCont = executor.decodeTargetFromPC();
+  auto* endCont = executor.decodeTargetFromPC();
+  const auto v = executor.retStackValOfRTType<Runtime::rt_i32_t>();
+  executor.pushLabel(endCont, arity);
+  if (v == 0) {
+    executor.setPC(elseCont);
   }
 }
 void Interpreter::doElse(Executor& executor, op_handler_info_t _) {
   doBr(executor, 0);
 }
 void Interpreter::doEnd(Executor& executor, op_handler_info_t _) {
-  doBr(executor, 0);  // No forwarding PC.
+  if (executor.getLabelAboveActivFrameCount() > 0) {
+    executor.getEngineData()->labelStack.pop_back();  // Results are already in place, no forwarding PC.
+  } else {
+    doReturn(executor, 0);
+  }
 }
 void Interpreter::doBr(Executor& executor, op_handler_info_t passedDepth) {
-  const auto depth = passedDepth.has_value() ? *passedDepth : executor.decodeVaruintFromPC<Runtime::relative_depth_t>();
-  const auto labelsCount = executor.getLabelAboveActivFrameCount();
-  if (labelsCount > depth) {
+  const auto depth = passedDepth.has_value() ? *passedDepth : executor.decodeImmeFromPC<Runtime::relative_depth_t>();
+  // Break depths have been checked by the validator.
+  if (executor.getLabelAboveActivFrameCount() > depth) {
     // Consume Label frames.
-    auto* cont = executor.retFromFrameWithCont<Runtime::RTLabelFrame>(depth);
-    if (static_cast<OpCodes>(*(executor.getPC() - 1)) != OpCodes::End) {
-      executor.setPC(cont);
-    }
-  } else if (labelsCount == depth) {
+    executor.setPC(executor.retFromLabelWithCont(depth));
+  } else {
     // Consuem Activ frame.
     doReturn(executor, depth);
-  } else {
-    Exception::terminate(Exception::ErrorType::ILLEGAL_BREAK_LVL);
   }
 }
 void Interpreter::doBrIf(Executor& executor, op_handler_info_t _) {
   const auto v = executor.retStackValOfRTType<Runtime::rt_i32_t>();
-  const auto depth = executor.decodeVaruintFromPC<Runtime::relative_depth_t>();
+  const auto depth = executor.decodeImmeFromPC<Runtime::relative_depth_t>();
   if (v != 0) {
     doBr(executor, depth);
   }
 }
 void Interpreter::doBrTable(Executor& executor, op_handler_info_t _) {
-  const auto entries = executor.parseBrTableInfo();
-  const auto v = executor.retStackValOfRTType<Runtime::rt_i32_t>();
-  if (v < entries.size()) {
-    doBr(executor, entries.at(v));
-  } else {
-    doBr(executor, entries.back());
-  }
+  const auto targetCount = executor.decodeImmeFromPC<Runtime::imme_u32_t>();
+  const auto* entries = executor.getPC();
+  const auto v = static_cast<uint32_t>(executor.retStackValOfRTType<Runtime::rt_i32_t>());
+  executor.movPC(targetCount + 1);
+  doBr(executor, (entries + std::min(v, targetCount))->as<Runtime::relative_depth_t>());
 }
 void Interpreter::doReturn(Executor& executor, op_handler_info_t labelDepth) {
-  const auto activIdx = executor.getTopFrameIdx(Runtime::STVariantIndex::ACTIVATION);
-  if (activIdx.has_value() && *activIdx == 0) {
+  if (executor.getEngineData()->callStack.size() == executor.baseDepth + 1) {
     executor.stopEngine();
   } else {
-    const auto depth = labelDepth.value_or(executor.getLabelAboveActivFrameCount());
-    executor.setPC(
-      executor.retFromFrameWithCont<Runtime::RTActivFrame>(depth));
+    executor.setPC(executor.retFromActivWithCont());
   }
 }
+// Refreshes the context of the native code, returning its caller to be restored on leaving.
+static Executor* enterNative(Executor& executor) {
+  auto& engineData = *executor.getEngineData();
+  auto& context = engineData.jitContext;
+  if (!engineData.rtMems.empty()) {
+    const auto& mem = engineData.rtMems.front();
+    context.memBase = mem.ptr;
+    context.memBytes = mem.size * WASM_PAGE_SIZE_IN_BYTE;
+  }
+  context.globals = engineData.rtGlobals.data();
+  context.table = engineData.jitTable.data();
+  context.tableSize = engineData.jitTable.size();
+  context.runtime = &engineData;
+  return std::exchange(context.caller, &executor);  // Restored for the native caller if any.
+}
+uint64_t Interpreter::callNative(Executor& executor, void* nativeEntry, const Runtime::RTValue* args) {
+  auto& context = executor.getEngineData()->jitContext;
+  const auto outerCaller = enterNative(executor);
+  const auto result = reinterpret_cast<JITCompiler::entry_t>(nativeEntry)(&context, args);
+  context.caller = outerCaller;
+  return result;
+}
 // Helper function to execute JIT-compiled code
-static void executeJITFunction(Executor& executor, Runtime::RTFuncDescriptor& descriptor) {
-  auto paramCount = descriptor.funcType->first.size();
-  const auto& returnTypes = descriptor.funcType->second;
-
-  // Extract parameters from stack in reverse order
-  std::vector<int32_t> params;  // For PoC, assume i32 params
-  for (size_t i = 0; i < paramCount; ++i) {
-    params.push_back(executor.retStackValOfRTType<Runtime::rt_i32_t>());
+static void executeJITFunction(Executor& executor, const Runtime::RTFuncDescriptor& descriptor, void* nativeEntry) {
+  // The arguments are the top slots of the operand stack, read before any call back into the VM.
+  auto& stack = executor.getEngineData()->stack;
+  const auto paramCount = descriptor.funcType->first.size();
+  const auto resultCount = descriptor.funcType->second.size();
+  const auto base = stack.size() - paramCount;
+  const auto result = Interpreter::callNative(executor, nativeEntry, stack.data() + base);
+  stack.resize(base + resultCount);
+  if (resultCount > 0) {
+    stack[base] = Runtime::RTValue::from(result);
   }
-  std::reverse(params.begin(), params.end());
-
-  // Cast function pointer and call
-  // For PoC: assume i32(i32) signature for fibonacci
-  if (paramCount == 1 && returnTypes.size() == 1 &&
-      static_cast<ValueTypes>(returnTypes[0]) == ValueTypes::I32) {
-    using FuncPtr = int32_t(*)(int32_t);
-    FuncPtr jitFunc = reinterpret_cast<FuncPtr>(descriptor.jitCompiledPtr);
-    int32_t result = jitFunc(params[0]);
-
-    // Push result back to stack
-    executor.pushToStack(Runtime::RTValueFrame(static_cast<Runtime::rt_i32_t>(result)));
-  } else {
-    // Unsupported signature - fall back to interpretation
-    std::cout << "[JIT] Unsupported function signature, falling back to interpretation\n";
+}
+// On-stack replacement, the interpreted frame is left for the native code at the header of the
+// loop, which takes over its locals and operands.
+bool Interpreter::enterLoopNatively(Executor& executor, uint32_t loopIdx, Runtime::RTCodeSlot& count) {
+  const auto& rtIns = executor.getEngineData();
+  const auto funcIdx = rtIns->callStack.back().funcIdx;
+  auto& descriptor = rtIns->rtFuncDescriptor[funcIdx];
+  auto* osrEntry = descriptor.osrEntryPtr.load(std::memory_order_acquire);
+  if (osrEntry == nullptr) {
+    // Not compiled yet, or compiled without it as the JIT failed, and the loop stays interpreted.
+    count.bits++;
+    if (descriptor.jitScheduled || count.bits < std::max(rtIns->options.jitLoopThreshold, 1u)) {
+      return false;
+    }
+    descriptor.jitScheduled = true;
+    JITCompiler::getInstance().schedule(funcIdx, rtIns);
+    osrEntry = descriptor.osrEntryPtr.load(std::memory_order_acquire);  // Unless in the background.
+    if (osrEntry == nullptr) {
+      return false;
+    }
+  }
+  // The locals followed by the operands of the frame, read before any call back into the VM.
+  auto& stack = rtIns->stack;
+  const auto localsBase = rtIns->callStack.back().localsBase;
+  const auto outerCaller = enterNative(executor);
+  const auto result = reinterpret_cast<JITCompiler::osr_entry_t>(osrEntry)(
+    &rtIns->jitContext, stack.data() + localsBase, loopIdx);
+  rtIns->jitContext.caller = outerCaller;
+  stack.resize(localsBase);
+  if (!descriptor.funcType->second.empty()) {
+    stack.push_back(Runtime::RTValue::from(result));
   }
+  doReturn(executor, 0);
+  return true;
 }
 
-void Interpreter::doCall(Executor& executor, op_handler_info_t passedFuncIdx) {
-  const auto idx = passedFuncIdx.has_value() ? *passedFuncIdx : executor.decodeVaruintFromPC<Runtime::index_t>();
-  auto& descriptor = executor.getEngineData()->rtFuncDescriptor.at(idx);
+void* Interpreter::prepareCall(Executor& executor, uint32_t funcIdx) {
+  const auto& rtIns = executor.getEngineData();
+  auto& descriptor = rtIns->rtFuncDescriptor.at(funcIdx);
+  // Published by the compile threads of the JIT at any time, also loaded ahead of time with `--aot`.
+  auto* nativeEntry = descriptor.jitCompiledPtr.load(std::memory_order_acquire);
+  if (descriptor.codeEntry == nullptr && nativeEntry == nullptr) {
+    Instantiator::translateLazily(*rtIns, funcIdx);  // Fills `descriptor` in place.
+  }
 
   // JIT compilation (only if enabled via --jit flag)
-  if (executor.getEngineData()->jitEnabled) {
-    // Profiling: increment execution counter
-    descriptor.executionCount++;
-
-    // Check if should JIT compile (threshold = 100)
-    if (!descriptor.isJitCompiled && descriptor.executionCount >= 100) {
-      if (JITCompiler::getInstance().initialize()) {
-        JITCompiler::getInstance().compileFunction(idx, descriptor, executor.getEngineData());
-      }
+  if (rtIns->options.jitEnabled && nativeEntry == nullptr) {
+    // Profiling, also the priority in the compile queue, which is the only concurrent reader.
+    const auto count = descriptor.executionCount.load(std::memory_order_relaxed) + 1;
+    descriptor.executionCount.store(count, std::memory_order_relaxed);
+
+    // Schedule once on reaching the threshold, a function the JIT cannot translate is never retried.
+    const auto threshold = std::max(rtIns->options.jitThreshold, 1u);
+    if (!descriptor.jitScheduled && count >= threshold) {
+      descriptor.jitScheduled = true;
+      JITCompiler::getInstance().schedule(funcIdx, rtIns);
+      nativeEntry = descriptor.jitCompiledPtr.load(std::memory_order_acquire);  // Unless in the background.
     }
+  }
+  return nativeEntry;
+}
 
-    // Execute JIT-compiled version if available
-    if (descriptor.isJitCompiled && descriptor.jitCompiledPtr) {
-      executeJITFunction(executor, descriptor);
-      return;
+void Interpreter::doCall(Executor& executor, op_handler_info_t passedFuncIdx) {
+  const auto idx = passedFuncIdx.has_value() ? *passedFuncIdx : executor.decodeImmeFromPC<Runtime::index_t>();
+  auto* const nativeEntry = prepareCall(executor, idx);
+  auto& descriptor = executor.getEngineData()->rtFuncDescriptor[idx];
+
+  // Execute JIT-compiled version if available, the interpretation goes on until it is.
+  if (nativeEntry != nullptr) {
+    executeJITFunction(executor, descriptor, nativeEntry);
+    executor.reloadLocals();
+    if (executor.getEngineData()->callStack.size() == executor.baseDepth) {
+      executor.stopEngine();  // Called by a driver, no frame to return into.
     }
+    return;
   }
 
   // Fall back to interpretation
-  auto paramCount = descriptor.funcType->first.size();
-  auto rtLocals = descriptor.localsDefault;  // Copied.
-  // Set up func parameters.
-  if (paramCount > 0) {
-    for (auto i = 0; i < paramCount; ++i) {
-      const auto& vf = executor.refFrameFromStack<Runtime::RTValueFrame>();
-      if (vf.value.index() == rtLocals.at(i).index()) {
-        rtLocals.at(i) = vf.value;
-        executor.popFromStack();
-      } else {
-        Exception::terminate(Exception::ErrorType::MISSING_FUNC_PARAMS);
-      }
-    }
-  }
+  const auto paramCount = descriptor.funcType->first.size();
+  const auto localCount = descriptor.localsDefault.size();
+  // Arguments on the operand stack become the first locals in place, the first one is the deepest.
+  auto& stack = executor.getEngineData()->stack;
+  const auto localsBase = static_cast<uint32_t>(stack.size() - paramCount);
+  executor.reserveStack(localCount - paramCount + descriptor.maxStackDepth);
+  stack.resize(localsBase + localCount);  // The remaining locals are zeroed.
   // Construct frame (locals + artiy).
-  executor.pushToStack(
-    Runtime::RTActivFrame(
-      rtLocals,
-      executor.getPC(),
-      &descriptor.funcType->second));
+  executor.pushActiv(localsBase, idx, &descriptor.funcType->second);
   // Redirection.
   executor.setPC(descriptor.codeEntry);
 }
+uint64_t Interpreter::callFromNative(Executor& caller, uint32_t funcIdx, const Runtime::RTValue* args) {
+  const auto& rtIns = caller.getEngineData();
+  const auto& funcType = *rtIns->rtFuncDescriptor.at(funcIdx).funcType;
+  auto& stack = rtIns->stack;
+  const auto base = stack.size();
+  stack.insert(stack.end(), args, args + funcType.first.size());
+  // Driven as by `Executor::execute`, by an executor of its own stopping on the return of the callee.
+  Runtime::RTCodeSlot driver[] = {
+    Runtime::RTCodeSlot::from(static_cast<uint32_t>(OpCodes::Call)),
+    Runtime::RTCodeSlot::from(funcIdx),
+  };
+  Executor callee(driver, rtIns);
+  callee.baseDepth = rtIns->callStack.size();
+  executeDirectThreaded(callee);
+  if (rtIns->callStack.size() > callee.baseDepth) {
+    callee.retFromActivWithCont();  // Left in place on stopping, unless the callee ran natively.
+  }
+  const auto result = funcType.second.empty() ? 0 : stack.back().bits;
+  stack.resize(base);
+  return result;
+}
 void Interpreter::doCallIndirect(Executor& executor, op_handler_info_t _) {
   const auto& engineData = executor.getEngineData();
   const auto& defaultTable = engineData->rtTables.front();  // Restricted to only 1 table in MVP.
-  const auto sigIdx = executor.decodeVaruintFromPC<Runtime::index_t>();
-  [[maybe_unused]] const auto tblIdx = executor.decodeByteFromPC();  // reserved.
-  const auto& funcTypesRef = engineData->module->funcTypes;
-  if (funcTypesRef.size() > sigIdx) {
-    const auto& expectedType = funcTypesRef.at(sigIdx);
-    const auto funcIdx = executor.retStackValOfRTType<Runtime::rt_i32_t>();
-    if (defaultTable.size() > funcIdx) {
-      executor.validateTypeWithFuncIdx(expectedType, funcIdx);  // May throw.
-      doCall(executor, funcIdx);
-    } else {
-      Exception::terminate(Exception::ErrorType::NO_AVAILABLE_TABLES_EXIST);
+  const auto sigIdx = executor.decodeImmeFromPC<Runtime::index_t>();
+  [[maybe_unused]] const auto tblIdx = executor.decodeImmeFromPC<uint32_t>();  // reserved.
+  const auto& expectedType = engineData->module->funcTypes[sigIdx];
+  const auto elemIdx = static_cast<uint32_t>(executor.retStackValOfRTType<Runtime::rt_i32_t>());
+  if (defaultTable.size() > elemIdx) {
+    const auto funcIdx = defaultTable[elemIdx];
+    if (!funcIdx.has_value()) {
+      Exception::terminate(Exception::ErrorType::UNINITIALIZED_TBL_ELEM);
     }
+    executor.validateTypeWithFuncIdx(expectedType, *funcIdx);  // May throw.
+    doCall(executor, *funcIdx);
   } else {
-    Exception::terminate(Exception::ErrorType::FUNC_TYPE_ACCESS_OOB);
+    Exception::terminate(Exception::ErrorType::TBL_ACCESS_OOB);
   }
 }
 void Interpreter::doDrop(Executor& executor, op_handler_info_t _) {
-  executor.refFrameFromStack<Runtime::RTValueFrame>();
   executor.popFromStack();
 }
 void Interpreter::doSelect(Executor& executor, op_handler_info_t _) {
   const auto v = executor.retStackValOfRTType<Runtime::rt_i32_t>();
-  const auto& vy = executor.refFrameFromStack<Runtime::RTValueFrame>();  // Top.
-  const auto& vx = executor.refFrameFromStack<Runtime::RTValueFrame>(1);
-  if (vy.value.index() == vx.value.index()) {
-    executor.eraseFrameFromStack(v == 0 ? 1 : 0);
-  } else {
-    Exception::terminate(Exception::ErrorType::STACK_VAL_TYPE_MISMATCH);
+  const auto vy = executor.refStackVal();  // Top.
+  executor.popFromStack();
+  if (v == 0) {
+    executor.refStackVal() = vy;
   }
 }
 void Interpreter::doLocalGet(Executor& executor, op_handler_info_t _) {
-  const auto idx = executor.decodeVaruintFromPC<Runtime::index_t>();
-  const auto& frameOffset = executor.refTrackedTopFrameByType(Runtime::STVariantIndex::ACTIVATION);
-  const auto& locals = std::get<Runtime::RTActivFrame>(*frameOffset.ptr).locals;
-  if (locals.size() >= idx + 1) {
-    executor.pushToStack(locals.at(idx));
-  } else {
-    Exception::terminate(Exception::ErrorType::ILLEGAL_LOCAL_IDX);
-  }
+  const auto idx = executor.decodeImmeFromPC<Runtime::index_t>();
+  executor.pushToStack(executor.refLocals()[idx]);
 }
 void Interpreter::doLocalSet(Executor& executor, op_handler_info_t fromTee) {
-  const auto localIdx = executor.decodeVaruintFromPC<Runtime::index_t>();
-  const auto& activFrameOffset = executor.refTrackedTopFrameByType(Runtime::STVariantIndex::ACTIVATION);
-  const auto& valueFrame = executor.refFrameFromStack<Runtime::RTValueFrame>();
-  auto& locals = std::get<Runtime::RTActivFrame>(*activFrameOffset.ptr).locals;
-  if (locals.at(localIdx).index() == valueFrame.value.index()) {
-    locals.at(localIdx) = valueFrame.value;
-  } else {
-    Exception::terminate(Exception::ErrorType::STACK_VAL_TYPE_MISMATCH);
-  }
+  const auto localIdx = executor.decodeImmeFromPC<Runtime::index_t>();
+  executor.refLocals()[localIdx] = executor.refStackVal();
   if (!fromTee.has_value()) {
     executor.popFromStack();
   }
@@ -419,385 +345,79 @@ void Interpreter::doLocalTee(Executor& executor, op_handler_info_t _) {
   doLocalSet(executor, OPTIONAL_SYM_BOOL_TRUE);
 }
 void Interpreter::doGlobalGet(Executor& executor, op_handler_info_t _) {
-  const auto idx = executor.decodeVaruintFromPC<Runtime::index_t>();
-  auto& rtGlobals = executor.getEngineData()->rtGlobals;
-  if (rtGlobals.size() > idx) {
-    executor.pushToStack(Runtime::RTValueFrame(rtGlobals.at(idx)));
-  } else {
-    Exception::terminate(Exception::ErrorType::GLOBAL_ACCESS_OOB);
-  }
+  const auto idx = executor.decodeImmeFromPC<Runtime::index_t>();
+  executor.pushToStack(executor.getEngineData()->rtGlobals[idx]);
 }
 void Interpreter::doGlobalSet(Executor& executor, op_handler_info_t _) {
-  const auto idx = executor.decodeVaruintFromPC<Runtime::index_t>();
-  const auto& engineData = executor.getEngineData();
-  auto& rtGlobals = engineData->rtGlobals;
-  if (rtGlobals.size() > idx) {
-    const auto mutability = engineData->module->globals.at(idx).globalType.mutability;
-    const auto& v = executor.refFrameFromStack<Runtime::RTValueFrame>();
-    if (mutability && v.value.index() == rtGlobals.at(idx).index()) {
-      rtGlobals.at(idx) = v.value;
-      executor.popFromStack();
-    } else {
-      Exception::terminate(Exception::ErrorType::IMMUTABLE_GLOBAL_MUTATION);
-    }
-  } else {
-    Exception::terminate(Exception::ErrorType::GLOBAL_ACCESS_OOB);
-  }
+  const auto idx = executor.decodeImmeFromPC<Runtime::index_t>();
+  executor.getEngineData()->rtGlobals[idx] = executor.refStackVal();  // Mutability has been validated.
+  executor.popFromStack();
 }
 void Interpreter::doI32Const(Executor& executor, op_handler_info_t _) {
-  executor.pushToStack(
-    Runtime::RTValueFrame(executor.decodeVarintFromPC<Runtime::rt_i32_t, Runtime::runtime_value_t>()));
+  executor.pushToStack(executor.decodeImmeFromPC<Runtime::rt_i32_t>());
 }
 void Interpreter::doI64Const(Executor& executor, op_handler_info_t _) {
-  executor.pushToStack(
-    Runtime::RTValueFrame(executor.decodeVarintFromPC<Runtime::rt_i64_t, Runtime::runtime_value_t>()));
+  executor.pushToStack(executor.decodeImmeFromPC<Runtime::rt_i64_t>());
 }
 void Interpreter::doF32Const(Executor& executor, op_handler_info_t _) {
-  executor.pushToStack(Runtime::RTValueFrame(executor.decodeFloatingPointFromPC<Runtime::rt_f32_t>()));
+  executor.pushToStack(executor.decodeImmeFromPC<Runtime::rt_f32_t>());
 }
 void Interpreter::doF64Const(Executor& executor, op_handler_info_t _) {
-  executor.pushToStack(Runtime::RTValueFrame(executor.decodeFloatingPointFromPC<Runtime::rt_f64_t>()));
+  executor.pushToStack(executor.decodeImmeFromPC<Runtime::rt_f64_t>());
 }
 void Interpreter::doMemorySize(Executor& executor, op_handler_info_t _) {
-  const auto& rtMems = executor.getEngineData()->rtMems;
-  [[maybe_unused]] const auto reserved = executor.decodeByteFromPC();
-  if (rtMems.size() > 0) {
-    const auto& defaultMem = rtMems.front();
-    executor.pushToStack(
-      Runtime::RTValueFrame(
-        static_cast<Runtime::rt_i32_t>(defaultMem.size)));
-  } else {
-    Exception::terminate(Exception::ErrorType::NO_AVAILABLE_MEM);
-  }
+  const auto& defaultMem = executor.getEngineData()->rtMems.front();
+  executor.pushToStack(static_cast<Runtime::rt_i32_t>(defaultMem.size));
 }
 void Interpreter::doMemoryGrow(Executor& executor, op_handler_info_t _) {
-  const auto& rtMems = executor.getEngineData()->rtMems;
-  [[maybe_unused]] const auto reserved = executor.decodeByteFromPC();
-  if (rtMems.size() > 0) {
-    const auto& defaultMem = rtMems.front();
-    const auto sz = defaultMem.size / WASM_PAGE_SIZE_IN_BYTE;
-    const auto n = executor.retStackValOfRTType<Runtime::rt_i32_t>();
-    const auto size = n + sz;
-    executor.pushToStack(
-      Runtime::RTValueFrame(static_cast<Runtime::rt_i32_t>(executor.resizeMem(size))));
-  } else {
-    Exception::terminate(Exception::ErrorType::NO_AVAILABLE_MEM);
+  const auto n = executor.retStackValOfRTType<uint32_t>();  // Delta in pages.
+  executor.pushToStack(static_cast<Runtime::rt_i32_t>(executor.resizeMem(n)));
+}
+// Superinstructions read the immediates of the fused instructions in place, and skip over them.
+void Interpreter::doLocalGetI32ConstI32Add(Executor& executor, op_handler_info_t _) {
+  // [LocalGet, idx, I32Const, c, I32Add].
+  const auto* pc = executor.getPC();
+  const auto x = executor.refLocals()[pc[0].as<Runtime::index_t>()].as<uint32_t>();
+  executor.pushToStack(static_cast<Runtime::rt_i32_t>(x + pc[2].as<uint32_t>()));
+  executor.movPC(4);
+}
+void Interpreter::doLocalGetI32ConstI32Sub(Executor& executor, op_handler_info_t _) {
+  // [LocalGet, idx, I32Const, c, I32Sub].
+  const auto* pc = executor.getPC();
+  const auto x = executor.refLocals()[pc[0].as<Runtime::index_t>()].as<uint32_t>();
+  executor.pushToStack(static_cast<Runtime::rt_i32_t>(x - pc[2].as<uint32_t>()));
+  executor.movPC(4);
+}
+void Interpreter::doLocalGetI32ConstI32LtS(Executor& executor, op_handler_info_t _) {
+  // [LocalGet, idx, I32Const, c, I32LtS].
+  const auto* pc = executor.getPC();
+  const auto x = executor.refLocals()[pc[0].as<Runtime::index_t>()].as<Runtime::rt_i32_t>();
+  executor.pushToStack(static_cast<Runtime::rt_i32_t>(x < pc[2].as<Runtime::rt_i32_t>()));
+  executor.movPC(4);
+}
+void Interpreter::doLocalGetLocalGetI32LtSBrIf(Executor& executor, op_handler_info_t _) {
+  // [LocalGet, x, LocalGet, y, I32LtS, BrIf, depth].
+  const auto* pc = executor.getPC();
+  const auto* locals = executor.refLocals();
+  const auto taken =
+    locals[pc[0].as<Runtime::index_t>()].as<Runtime::rt_i32_t>() <
+    locals[pc[2].as<Runtime::index_t>()].as<Runtime::rt_i32_t>();
+  const auto depth = pc[5].as<Runtime::relative_depth_t>();
+  executor.movPC(6);
+  if (taken) {
+    doBr(executor, depth);
   }
 }
-void Interpreter::doI32Eqz(Executor& executor, op_handler_info_t _) {
-  executor.opHandlerFORO<Runtime::rt_i32_t, Runtime::rt_i32_t>([](auto v) {
-    return v == 0;
-  });
-}
-void Interpreter::doI64Eqz(Executor& executor, op_handler_info_t _) {
-  executor.opHandlerFORO<Runtime::rt_i64_t, Runtime::rt_i32_t>([](auto v) {
-    return v == 0;
-  });
-}
-void Interpreter::doI32Clz(Executor& executor, op_handler_info_t _) {
-  executor.opHandlerFORO<Runtime::rt_i32_t, Runtime::rt_i32_t>([](auto v) {
-    return Util::countLeadingZeros(v);
-  });
-}
-void Interpreter::doI32Ctz(Executor& executor, op_handler_info_t _) {
-  executor.opHandlerFORO<Runtime::rt_i32_t, Runtime::rt_i32_t>([](auto v) {
-    return Util::countTrailingZeros(v);
-  });
-}
-void Interpreter::doI32Popcnt(Executor& executor, op_handler_info_t _) {
-  executor.opHandlerFORO<Runtime::rt_i32_t, Runtime::rt_i32_t>([](auto v) {
-    return Util::countPopulation(v);
-  });
-}
-void Interpreter::doI32DivS(Executor& executor, op_handler_info_t _) {
-  executor.opHandlerFTRO<Runtime::rt_i32_t, Runtime::rt_i32_t>([](auto x, auto y) {
-    const auto sx = static_cast<std::make_signed_t<decltype(x)>>(x);
-    const auto sy = static_cast<std::make_signed_t<decltype(y)>>(y);
-    if (sy != 0) {
-      if (!(sy == -1 && sx == std::numeric_limits<int32_t>::min())) {
-        return sx / sy;
-      } else {
-        Exception::terminate(Exception::ErrorType::VAL_NOT_REPRESENTABLE);
-      }
-    } else {
-      Exception::terminate(Exception::ErrorType::DIVISION_BY_ZERO);
-    }
-  });
-}
-void Interpreter::doI32DivU(Executor& executor, op_handler_info_t _) {
-  executor.opHandlerFTRO<Runtime::rt_i32_t, Runtime::rt_i32_t>([](auto x, auto y) {
-    const auto ux = static_cast<std::make_unsigned_t<decltype(x)>>(x);
-    const auto uy = static_cast<std::make_unsigned_t<decltype(y)>>(y);
-    if (uy != 0) {
-      return ux / uy;
-    } else {
-      Exception::terminate(Exception::ErrorType::DIVISION_BY_ZERO);
-    }
-  });
-}
-void Interpreter::doI32RemS(Executor& executor, op_handler_info_t _) {
-  executor.opHandlerFTRO<Runtime::rt_i32_t, Runtime::rt_i32_t>([](auto x, auto y) {
-    const auto sx = static_cast<std::make_signed_t<decltype(x)>>(x);
-    const auto sy = static_cast<std::make_signed_t<decltype(y)>>(y);
-    if (sy != 0) {
-      return sx % sy;
-    } else {
-      Exception::terminate(Exception::ErrorType::DIVISION_BY_ZERO);
-    }
-  });
-}
-void Interpreter::doI32RemU(Executor& executor, op_handler_info_t _) {
-  executor.opHandlerFTRO<Runtime::rt_i32_t, Runtime::rt_i32_t>([](auto x, auto y) {
-    const auto ux = static_cast<std::make_unsigned_t<decltype(x)>>(x);
-    const auto uy = static_cast<std::make_unsigned_t<decltype(y)>>(y);
-    if (uy != 0) {
-      return ux % uy;
-    } else {
-      Exception::terminate(Exception::ErrorType::DIVISION_BY_ZERO);
-    }
-  });
-}
-void Interpreter::doI32Shl(Executor& executor, op_handler_info_t _) {
-  executor.opHandlerFTRO<Runtime::rt_i32_t, Runtime::rt_i32_t>([](auto x, auto y) {
-    return x << (y & 0x1f);
-  });
-}
-void Interpreter::doI32ShrS(Executor& executor, op_handler_info_t _) {
-  executor.opHandlerFTRO<Runtime::rt_i32_t, Runtime::rt_i32_t>([](auto x, auto y) {
-    const auto sx = static_cast<std::make_signed_t<decltype(x)>>(x);
-    const auto sy = static_cast<std::make_signed_t<decltype(y)>>(y);
-    return sx >> (sy & 0x1f);
-  });
-}
-void Interpreter::doI32ShrU(Executor& executor, op_handler_info_t _) {
-  executor.opHandlerFTRO<Runtime::rt_i32_t, Runtime::rt_i32_t>([](auto x, auto y) {
-    const auto ux = static_cast<std::make_unsigned_t<decltype(x)>>(x);
-    const auto uy = static_cast<std::make_unsigned_t<decltype(y)>>(y);
-    return ux >> (uy & 0x1f);
-  });
-}
-void Interpreter::doI32Rotl(Executor& executor, op_handler_info_t _) {
-  executor.opHandlerFTRO<Runtime::rt_i32_t, Runtime::rt_i32_t>([](auto x, auto y) {
-    const auto ux = static_cast<std::make_unsigned_t<decltype(x)>>(x);
-    return (ux << (y & 0x1f)) | (ux >> (32 - (y & 0x1f)));
-  });
-}
-void Interpreter::doI32Rotr(Executor& executor, op_handler_info_t _) {
-  executor.opHandlerFTRO<Runtime::rt_i32_t, Runtime::rt_i32_t>([](auto x, auto y) {
-    const auto ux = static_cast<std::make_unsigned_t<decltype(x)>>(x);
-    return (ux >> (y & 0x1f)) | (ux << ((32 - y) & 0x1f));
-  });
-}
-void Interpreter::doI64Clz(Executor& executor, op_handler_info_t _) {
-  executor.opHandlerFORO<Runtime::rt_i64_t, Runtime::rt_i64_t>([](auto v) {
-    return Util::countLeadingZeros(v);
-  });
-}
-void Interpreter::doI64Ctz(Executor& executor, op_handler_info_t _) {
-  executor.opHandlerFORO<Runtime::rt_i64_t, Runtime::rt_i64_t>([](auto v) {
-    return Util::countTrailingZeros(v);
-  });
-}
-void Interpreter::doI64Popcnt(Executor& executor, op_handler_info_t _) {
-  executor.opHandlerFORO<Runtime::rt_i64_t, Runtime::rt_i64_t>([](auto v) {
-    return Util::countPopulation(v);
-  });
-}
-void Interpreter::doI64DivS(Executor& executor, op_handler_info_t _) {
-  executor.opHandlerFTRO<Runtime::rt_i64_t, Runtime::rt_i64_t>([](auto x, auto y) {
-    const auto sx = static_cast<std::make_signed_t<decltype(x)>>(x);
-    const auto sy = static_cast<std::make_signed_t<decltype(y)>>(y);
-    if (sy != 0) {
-      if (!(sy == -1 && sx == std::numeric_limits<int64_t>::min())) {
-        return sx / sy;
-      } else {
-        Exception::terminate(Exception::ErrorType::VAL_NOT_REPRESENTABLE);
-      }
-    } else {
-      Exception::terminate(Exception::ErrorType::DIVISION_BY_ZERO);
-    }
-  });
-}
-void Interpreter::doI64DivU(Executor& executor, op_handler_info_t _) {
-  executor.opHandlerFTRO<Runtime::rt_i64_t, Runtime::rt_i64_t>([](auto x, auto y) {
-    const auto ux = static_cast<std::make_unsigned_t<decltype(x)>>(x);
-    const auto uy = static_cast<std::make_unsigned_t<decltype(y)>>(y);
-    if (uy != 0) {
-      return ux / uy;
-    } else {
-      Exception::terminate(Exception::ErrorType::DIVISION_BY_ZERO);
-    }
-  });
-}
-void Interpreter::doI64RemS(Executor& executor, op_handler_info_t _) {
-  executor.opHandlerFTRO<Runtime::rt_i64_t, Runtime::rt_i64_t>([](auto x, auto y) {
-    const auto sx = static_cast<std::make_signed_t<decltype(x)>>(x);
-    const auto sy = static_cast<std::make_signed_t<decltype(y)>>(y);
-    if (sy != 0) {
-      return sx % sy;
-    } else {
-      Exception::terminate(Exception::ErrorType::DIVISION_BY_ZERO);
-    }
-  });
-}
-void Interpreter::doI64RemU(Executor& executor, op_handler_info_t _) {
-  executor.opHandlerFTRO<Runtime::rt_i64_t, Runtime::rt_i64_t>([](auto x, auto y) {
-    const auto ux = static_cast<std::make_unsigned_t<decltype(x)>>(x);
-    const auto uy = static_cast<std::make_unsigned_t<decltype(y)>>(y);
-    if (uy != 0) {
-      return ux % uy;
-    } else {
-      Exception::terminate(Exception::ErrorType::DIVISION_BY_ZERO);
-    }
-  });
-}
-void Interpreter::doI64Shl(Executor& executor, op_handler_info_t _) {
-  executor.opHandlerFTRO<Runtime::rt_i64_t, Runtime::rt_i64_t>([](auto x, auto y) {
-    return x << (y & 0x3f);
-  });
-}
-void Interpreter::doI64ShrS(Executor& executor, op_handler_info_t _) {
-  executor.opHandlerFTRO<Runtime::rt_i64_t, Runtime::rt_i64_t>([](auto x, auto y) {
-    const auto sx = static_cast<std::make_signed_t<decltype(x)>>(x);
-    const auto sy = static_cast<std::make_signed_t<decltype(y)>>(y);
-    return sx >> (sy & 0x3f);
-  });
-}
-void Interpreter::doI64ShrU(Executor& executor, op_handler_info_t _) {
-  executor.opHandlerFTRO<Runtime::rt_i64_t, Runtime::rt_i64_t>([](auto x, auto y) {
-    const auto ux = static_cast<std::make_unsigned_t<decltype(x)>>(x);
-    const auto uy = static_cast<std::make_unsigned_t<decltype(y)>>(y);
-    return ux >> (uy & 0x3f);
-  });
-}
-void Interpreter::doI64Rotl(Executor& executor, op_handler_info_t _) {
-  executor.opHandlerFTRO<Runtime::rt_i64_t, Runtime::rt_i64_t>([](auto x, auto y) {
-    const auto ux = static_cast<std::make_unsigned_t<decltype(x)>>(x);
-    return (ux << (y & 0x3f)) | (ux >> (64 - (y & 0x3f)));
-  });
-}
-void Interpreter::doI64Rotr(Executor& executor, op_handler_info_t _) {
-  executor.opHandlerFTRO<Runtime::rt_i64_t, Runtime::rt_i64_t>([](auto x, auto y) {
-    const auto ux = static_cast<std::make_unsigned_t<decltype(x)>>(x);
-    return (ux >> (y & 0x3f)) | (ux << ((64 - y) & 0x3f));
-  });
-}
-void Interpreter::doF32Abs(Executor& executor, op_handler_info_t _) {
-  executor.opHandlerFORO<Runtime::rt_f32_t, Runtime::rt_f32_t>([](auto v) {
-    return std::abs(v);
-  });
-}
-void Interpreter::doF32Neg(Executor& executor, op_handler_info_t _) {
-  executor.opHandlerFORO<Runtime::rt_f32_t, Runtime::rt_f32_t>([](auto v) {
-    return -v;
-  });
-}
-void Interpreter::doF32Ceil(Executor& executor, op_handler_info_t _) {
-  executor.opHandlerFORO<Runtime::rt_f32_t, Runtime::rt_f32_t>([](auto v) {
-    return std::ceil(v);
-  });
-}
-void Interpreter::doF32Floor(Executor& executor, op_handler_info_t _) {
-  executor.opHandlerFORO<Runtime::rt_f32_t, Runtime::rt_f32_t>([](auto v) {
-    return std::floor(v);
-  });
-}
-void Interpreter::doF32Trunc(Executor& executor, op_handler_info_t _) {
-  executor.opHandlerFORO<Runtime::rt_f32_t, Runtime::rt_f32_t>([](auto v) {
-    return std::trunc(v);
-  });
-}
-void Interpreter::doF32NearestInt(Executor& executor, op_handler_info_t _) {
-  executor.opHandlerFORO<Runtime::rt_f32_t, Runtime::rt_f32_t>([](auto v) {
-    std::fesetround(FE_TONEAREST);
-    return std::nearbyint(v);
-  });
-}
-void Interpreter::doF32Sqrt(Executor& executor, op_handler_info_t _) {
-  executor.opHandlerFORO<Runtime::rt_f32_t, Runtime::rt_f32_t>([](auto v) {
-    return std::sqrt(v);
-  });
-}
-void Interpreter::doF32Min(Executor& executor, op_handler_info_t _) {
-  executor.opHandlerFTRO<Runtime::rt_f32_t, Runtime::rt_f32_t>([](auto x, auto y) {
-    return std::min(x, y);
-  });
-}
-void Interpreter::doF32Max(Executor& executor, op_handler_info_t _) {
-  executor.opHandlerFTRO<Runtime::rt_f32_t, Runtime::rt_f32_t>([](auto x, auto y) {
-    return std::max(x, y);
-  });
-}
-void Interpreter::doF32CopySign(Executor& executor, op_handler_info_t _) {
-  executor.opHandlerFTRO<Runtime::rt_f32_t, Runtime::rt_f32_t>([](auto x, auto y) {
-    return std::copysign(x, y);
-  });
-}
-void Interpreter::doF64Abs(Executor& executor, op_handler_info_t _) {
-  executor.opHandlerFORO<Runtime::rt_f64_t, Runtime::rt_f64_t>([](auto v) {
-    return std::abs(v);
-  });
-}
-void Interpreter::doF64Neg(Executor& executor, op_handler_info_t _) {
-  executor.opHandlerFORO<Runtime::rt_f64_t, Runtime::rt_f64_t>([](auto v) {
-    return -v;
-  });
-}
-void Interpreter::doF64Ceil(Executor& executor, op_handler_info_t _) {
-  executor.opHandlerFORO<Runtime::rt_f64_t, Runtime::rt_f64_t>([](auto v) {
-    return std::ceil(v);
-  });
-}
-void Interpreter::doF64Floor(Executor& executor, op_handler_info_t _) {
-  executor.opHandlerFORO<Runtime::rt_f64_t, Runtime::rt_f64_t>([](auto v) {
-    return std::floor(v);
-  });
-}
-void Interpreter::doF64Trunc(Executor& executor, op_handler_info_t _) {
-  executor.opHandlerFORO<Runtime::rt_f64_t, Runtime::rt_f64_t>([](auto v) {
-    return std::trunc(v);
-  });
-}
-void Interpreter::doF64NearestInt(Executor& executor, op_handler_info_t _) {
-  executor.opHandlerFORO<Runtime::rt_f64_t, Runtime::rt_f64_t>([](auto v) {
-    std::fesetround(FE_TONEAREST);
-    return std::nearbyint(v);
-  });
-}
-void Interpreter::doF64Sqrt(Executor& executor, op_handler_info_t _) {
-  executor.opHandlerFORO<Runtime::rt_f64_t, Runtime::rt_f64_t>([](auto v) {
-    return std::sqrt(v);
-  });
-}
-void Interpreter::doF64Min(Executor& executor, op_handler_info_t _) {
-  executor.opHandlerFTRO<Runtime::rt_f64_t, Runtime::rt_f64_t>([](auto x, auto y) {
-    return std::min(x, y);
-  });
-}
-void Interpreter::doF64Max(Executor& executor, op_handler_info_t _) {
-  executor.opHandlerFTRO<Runtime::rt_f64_t, Runtime::rt_f64_t>([](auto x, auto y) {
-    return std::max(x, y);
-  });
-}
-void Interpreter::doF64CopySign(Executor& executor, op_handler_info_t _) {
-  executor.opHandlerFTRO<Runtime::rt_f64_t, Runtime::rt_f64_t>([](auto x, auto y) {
-    return std::copysign(x, y);
-  });
-}
-void Interpreter::doI32WrapI64(Executor& executor, op_handler_info_t _) {
-  executor.opHandlerFORO<Runtime::rt_i64_t, Runtime::rt_i32_t>([](auto v) {
-    return v & 0xffffffff;
-  });
-}
-void Interpreter::doF32DemoteF64(Executor& executor, op_handler_info_t _) {
-  executor.opHandlerFORO<Runtime::rt_f64_t, Runtime::rt_f32_t>([](auto v) {
-    return v;
-  });
-}
-void Interpreter::doF64PromoteF32(Executor& executor, op_handler_info_t _) {
-  executor.opHandlerFORO<Runtime::rt_f32_t, Runtime::rt_f64_t>([](auto v) {
-    return v;
-  });
+void Interpreter::doI32ConstI32LoadMem(Executor& executor, op_handler_info_t _) {
+  // [I32Const, addr, I32LoadMem, offset].
+  const auto* pc = executor.getPC();
+  const auto& defaultMem = executor.getEngineData()->rtMems.front();
+  const auto ea = static_cast<uint64_t>(pc[0].as<uint32_t>()) + pc[2].as<Runtime::imme_u32_t>();
+  if (ea + sizeof(Runtime::rt_i32_t) > static_cast<uint64_t>(defaultMem.size) * WASM_PAGE_SIZE_IN_BYTE) {
+    Exception::terminate(Exception::ErrorType::MEM_ACCESS_OOB);
+  }
+  executor.pushToStack(*reinterpret_cast<Runtime::rt_i32_t*>(defaultMem.ptr + ea));
+  executor.movPC(3);
 }
 
 // Direct-threaded interpreter using computed goto (GCC/Clang extension)
@@ -810,11 +430,107 @@ void Interpreter::executeDirectThreaded(Executor& executor) {
   // Create the dispatch table at function scope
   void* dispatch_table[256];
 
+  // Hot state is kept in locals across dispatches, the top of the operand stack included.
+  // Its slot in `stack` is stale while cached, so that unary and binary operators never touch it.
+  auto& rt = *executor.rtIns;
+  auto& stack = rt.stack;
+  auto* const globals = rt.rtGlobals.data();
+  auto* const mem = rt.rtMems.empty() ? nullptr : &rt.rtMems.front();  // Restricted to only 1 memory in MVP.
+  // The bottom slot pushed by the `Instantiator` keeps the stack non-empty, so the top can always
+  // be spilled or reloaded.
+  auto* pc = executor.pc;
+  auto tos = stack.back();
+  auto* locals = executor.locals;
+
   // Dispatch macro: fetch next opcode and jump to its handler
   #define DISPATCH() do { \
-    uint8_t opcode = *executor.pc++; \
+    uint8_t opcode = (pc++)->as<uint32_t>(); \
     goto *dispatch_table[opcode]; \
   } while(0)
+  // Hand the cached state back to the `Executor` before running an out-of-line handler.
+  #define SPILL() do { \
+    executor.pc = pc; \
+    stack.back() = tos; \
+  } while (0)
+  // The out-of-line handler may have switched the frame.
+  #define RELOAD() do { \
+    pc = executor.pc; \
+    tos = stack.back(); \
+    locals = executor.locals; \
+  } while (0)
+  #define EXIT_IF_STOPPED() do { \
+    if (executor.getCurrentStatus() != Executor::EngineStatus::EXECUTING) { \
+      return; \
+    } \
+  } while (0)
+  #define PUSH(V) do { \
+    stack.back() = tos; \
+    stack.emplace_back(); \
+    tos = (V); \
+  } while (0)
+  #define POP() do { \
+    stack.pop_back(); \
+    tos = stack.back(); \
+  } while (0)
+  #define OUT_OF_LINE_HANDLER(NAME, ...) \
+    op_##NAME: \
+      SPILL(); \
+      do##NAME(executor, std::nullopt); \
+      RELOAD(); \
+      DISPATCH();
+  #define INLINE_SIMPLE_BINOP_HANDLER(NAME, VAL_TYPE, RET_TYPE, OP_CAST_TYPE, OP) \
+    op_##NAME: { \
+      const auto y = tos.as<CONCAT_PREFIX(VAL_TYPE)>(); \
+      stack.pop_back(); \
+      tos = Runtime::RTValue::from(static_cast<CONCAT_PREFIX(RET_TYPE)>( \
+        static_cast<CONCAT_PREFIX(OP_CAST_TYPE)>(stack.back().as<CONCAT_PREFIX(VAL_TYPE)>()) OP \
+        static_cast<CONCAT_PREFIX(OP_CAST_TYPE)>(y))); \
+      DISPATCH(); \
+    }
+  #define INLINE_BINOP_HANDLER(NAME, VAL_TYPE, RET_TYPE, KERNEL) \
+    op_##NAME: { \
+      const auto y = tos.as<CONCAT_PREFIX(VAL_TYPE)>(); \
+      stack.pop_back(); \
+      tos = Runtime::RTValue::from(static_cast<CONCAT_PREFIX(RET_TYPE)>( \
+        Kernels::KERNEL(stack.back().as<CONCAT_PREFIX(VAL_TYPE)>(), y))); \
+      DISPATCH(); \
+    }
+  #define INLINE_UNOP_HANDLER(NAME, PARAM_TYPE, RET_TYPE, KERNEL) \
+    op_##NAME: \
+      tos = Runtime::RTValue::from(static_cast<CONCAT_PREFIX(RET_TYPE)>( \
+        Kernels::KERNEL(tos.as<CONCAT_PREFIX(PARAM_TYPE)>()))); \
+      DISPATCH();
+  // Every memory access has a checked handler, and an unchecked one for guard-page memory.
+  #define CHECK_MEM_BOUNDS(EA, N) \
+    if ((EA) + (N) > mem->size * WASM_PAGE_SIZE_IN_BYTE) { \
+      Exception::terminate(Exception::ErrorType::MEM_ACCESS_OOB); \
+    }
+  #define SKIP_MEM_BOUNDS(EA, N)
+  #define INLINE_LOAD_HANDLER_WITH(LABEL, VAL_TYPE, MEM_TYPE, CHECK) \
+    LABEL: { \
+      const auto ea = static_cast<uint64_t>(tos.as<uint32_t>()) + (pc++)->as<Runtime::imme_u32_t>(); \
+      CHECK(ea, sizeof(MEM_TYPE)) \
+      MEM_TYPE v; \
+      std::memcpy(&v, mem->ptr + ea, sizeof(MEM_TYPE)); \
+      tos = Runtime::RTValue::from(static_cast<CONCAT_PREFIX(VAL_TYPE)>(v)); \
+      DISPATCH(); \
+    }
+  #define INLINE_LOAD_HANDLER(NAME, VAL_TYPE, MEM_TYPE) \
+    INLINE_LOAD_HANDLER_WITH(op_##NAME, VAL_TYPE, MEM_TYPE, CHECK_MEM_BOUNDS) \
+    INLINE_LOAD_HANDLER_WITH(op_##NAME##Guarded, VAL_TYPE, MEM_TYPE, SKIP_MEM_BOUNDS)
+  #define INLINE_STORE_HANDLER_WITH(LABEL, VAL_TYPE, MEM_TYPE, CHECK) \
+    LABEL: { \
+      const auto v = static_cast<MEM_TYPE>(tos.as<CONCAT_PREFIX(VAL_TYPE)>()); \
+      stack.pop_back(); \
+      const auto ea = static_cast<uint64_t>(stack.back().as<uint32_t>()) + (pc++)->as<Runtime::imme_u32_t>(); \
+      CHECK(ea, sizeof(MEM_TYPE)) \
+      std::memcpy(mem->ptr + ea, &v, sizeof(MEM_TYPE)); \
+      POP(); \
+      DISPATCH(); \
+    }
+  #define INLINE_STORE_HANDLER(NAME, VAL_TYPE, MEM_TYPE) \
+    INLINE_STORE_HANDLER_WITH(op_##NAME, VAL_TYPE, MEM_TYPE, CHECK_MEM_BOUNDS) \
+    INLINE_STORE_HANDLER_WITH(op_##NAME##Guarded, VAL_TYPE, MEM_TYPE, SKIP_MEM_BOUNDS)
 
   // Jump to initialization code after all labels are defined
   goto init_dispatch_table;
@@ -830,713 +546,195 @@ init_dispatch_table:
   #define SET_DISPATCH_ENTRY_VALID(NAME) \
     dispatch_table[Util::asInteger(OpCodes::NAME)] = &&op_##NAME;
   #define SET_DISPATCH_ENTRY_INVALID(NAME)
+  #define SET_DISPATCH_ENTRY_FUSED(NAME) \
+    SET_DISPATCH_ENTRY_VALID(NAME)
   #define SET_DISPATCH_ENTRY(NAME, OP, VALIDITY) \
     SET_DISPATCH_ENTRY_##VALIDITY(NAME)
 
   ITERATE_ALL_OPCODE(SET_DISPATCH_ENTRY)
+  ITERATE_FUSED_OPCODE(SET_DISPATCH_ENTRY)
 
   #undef SET_DISPATCH_ENTRY
+  #undef SET_DISPATCH_ENTRY_FUSED
   #undef SET_DISPATCH_ENTRY_INVALID
   #undef SET_DISPATCH_ENTRY_VALID
 
+  // Out-of-bounds accesses fault on the guard pages instead.
+  #define SET_GUARDED_DISPATCH_ENTRY(NAME, ...) \
+    dispatch_table[Util::asInteger(OpCodes::NAME)] = &&op_##NAME##Guarded;
+  if (mem && mem->guarded) {
+    ITERATE_LOAD_MEMOP(SET_GUARDED_DISPATCH_ENTRY)
+    ITERATE_STORE_MEMOP(SET_GUARDED_DISPATCH_ENTRY)
+  }
+  #undef SET_GUARDED_DISPATCH_ENTRY
+
   // Start execution - fetch first opcode
-  goto *dispatch_table[*executor.pc++];
+  DISPATCH();
 
   // ===== Opcode Handlers =====
   // Each handler executes the instruction and dispatches to the next one
 
   op_Unreachable:
-    doUnreachable(executor, std::nullopt);
-    DISPATCH();
+    Exception::terminate(Exception::ErrorType::UNREACHABLE);
 
   op_Nop:
-    // Inline nop for maximum performance
-    DISPATCH();
-
-  op_Block:
-    doBlock(executor, std::nullopt);
     DISPATCH();
 
+  // Structured control and calls manipulate the label and call stacks, they stay out of line.
+  OUT_OF_LINE_HANDLER(Block)
   op_Loop:
+    SPILL();
     doLoop(executor, std::nullopt);
+    EXIT_IF_STOPPED();  // The entry function returned from its loop natively.
+    RELOAD();
     DISPATCH();
 
-  op_If:
-    doIf(executor, std::nullopt);
+  OUT_OF_LINE_HANDLER(If)
+  OUT_OF_LINE_HANDLER(Else)
+  op_Call:
+    SPILL();
+    doCall(executor, std::nullopt);
+    EXIT_IF_STOPPED();  // The entry function ran natively.
+    RELOAD();
     DISPATCH();
 
-  op_Else:
-    doElse(executor, std::nullopt);
-    DISPATCH();
+  OUT_OF_LINE_HANDLER(CallIndirect)
 
   op_End:
+    SPILL();
     doEnd(executor, std::nullopt);
-    if (executor.getCurrentStatus() != Executor::EngineStatus::EXECUTING) {
-      return;  // Engine stopped
-    }
+    EXIT_IF_STOPPED();  // Engine stopped
+    RELOAD();
     DISPATCH();
 
   op_Br:
+    SPILL();
     doBr(executor, std::nullopt);
+    EXIT_IF_STOPPED();  // Branched out of the entry function.
+    RELOAD();
+    DISPATCH();
+
+  op_BrIf: {
+    const auto v = tos.as<Runtime::rt_i32_t>();
+    const auto depth = (pc++)->as<Runtime::relative_depth_t>();
+    POP();
+    if (v != 0) {
+      SPILL();
+      doBr(executor, depth);
+      EXIT_IF_STOPPED();  // Branched out of the entry function.
+      RELOAD();
+    }
     DISPATCH();
-
-  op_BrIf:
-    doBrIf(executor, std::nullopt);
-    DISPATCH();
+  }
 
   op_BrTable:
+    SPILL();
     doBrTable(executor, std::nullopt);
+    EXIT_IF_STOPPED();  // Branched out of the entry function.
+    RELOAD();
     DISPATCH();
 
   op_Return:
+    SPILL();
     doReturn(executor, std::nullopt);
-    if (executor.getCurrentStatus() != Executor::EngineStatus::EXECUTING) {
-      return;  // Engine stopped
-    }
-    DISPATCH();
-
-  op_Call:
-    doCall(executor, std::nullopt);
-    DISPATCH();
-
-  op_CallIndirect:
-    doCallIndirect(executor, std::nullopt);
+    EXIT_IF_STOPPED();  // Engine stopped
+    RELOAD();
     DISPATCH();
 
   op_Drop:
-    doDrop(executor, std::nullopt);
+    POP();
     DISPATCH();
 
-  op_Select:
-    doSelect(executor, std::nullopt);
+  op_Select: {
+    const auto v = tos.as<Runtime::rt_i32_t>();
+    stack.pop_back();
+    const auto vy = stack.back();
+    stack.pop_back();
+    tos = v != 0 ? stack.back() : vy;
     DISPATCH();
+  }
 
   op_LocalGet:
-    doLocalGet(executor, std::nullopt);
+    PUSH(locals[(pc++)->as<Runtime::index_t>()]);
     DISPATCH();
 
   op_LocalSet:
-    doLocalSet(executor, std::nullopt);
+    locals[(pc++)->as<Runtime::index_t>()] = tos;
+    POP();
     DISPATCH();
 
   op_LocalTee:
-    doLocalTee(executor, std::nullopt);
+    locals[(pc++)->as<Runtime::index_t>()] = tos;
     DISPATCH();
 
   op_GlobalGet:
-    doGlobalGet(executor, std::nullopt);
+    PUSH(globals[(pc++)->as<Runtime::index_t>()]);
     DISPATCH();
 
   op_GlobalSet:
-    doGlobalSet(executor, std::nullopt);
-    DISPATCH();
-
-  op_I32LoadMem:
-    doI32LoadMem(executor, std::nullopt);
-    DISPATCH();
-
-  op_I64LoadMem:
-    doI64LoadMem(executor, std::nullopt);
-    DISPATCH();
-
-  op_F32LoadMem:
-    doF32LoadMem(executor, std::nullopt);
-    DISPATCH();
-
-  op_F64LoadMem:
-    doF64LoadMem(executor, std::nullopt);
-    DISPATCH();
-
-  op_I32LoadMem8S:
-    doI32LoadMem8S(executor, std::nullopt);
-    DISPATCH();
-
-  op_I32LoadMem8U:
-    doI32LoadMem8U(executor, std::nullopt);
-    DISPATCH();
-
-  op_I32LoadMem16S:
-    doI32LoadMem16S(executor, std::nullopt);
-    DISPATCH();
-
-  op_I32LoadMem16U:
-    doI32LoadMem16U(executor, std::nullopt);
-    DISPATCH();
-
-  op_I64LoadMem8S:
-    doI64LoadMem8S(executor, std::nullopt);
-    DISPATCH();
-
-  op_I64LoadMem8U:
-    doI64LoadMem8U(executor, std::nullopt);
-    DISPATCH();
-
-  op_I64LoadMem16S:
-    doI64LoadMem16S(executor, std::nullopt);
-    DISPATCH();
-
-  op_I64LoadMem16U:
-    doI64LoadMem16U(executor, std::nullopt);
-    DISPATCH();
-
-  op_I64LoadMem32S:
-    doI64LoadMem32S(executor, std::nullopt);
-    DISPATCH();
-
-  op_I64LoadMem32U:
-    doI64LoadMem32U(executor, std::nullopt);
-    DISPATCH();
-
-  op_I32StoreMem:
-    doI32StoreMem(executor, std::nullopt);
-    DISPATCH();
-
-  op_I64StoreMem:
-    doI64StoreMem(executor, std::nullopt);
-    DISPATCH();
-
-  op_F32StoreMem:
-    doF32StoreMem(executor, std::nullopt);
-    DISPATCH();
-
-  op_F64StoreMem:
-    doF64StoreMem(executor, std::nullopt);
-    DISPATCH();
-
-  op_I32StoreMem8:
-    doI32StoreMem8(executor, std::nullopt);
-    DISPATCH();
-
-  op_I32StoreMem16:
-    doI32StoreMem16(executor, std::nullopt);
-    DISPATCH();
-
-  op_I64StoreMem8:
-    doI64StoreMem8(executor, std::nullopt);
-    DISPATCH();
-
-  op_I64StoreMem16:
-    doI64StoreMem16(executor, std::nullopt);
-    DISPATCH();
-
-  op_I64StoreMem32:
-    doI64StoreMem32(executor, std::nullopt);
-    DISPATCH();
-
-  op_MemorySize:
-    doMemorySize(executor, std::nullopt);
-    DISPATCH();
-
-  op_MemoryGrow:
-    doMemoryGrow(executor, std::nullopt);
+    globals[(pc++)->as<Runtime::index_t>()] = tos;  // Mutability has been validated.
+    POP();
     DISPATCH();
 
   op_I32Const:
-    doI32Const(executor, std::nullopt);
-    DISPATCH();
-
   op_I64Const:
-    doI64Const(executor, std::nullopt);
-    DISPATCH();
-
   op_F32Const:
-    doF32Const(executor, std::nullopt);
-    DISPATCH();
-
   op_F64Const:
-    doF64Const(executor, std::nullopt);
-    DISPATCH();
-
-  op_I32Eqz:
-    doI32Eqz(executor, std::nullopt);
-    DISPATCH();
-
-  op_I32Eq:
-    doI32Eq(executor, std::nullopt);
-    DISPATCH();
-
-  op_I32Ne:
-    doI32Ne(executor, std::nullopt);
-    DISPATCH();
-
-  op_I32LtS:
-    doI32LtS(executor, std::nullopt);
-    DISPATCH();
-
-  op_I32LtU:
-    doI32LtU(executor, std::nullopt);
-    DISPATCH();
-
-  op_I32GtS:
-    doI32GtS(executor, std::nullopt);
-    DISPATCH();
-
-  op_I32GtU:
-    doI32GtU(executor, std::nullopt);
-    DISPATCH();
-
-  op_I32LeS:
-    doI32LeS(executor, std::nullopt);
-    DISPATCH();
-
-  op_I32LeU:
-    doI32LeU(executor, std::nullopt);
-    DISPATCH();
-
-  op_I32GeS:
-    doI32GeS(executor, std::nullopt);
-    DISPATCH();
-
-  op_I32GeU:
-    doI32GeU(executor, std::nullopt);
-    DISPATCH();
-
-  op_I64Eqz:
-    doI64Eqz(executor, std::nullopt);
-    DISPATCH();
-
-  op_I64Eq:
-    doI64Eq(executor, std::nullopt);
-    DISPATCH();
-
-  op_I64Ne:
-    doI64Ne(executor, std::nullopt);
-    DISPATCH();
-
-  op_I64LtS:
-    doI64LtS(executor, std::nullopt);
-    DISPATCH();
-
-  op_I64LtU:
-    doI64LtU(executor, std::nullopt);
-    DISPATCH();
-
-  op_I64GtS:
-    doI64GtS(executor, std::nullopt);
-    DISPATCH();
-
-  op_I64GtU:
-    doI64GtU(executor, std::nullopt);
-    DISPATCH();
-
-  op_I64LeS:
-    doI64LeS(executor, std::nullopt);
-    DISPATCH();
-
-  op_I64LeU:
-    doI64LeU(executor, std::nullopt);
-    DISPATCH();
-
-  op_I64GeS:
-    doI64GeS(executor, std::nullopt);
-    DISPATCH();
-
-  op_I64GeU:
-    doI64GeU(executor, std::nullopt);
-    DISPATCH();
-
-  op_F32Eq:
-    doF32Eq(executor, std::nullopt);
-    DISPATCH();
-
-  op_F32Ne:
-    doF32Ne(executor, std::nullopt);
-    DISPATCH();
-
-  op_F32Lt:
-    doF32Lt(executor, std::nullopt);
-    DISPATCH();
-
-  op_F32Gt:
-    doF32Gt(executor, std::nullopt);
-    DISPATCH();
-
-  op_F32Le:
-    doF32Le(executor, std::nullopt);
-    DISPATCH();
-
-  op_F32Ge:
-    doF32Ge(executor, std::nullopt);
-    DISPATCH();
-
-  op_F64Eq:
-    doF64Eq(executor, std::nullopt);
-    DISPATCH();
-
-  op_F64Ne:
-    doF64Ne(executor, std::nullopt);
-    DISPATCH();
-
-  op_F64Lt:
-    doF64Lt(executor, std::nullopt);
-    DISPATCH();
-
-  op_F64Gt:
-    doF64Gt(executor, std::nullopt);
-    DISPATCH();
-
-  op_F64Le:
-    doF64Le(executor, std::nullopt);
-    DISPATCH();
-
-  op_F64Ge:
-    doF64Ge(executor, std::nullopt);
-    DISPATCH();
-
-  op_I32Clz:
-    doI32Clz(executor, std::nullopt);
-    DISPATCH();
-
-  op_I32Ctz:
-    doI32Ctz(executor, std::nullopt);
-    DISPATCH();
-
-  op_I32Popcnt:
-    doI32Popcnt(executor, std::nullopt);
-    DISPATCH();
-
-  op_I32Add:
-    doI32Add(executor, std::nullopt);
-    DISPATCH();
-
-  op_I32Sub:
-    doI32Sub(executor, std::nullopt);
-    DISPATCH();
-
-  op_I32Mul:
-    doI32Mul(executor, std::nullopt);
-    DISPATCH();
-
-  op_I32DivS:
-    doI32DivS(executor, std::nullopt);
-    DISPATCH();
-
-  op_I32DivU:
-    doI32DivU(executor, std::nullopt);
-    DISPATCH();
-
-  op_I32RemS:
-    doI32RemS(executor, std::nullopt);
-    DISPATCH();
-
-  op_I32RemU:
-    doI32RemU(executor, std::nullopt);
-    DISPATCH();
-
-  op_I32And:
-    doI32And(executor, std::nullopt);
-    DISPATCH();
-
-  op_I32Or:
-    doI32Or(executor, std::nullopt);
-    DISPATCH();
-
-  op_I32Xor:
-    doI32Xor(executor, std::nullopt);
-    DISPATCH();
-
-  op_I32Shl:
-    doI32Shl(executor, std::nullopt);
-    DISPATCH();
-
-  op_I32ShrS:
-    doI32ShrS(executor, std::nullopt);
-    DISPATCH();
-
-  op_I32ShrU:
-    doI32ShrU(executor, std::nullopt);
-    DISPATCH();
-
-  op_I32Rotl:
-    doI32Rotl(executor, std::nullopt);
-    DISPATCH();
-
-  op_I32Rotr:
-    doI32Rotr(executor, std::nullopt);
-    DISPATCH();
-
-  op_I64Clz:
-    doI64Clz(executor, std::nullopt);
-    DISPATCH();
-
-  op_I64Ctz:
-    doI64Ctz(executor, std::nullopt);
-    DISPATCH();
-
-  op_I64Popcnt:
-    doI64Popcnt(executor, std::nullopt);
-    DISPATCH();
-
-  op_I64Add:
-    doI64Add(executor, std::nullopt);
-    DISPATCH();
-
-  op_I64Sub:
-    doI64Sub(executor, std::nullopt);
-    DISPATCH();
-
-  op_I64Mul:
-    doI64Mul(executor, std::nullopt);
-    DISPATCH();
-
-  op_I64DivS:
-    doI64DivS(executor, std::nullopt);
-    DISPATCH();
-
-  op_I64DivU:
-    doI64DivU(executor, std::nullopt);
-    DISPATCH();
-
-  op_I64RemS:
-    doI64RemS(executor, std::nullopt);
-    DISPATCH();
-
-  op_I64RemU:
-    doI64RemU(executor, std::nullopt);
-    DISPATCH();
-
-  op_I64And:
-    doI64And(executor, std::nullopt);
-    DISPATCH();
-
-  op_I64Or:
-    doI64Or(executor, std::nullopt);
+    // Constants of all types are stored with the same bit pattern in code and stack slots.
+    PUSH(Runtime::RTValue::from((pc++)->bits));
     DISPATCH();
 
-  op_I64Xor:
-    doI64Xor(executor, std::nullopt);
-    DISPATCH();
-
-  op_I64Shl:
-    doI64Shl(executor, std::nullopt);
-    DISPATCH();
-
-  op_I64ShrS:
-    doI64ShrS(executor, std::nullopt);
-    DISPATCH();
-
-  op_I64ShrU:
-    doI64ShrU(executor, std::nullopt);
-    DISPATCH();
-
-  op_I64Rotl:
-    doI64Rotl(executor, std::nullopt);
-    DISPATCH();
-
-  op_I64Rotr:
-    doI64Rotr(executor, std::nullopt);
-    DISPATCH();
-
-  op_F32Abs:
-    doF32Abs(executor, std::nullopt);
-    DISPATCH();
-
-  op_F32Neg:
-    doF32Neg(executor, std::nullopt);
-    DISPATCH();
-
-  op_F32Ceil:
-    doF32Ceil(executor, std::nullopt);
-    DISPATCH();
-
-  op_F32Floor:
-    doF32Floor(executor, std::nullopt);
-    DISPATCH();
-
-  op_F32Trunc:
-    doF32Trunc(executor, std::nullopt);
-    DISPATCH();
-
-  op_F32NearestInt:
-    doF32NearestInt(executor, std::nullopt);
-    DISPATCH();
-
-  op_F32Sqrt:
-    doF32Sqrt(executor, std::nullopt);
-    DISPATCH();
-
-  op_F32Add:
-    doF32Add(executor, std::nullopt);
-    DISPATCH();
-
-  op_F32Sub:
-    doF32Sub(executor, std::nullopt);
-    DISPATCH();
-
-  op_F32Mul:
-    doF32Mul(executor, std::nullopt);
-    DISPATCH();
-
-  op_F32Div:
-    doF32Div(executor, std::nullopt);
-    DISPATCH();
-
-  op_F32Min:
-    doF32Min(executor, std::nullopt);
-    DISPATCH();
-
-  op_F32Max:
-    doF32Max(executor, std::nullopt);
-    DISPATCH();
-
-  op_F32CopySign:
-    doF32CopySign(executor, std::nullopt);
-    DISPATCH();
-
-  op_F64Abs:
-    doF64Abs(executor, std::nullopt);
-    DISPATCH();
-
-  op_F64Neg:
-    doF64Neg(executor, std::nullopt);
-    DISPATCH();
-
-  op_F64Ceil:
-    doF64Ceil(executor, std::nullopt);
-    DISPATCH();
-
-  op_F64Floor:
-    doF64Floor(executor, std::nullopt);
-    DISPATCH();
-
-  op_F64Trunc:
-    doF64Trunc(executor, std::nullopt);
-    DISPATCH();
+  ITERATE_LOAD_MEMOP(INLINE_LOAD_HANDLER)
+  ITERATE_STORE_MEMOP(INLINE_STORE_HANDLER)
+  OUT_OF_LINE_HANDLER(MemorySize)
+  OUT_OF_LINE_HANDLER(MemoryGrow)
 
-  op_F64NearestInt:
-    doF64NearestInt(executor, std::nullopt);
-    DISPATCH();
-
-  op_F64Sqrt:
-    doF64Sqrt(executor, std::nullopt);
-    DISPATCH();
+  ITERATE_SIMPLE_BINOP(INLINE_SIMPLE_BINOP_HANDLER)
+  ITERATE_BINOP(INLINE_BINOP_HANDLER)
+  ITERATE_UNOP(INLINE_UNOP_HANDLER)
+  ITERATE_TRUNCOP(INLINE_UNOP_HANDLER)
+  ITERATE_CONVERTOP(INLINE_UNOP_HANDLER)
+  ITERATE_REINTERPRETOP(INLINE_UNOP_HANDLER)
 
-  op_F64Add:
-    doF64Add(executor, std::nullopt);
-    DISPATCH();
+  // ===== Superinstructions =====
 
-  op_F64Sub:
-    doF64Sub(executor, std::nullopt);
+  op_LocalGetI32ConstI32Add:
+    PUSH(Runtime::RTValue::from(static_cast<Runtime::rt_i32_t>(
+      locals[pc[0].as<Runtime::index_t>()].as<uint32_t>() + pc[2].as<uint32_t>())));
+    pc += 4;
     DISPATCH();
 
-  op_F64Mul:
-    doF64Mul(executor, std::nullopt);
+  op_LocalGetI32ConstI32Sub:
+    PUSH(Runtime::RTValue::from(static_cast<Runtime::rt_i32_t>(
+      locals[pc[0].as<Runtime::index_t>()].as<uint32_t>() - pc[2].as<uint32_t>())));
+    pc += 4;
     DISPATCH();
 
-  op_F64Div:
-    doF64Div(executor, std::nullopt);
+  op_LocalGetI32ConstI32LtS:
+    PUSH(Runtime::RTValue::from(static_cast<Runtime::rt_i32_t>(
+      locals[pc[0].as<Runtime::index_t>()].as<Runtime::rt_i32_t>() < pc[2].as<Runtime::rt_i32_t>())));
+    pc += 4;
     DISPATCH();
 
-  op_F64Min:
-    doF64Min(executor, std::nullopt);
-    DISPATCH();
-
-  op_F64Max:
-    doF64Max(executor, std::nullopt);
-    DISPATCH();
-
-  op_F64CopySign:
-    doF64CopySign(executor, std::nullopt);
-    DISPATCH();
-
-  op_I32TruncF32S:
-    doI32TruncF32S(executor, std::nullopt);
-    DISPATCH();
-
-  op_I32TruncF32U:
-    doI32TruncF32U(executor, std::nullopt);
-    DISPATCH();
-
-  op_I32TruncF64S:
-    doI32TruncF64S(executor, std::nullopt);
-    DISPATCH();
-
-  op_I32TruncF64U:
-    doI32TruncF64U(executor, std::nullopt);
-    DISPATCH();
-
-  op_I64TruncF32S:
-    doI64TruncF32S(executor, std::nullopt);
-    DISPATCH();
-
-  op_I64TruncF32U:
-    doI64TruncF32U(executor, std::nullopt);
-    DISPATCH();
-
-  op_I64TruncF64S:
-    doI64TruncF64S(executor, std::nullopt);
-    DISPATCH();
-
-  op_I64TruncF64U:
-    doI64TruncF64U(executor, std::nullopt);
-    DISPATCH();
-
-  op_I64ExtendI32S:
-    doI64ExtendI32S(executor, std::nullopt);
-    DISPATCH();
-
-  op_I64ExtendI32U:
-    doI64ExtendI32U(executor, std::nullopt);
-    DISPATCH();
-
-  op_F32SConvertI32:
-    doF32SConvertI32(executor, std::nullopt);
-    DISPATCH();
-
-  op_F32UConvertI32:
-    doF32UConvertI32(executor, std::nullopt);
-    DISPATCH();
-
-  op_F32SConvertI64:
-    doF32SConvertI64(executor, std::nullopt);
-    DISPATCH();
-
-  op_F32UConvertI64:
-    doF32UConvertI64(executor, std::nullopt);
-    DISPATCH();
-
-  op_F64SConvertI32:
-    doF64SConvertI32(executor, std::nullopt);
-    DISPATCH();
-
-  op_F64UConvertI32:
-    doF64UConvertI32(executor, std::nullopt);
-    DISPATCH();
-
-  op_F64SConvertI64:
-    doF64SConvertI64(executor, std::nullopt);
-    DISPATCH();
-
-  op_F64UConvertI64:
-    doF64UConvertI64(executor, std::nullopt);
-    DISPATCH();
-
-  op_I32WrapI64:
-    doI32WrapI64(executor, std::nullopt);
-    DISPATCH();
-
-  op_F32DemoteF64:
-    doF32DemoteF64(executor, std::nullopt);
-    DISPATCH();
-
-  op_F64PromoteF32:
-    doF64PromoteF32(executor, std::nullopt);
-    DISPATCH();
-
-  op_I32ReinterpretF32:
-    doI32ReinterpretF32(executor, std::nullopt);
-    DISPATCH();
-
-  op_I64ReinterpretF64:
-    doI64ReinterpretF64(executor, std::nullopt);
-    DISPATCH();
-
-  op_F32ReinterpretI32:
-    doF32ReinterpretI32(executor, std::nullopt);
+  op_LocalGetLocalGetI32LtSBrIf: {
+    const auto taken =
+      locals[pc[0].as<Runtime::index_t>()].as<Runtime::rt_i32_t>() <
+      locals[pc[2].as<Runtime::index_t>()].as<Runtime::rt_i32_t>();
+    const auto depth = pc[5].as<Runtime::relative_depth_t>();
+    pc += 6;
+    if (taken) {
+      SPILL();
+      doBr(executor, depth);
+      EXIT_IF_STOPPED();  // Branched out of the entry function.
+      RELOAD();
+    }
     DISPATCH();
+  }
 
-  op_F64ReinterpretI64:
-    doF64ReinterpretI64(executor, std::nullopt);
+  op_I32ConstI32LoadMem:
+    SPILL();
+    doI32ConstI32LoadMem(executor, std::nullopt);
+    RELOAD();
     DISPATCH();
 
   // Invalid opcode handler
@@ -1544,6 +742,21 @@ init_dispatch_table:
     Exception::terminate(Exception::ErrorType::UNREACHABLE);
     return;
 
+  #undef INLINE_STORE_HANDLER
+  #undef INLINE_STORE_HANDLER_WITH
+  #undef INLINE_LOAD_HANDLER
+  #undef INLINE_LOAD_HANDLER_WITH
+  #undef SKIP_MEM_BOUNDS
+  #undef CHECK_MEM_BOUNDS
+  #undef INLINE_UNOP_HANDLER
+  #undef INLINE_BINOP_HANDLER
+  #undef INLINE_SIMPLE_BINOP_HANDLER
+  #undef OUT_OF_LINE_HANDLER
+  #undef POP
+  #undef PUSH
+  #undef EXIT_IF_STOPPED
+  #undef RELOAD
+  #undef SPILL
   #undef DISPATCH
   #undef USE_COMPUTED_GOTO
 
@@ -1551,9 +764,19 @@ init_dispatch_table:
   // Fallback for compilers without computed goto support
   #warning "Computed goto not supported by this compiler, falling back to slower dispatch"
   while (executor.getCurrentStatus() == Executor::EngineStatus::EXECUTING) {
-    Interpreter::opTokenHandlers[*executor.pc++](executor, std::nullopt);
+    Interpreter::opTokenHandlers[(executor.pc++)->as<uint32_t>()](executor, std::nullopt);
   }
 #endif
 }
 
+void Interpreter::executeProfiled(Executor& executor) {
+  OpcodeStats stats(executor.getEngineData()->options.ngramSize);
+  while (executor.getCurrentStatus() == Executor::EngineStatus::EXECUTING) {
+    const auto op = (executor.pc++)->as<uint32_t>();
+    stats.record(op);
+    opTokenHandlers[op](executor, std::nullopt);
+  }
+  stats.report(std::cerr);
+}
+
 }  // namespace TWVM
@@ -1,18 +1,343 @@
 // Copyright 2021 YHSPY. All rights reserved.
 #include "lib/include/jit_compiler.hh"
+#include "lib/include/code_cache.hh"
+#include "lib/include/executor.hh"
+#include "lib/include/interpreter.hh"
+#include "lib/include/kernels.hh"
 #include "lib/include/opcodes.hh"
 #include "lib/include/decoder.hh"
+#include "lib/include/exception.hh"
 #include "lib/include/util.hh"
+#include "llvm/Config/llvm-config.h"
+#include "llvm/ExecutionEngine/ObjectCache.h"
+#include "llvm/ExecutionEngine/Orc/CompileUtils.h"
 #include "llvm/ExecutionEngine/Orc/LLJIT.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/IR/LegacyPassManager.h"
 #include "llvm/IR/LLVMContext.h"
 #include "llvm/IR/Module.h"
 #include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/Intrinsics.h"
 #include "llvm/IR/Verifier.h"
+#include "llvm/Object/ObjectFile.h"
+#include "llvm/Passes/PassBuilder.h"
 #include "llvm/Support/TargetSelect.h"
+#include "llvm/Target/TargetMachine.h"
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstring>
+#include <iomanip>
 #include <iostream>
+#include <type_traits>
 
 namespace TWVM {
 
+// Modules named after the key of a cache entry are cached in `dir`, as "<key>-<function index>-O<level>.o",
+// with a "-guarded" suffix for the code leaving the bounds checks to the guard pages.
+namespace {
+
+// Of the host functions called by the compiled code, on a trap with the `Exception::ErrorType`,
+// for the calls not linked directly, see `Interpreter::callFromNative`, and for `memory.grow`.
+constexpr char JIT_TRAP_SYMBOL[] = "twvm_jit_trap";
+constexpr char JIT_CALL_SYMBOL[] = "twvm_jit_call";
+constexpr char JIT_MEMORY_GROW_SYMBOL[] = "twvm_jit_memory_grow";
+constexpr char FUNC_SYMBOL_PREFIX[] = "wasm_func_";
+// The symbols of the objects written by `JITCompiler::compileModule`.
+constexpr char AOT_KEY_SYMBOL[] = "twvm_aot_key";
+constexpr char AOT_FUNCS_SYMBOL[] = "twvm_aot_funcs";  // Null for the functions not compiled.
+constexpr uint8_t BLOCK_TYPE_EMPTY = 0x40;
+// Of `JITOptLevel`, the translation keeps the locals and the operands crossing blocks in stack
+// slots and phis, which mem2reg turns into registers, most of the speedup for little of the time.
+constexpr char BASELINE_PIPELINE[] = "function(mem2reg,instcombine,simplifycfg)";
+constexpr char OPTIMIZING_PIPELINE[] =
+  "function(sroa,early-cse,instcombine,simplifycfg,reassociate,loop-mssa(loop-rotate,licm),gvn,"
+  "loop(indvars,loop-deletion),loop-unroll,instcombine,simplifycfg)";
+
+// Of the object last compiled or loaded from the cache on this thread, which is the module being
+// looked up, as LLJIT materializes the modules on the threads looking them up.
+struct ObjectInfo {
+  uint64_t codeBytes = 0;
+  bool cached = false;
+};
+thread_local ObjectInfo lastObject;
+
+[[noreturn]] void jitTrap(uint32_t type) {
+  Exception::terminate(static_cast<Exception::ErrorType>(type));
+}
+
+// The memory may have been grown, and moved unless reserved, by the VM.
+void refreshMemory(Runtime::RTJITContext* ctx) {
+  if (!ctx->runtime->rtMems.empty()) {
+    const auto& mem = ctx->runtime->rtMems.front();
+    ctx->memBase = mem.ptr;
+    ctx->memBytes = mem.size * WASM_PAGE_SIZE_IN_BYTE;
+  }
+}
+
+uint64_t jitCall(Runtime::RTJITContext* ctx, uint32_t funcIdx, const Runtime::RTValue* args) {
+  const auto result = Interpreter::callFromNative(*ctx->caller, funcIdx, args);
+  refreshMemory(ctx);
+  return result;
+}
+
+int32_t jitMemoryGrow(Runtime::RTJITContext* ctx, uint32_t delta) {
+  const auto prevPages = ctx->caller->resizeMem(delta);
+  refreshMemory(ctx);
+  return static_cast<int32_t>(prevPages);
+}
+
+uint64_t textBytes(llvm::MemoryBufferRef object) {
+  auto file = llvm::object::ObjectFile::createObjectFile(object);
+  if (!file) {
+    llvm::consumeError(file.takeError());
+    return 0;
+  }
+  uint64_t bytes = 0;
+  for (const auto& section : (*file)->sections()) {
+    if (section.isText()) {
+      bytes += section.getSize();
+    }
+  }
+  return bytes;
+}
+
+// Runs the pipeline of the level on the module, which is left as is if it fails to build.
+void optimize(llvm::Module& module, JITOptLevel level) {
+  if (level == JITOptLevel::None) {
+    return;
+  }
+  llvm::LoopAnalysisManager lam;
+  llvm::FunctionAnalysisManager fam;
+  llvm::CGSCCAnalysisManager cgam;
+  llvm::ModuleAnalysisManager mam;
+  llvm::PassBuilder builder;
+  builder.registerModuleAnalyses(mam);
+  builder.registerCGSCCAnalyses(cgam);
+  builder.registerFunctionAnalyses(fam);
+  builder.registerLoopAnalyses(lam);
+  builder.crossRegisterProxies(lam, fam, cgam, mam);
+  llvm::ModulePassManager passes;
+  if (auto err = builder.parsePassPipeline(
+    passes, level == JITOptLevel::Baseline ? BASELINE_PIPELINE : OPTIMIZING_PIPELINE)) {
+    llvm::errs() << "[JIT] Failed to build the pipeline: " << llvm::toString(std::move(err)) << "\n";
+    return;
+  }
+  passes.run(module, mam);
+}
+
+double elapsedMs(std::chrono::steady_clock::time_point& since) {
+  const auto now = std::chrono::steady_clock::now();
+  const auto elapsed = std::chrono::duration<double, std::milli>(now - since).count();
+  since = now;
+  return elapsed;
+}
+
+std::string funcSymbol(uint32_t funcIdx) {
+  return FUNC_SYMBOL_PREFIX + std::to_string(funcIdx);
+}
+
+// The first of the structurally equal types, so that a signature check compares the indices.
+uint32_t canonicalTypeIdx(const Module& mod, uint32_t typeIdx) {
+  const auto& types = mod.funcTypes;
+  return static_cast<uint32_t>(std::find(types.begin(), types.end(), types.at(typeIdx)) - types.begin());
+}
+
+// The typed copy of the default table read by `call_indirect`, see `Runtime::RTJITTableEntry`.
+void buildTable(Runtime& rt) {
+  if (!rt.jitTable.empty() || rt.rtTables.empty()) {
+    return;
+  }
+  const auto& mod = *rt.module;
+  for (const auto& elem : rt.rtTables.front()) {
+    rt.jitTable.push_back(elem.has_value() ?
+      Runtime::RTJITTableEntry { canonicalTypeIdx(mod, mod.funcTypesIndices.at(*elem)), *elem } :
+      Runtime::RTJITTableEntry { JIT_TABLE_ELEM_UNINITIALIZED, 0 });
+  }
+}
+
+// An artifact of `compileModule` leaves the bounds checks to the guard pages, or not.
+std::string artifactKey(const Runtime& rt) {
+  const bool guarded = !rt.rtMems.empty() && rt.rtMems.front().guarded;
+  return CodeCache::moduleKey(*rt.module) + (guarded ? "-guarded" : "");
+}
+
+template<typename T>
+llvm::Type* toLLVMType(llvm::LLVMContext& ctx) {
+  if constexpr (std::is_same_v<T, float>) {
+    return llvm::Type::getFloatTy(ctx);
+  } else if constexpr (std::is_same_v<T, double>) {
+    return llvm::Type::getDoubleTy(ctx);
+  } else {
+    return llvm::Type::getIntNTy(ctx, sizeof(T) * 8);
+  }
+}
+
+llvm::Type* toLLVMType(uint8_t type, llvm::LLVMContext& ctx) {
+  switch (static_cast<ValueTypes>(type)) {
+    case ValueTypes::I64: return llvm::Type::getInt64Ty(ctx);
+    case ValueTypes::F32: return llvm::Type::getFloatTy(ctx);
+    case ValueTypes::F64: return llvm::Type::getDoubleTy(ctx);
+    default: return llvm::Type::getInt32Ty(ctx);
+  }
+}
+
+// Moves past the immediates of an instruction in unreachable code, which is not translated.
+void skipImmediates(OpCodes op, const uint8_t*& pc) {
+  switch (op) {
+    case OpCodes::Block:
+    case OpCodes::Loop:
+    case OpCodes::If:
+    case OpCodes::MemorySize:
+    case OpCodes::MemoryGrow: {
+      pc++;  // Block type, or reserved.
+      break;
+    }
+    case OpCodes::Br:
+    case OpCodes::BrIf:
+    case OpCodes::Call:
+    case OpCodes::LocalGet:
+    case OpCodes::LocalSet:
+    case OpCodes::LocalTee:
+    case OpCodes::GlobalGet:
+    case OpCodes::GlobalSet:
+    case OpCodes::I32Const: {
+      Decoder::decodeVaruint<uint32_t>(pc);  // Only the length matters.
+      break;
+    }
+    case OpCodes::I64Const: {
+      Decoder::decodeVaruint<uint64_t>(pc);
+      break;
+    }
+    case OpCodes::F32Const: {
+      pc += sizeof(Runtime::rt_f32_t);
+      break;
+    }
+    case OpCodes::F64Const: {
+      pc += sizeof(Runtime::rt_f64_t);
+      break;
+    }
+    case OpCodes::BrTable: {
+      const auto targetCount = Decoder::decodeVaruint<uint32_t>(pc);
+      for (uint32_t i = 0; i <= targetCount; ++i) {
+        Decoder::decodeVaruint<uint32_t>(pc);
+      }
+      break;
+    }
+    case OpCodes::CallIndirect: {
+      Decoder::decodeVaruint<uint32_t>(pc);
+      pc++;  // Reserved.
+      break;
+    }
+    default: {
+      // Memory accesses, the alignment hint and the offset.
+      if (op >= OpCodes::I32LoadMem && op <= OpCodes::I64StoreMem32) {
+        Decoder::decodeVaruint<uint32_t>(pc);
+        Decoder::decodeVaruint<uint32_t>(pc);
+      }
+      break;
+    }
+  }
+}
+
+// A structured instruction being translated, or the function body itself.
+struct CtrlFrame {
+  llvm::BasicBlock* header;  // Of a loop, the target of its branches.
+  llvm::BasicBlock* cont;  // Following the `End`, the target of the branches otherwise.
+  llvm::BasicBlock* elseArm;  // Of an `If`, until its `Else`.
+  llvm::PHINode* result;  // In `cont`, none for the empty block type.
+  size_t height;  // Of the value stack on entering.
+  bool unreachable;  // After a branch, until the `Else` or `End`.
+};
+
+// The values are kept in the low bytes of the `RTValue` slots, as by `RTValue::from`.
+llvm::Value* toSlot(llvm::IRBuilder<>& builder, llvm::Value* val) {
+  auto* const bits = builder.CreateBitCast(val, builder.getIntNTy(val->getType()->getPrimitiveSizeInBits()));
+  return builder.CreateZExt(bits, builder.getInt64Ty());
+}
+llvm::Value* fromSlot(llvm::IRBuilder<>& builder, llvm::Value* slot, llvm::Type* type) {
+  const auto bitWidth = type->getPrimitiveSizeInBits();
+  if (bitWidth < 64) {
+    slot = builder.CreateTrunc(slot, builder.getIntNTy(bitWidth));
+  }
+  return builder.CreateBitCast(slot, type);
+}
+llvm::Value* loadSlot(llvm::IRBuilder<>& builder, llvm::Value* slots, size_t idx, llvm::Type* type) {
+  auto* const slotType = builder.getInt64Ty();
+  return fromSlot(builder, builder.CreateLoad(slotType, builder.CreateConstGEP1_32(slotType, slots, idx)), type);
+}
+
+// Calls the function through the VM, with the arguments in `RTValue` slots.
+llvm::Value* callThroughVM(llvm::IRBuilder<>& builder, llvm::Value* ctx, llvm::Value* funcIdx,
+                           llvm::Type* resultType, llvm::ArrayRef<llvm::Value*> args) {
+  auto* const func = builder.GetInsertBlock()->getParent();
+  auto* const slotType = builder.getInt64Ty();
+  const auto stub = func->getParent()->getOrInsertFunction(JIT_CALL_SYMBOL, llvm::FunctionType::get(
+    slotType, { builder.getInt8PtrTy(), builder.getInt32Ty(), slotType->getPointerTo() }, false));
+  // In the entry block, so that the calls in loops do not grow the native stack.
+  llvm::IRBuilder<> entryBuilder(&func->getEntryBlock(), func->getEntryBlock().begin());
+  auto* const slots = entryBuilder.CreateAlloca(
+    slotType, builder.getInt32(std::max<size_t>(args.size(), 1)), "slots");
+  for (size_t i = 0; i < args.size(); ++i) {
+    builder.CreateStore(toSlot(builder, args[i]), builder.CreateConstGEP1_32(slotType, slots, i));
+  }
+  auto* const result = builder.CreateCall(stub, { ctx, funcIdx, slots });
+  return resultType->isVoidTy() ? nullptr : fromSlot(builder, result, resultType);
+}
+
+// Gives the functions called, but not translated into the module, a body calling through the VM.
+void defineThunks(llvm::Module* module) {
+  std::vector<llvm::Function*> callees;
+  for (auto& func : module->functions()) {
+    if (func.isDeclaration() && func.getName().startswith(FUNC_SYMBOL_PREFIX)) {
+      callees.push_back(&func);
+    }
+  }
+  for (auto* const func : callees) {
+    llvm::IRBuilder<> builder(llvm::BasicBlock::Create(func->getContext(), "entry", func));
+    const auto funcIdx = std::stoul(func->getName().substr(sizeof(FUNC_SYMBOL_PREFIX) - 1).str());
+    std::vector<llvm::Value*> args;
+    for (auto& arg : llvm::drop_begin(func->args())) {
+      args.push_back(&arg);
+    }
+    auto* const result =
+      callThroughVM(builder, func->getArg(0), builder.getInt32(funcIdx), func->getReturnType(), args);
+    if (result == nullptr) {
+      builder.CreateRetVoid();
+    } else {
+      builder.CreateRet(result);
+    }
+    func->setLinkage(llvm::Function::InternalLinkage);
+  }
+}
+
+}  // namespace
+
+// The object of a module is kept at its source file name, which is left empty when not cached.
+// Stateless, as it is used by the compile threads concurrently.
+class JITCompiler::ObjectFileCache : public llvm::ObjectCache {
+ public:
+  void notifyObjectCompiled(const llvm::Module* module, llvm::MemoryBufferRef object) override {
+    lastObject = { textBytes(object), false };
+    if (!module->getSourceFileName().empty()) {
+      CodeCache::writeFile(module->getSourceFileName(),
+        reinterpret_cast<const uint8_t*>(object.getBufferStart()), object.getBufferSize());
+    }
+  }
+  std::unique_ptr<llvm::MemoryBuffer> getObject(const llvm::Module* module) override {
+    if (module->getSourceFileName().empty()) {
+      return nullptr;
+    }
+    // Mapped by LLVM unless the file is small.
+    auto buffer = llvm::MemoryBuffer::getFile(module->getSourceFileName(), false, false);
+    if (!buffer) {
+      return nullptr;
+    }
+    lastObject = { textBytes((*buffer)->getMemBufferRef()), true };
+    return std::move(*buffer);
+  }
+};
+
 JITCompiler& JITCompiler::getInstance() {
   static JITCompiler instance;
   return instance;
@@ -20,7 +345,12 @@ JITCompiler& JITCompiler::getInstance() {
 
 JITCompiler::JITCompiler() {}
 
-JITCompiler::~JITCompiler() {}
+JITCompiler::~JITCompiler() {
+  // The functions still queued are dropped, those being compiled are waited for.
+  std::unique_lock<std::mutex> lock(queueMutex);
+  stopping = true;
+  idle.wait(lock, [this]() { return workers == 0; });
+}
 
 bool JITCompiler::initialize() {
   if (jitInitialized) {
@@ -32,87 +362,84 @@ bool JITCompiler::initialize() {
   llvm::InitializeNativeTargetAsmPrinter();
   llvm::InitializeNativeTargetAsmParser();
 
-  // Create LLVM context
-  context = std::make_unique<llvm::LLVMContext>();
-
-  // Create LLJIT instance
-  auto jitOrErr = llvm::orc::LLJITBuilder().create();
+  // Create LLJIT instance, compiling through the object cache with a target machine per module,
+  // so that the compile threads never share one.
+  objectCache = std::make_unique<ObjectFileCache>();
+  auto jitOrErr = llvm::orc::LLJITBuilder()
+    .setCompileFunctionCreator([this](llvm::orc::JITTargetMachineBuilder jtmb)
+      -> llvm::Expected<std::unique_ptr<llvm::orc::IRCompileLayer::IRCompiler>> {
+      return std::make_unique<llvm::orc::ConcurrentIRCompiler>(std::move(jtmb), objectCache.get());
+    })
+    .create();
   if (!jitOrErr) {
     llvm::errs() << "Failed to create LLJIT: " << llvm::toString(jitOrErr.takeError()) << "\n";
     return false;
   }
 
   jit = std::move(*jitOrErr);
-  jitInitialized = true;
 
-  std::cout << "[JIT] Initialized LLVM ORC JIT v2\n";
+  // The host functions called by the compiled code.
+  llvm::orc::SymbolMap runtime;
+  const auto define = [&](const char* name, auto* ptr) {
+#if LLVM_VERSION_MAJOR >= 17
+    runtime[jit->mangleAndIntern(name)] = { llvm::orc::ExecutorAddr::fromPtr(ptr), llvm::JITSymbolFlags::Exported };
+#else
+    runtime[jit->mangleAndIntern(name)] =
+      llvm::JITEvaluatedSymbol(llvm::pointerToJITTargetAddress(ptr), llvm::JITSymbolFlags::Exported);
+#endif
+  };
+  define(JIT_TRAP_SYMBOL, &jitTrap);
+  define(JIT_CALL_SYMBOL, &jitCall);
+  define(JIT_MEMORY_GROW_SYMBOL, &jitMemoryGrow);
+  if (auto err = jit->getMainJITDylib().define(llvm::orc::absoluteSymbols(std::move(runtime)))) {
+    llvm::errs() << "Failed to define the runtime symbols: " << llvm::toString(std::move(err)) << "\n";
+    return false;
+  }
+  jitInitialized = true;
   return true;
 }
 
 llvm::FunctionType* JITCompiler::createFunctionType(const Module::func_type_t& funcType,
                                                      llvm::LLVMContext& ctx) {
-  // For PoC: assume i32 parameters and return types
-  std::vector<llvm::Type*> paramTypes;
+  std::vector<llvm::Type*> paramTypes = { llvm::Type::getInt8PtrTy(ctx) };  // The `RTJITContext`.
   for (const auto& param : funcType.first) {
-    // Map WebAssembly types to LLVM types
-    switch (static_cast<ValueTypes>(param)) {
-      case ValueTypes::I32:
-        paramTypes.push_back(llvm::Type::getInt32Ty(ctx));
-        break;
-      case ValueTypes::I64:
-        paramTypes.push_back(llvm::Type::getInt64Ty(ctx));
-        break;
-      case ValueTypes::F32:
-        paramTypes.push_back(llvm::Type::getFloatTy(ctx));
-        break;
-      case ValueTypes::F64:
-        paramTypes.push_back(llvm::Type::getDoubleTy(ctx));
-        break;
-      default:
-        paramTypes.push_back(llvm::Type::getInt32Ty(ctx));
-        break;
-    }
+    paramTypes.push_back(toLLVMType(param, ctx));
   }
-
-  // Return type
-  llvm::Type* returnType = llvm::Type::getVoidTy(ctx);
-  if (funcType.second.size() > 0) {
-    switch (static_cast<ValueTypes>(funcType.second[0])) {
-      case ValueTypes::I32:
-        returnType = llvm::Type::getInt32Ty(ctx);
-        break;
-      case ValueTypes::I64:
-        returnType = llvm::Type::getInt64Ty(ctx);
-        break;
-      case ValueTypes::F32:
-        returnType = llvm::Type::getFloatTy(ctx);
-        break;
-      case ValueTypes::F64:
-        returnType = llvm::Type::getDoubleTy(ctx);
-        break;
-      default:
-        returnType = llvm::Type::getInt32Ty(ctx);
-        break;
-    }
-  }
-
+  // At most one result in MVP.
+  llvm::Type* returnType = funcType.second.empty() ? llvm::Type::getVoidTy(ctx) : toLLVMType(funcType.second[0], ctx);
   return llvm::FunctionType::get(returnType, paramTypes, false);
 }
 
 llvm::Function* JITCompiler::translateToIR(uint32_t funcIdx,
                                            const Runtime::RTFuncDescriptor& descriptor,
                                            shared_module_runtime_t rtIns,
-                                           llvm::Module* module) {
-  llvm::IRBuilder<> builder(*context);
+                                           llvm::Module* module,
+                                           bool osr,
+                                           bool* noLoops) {
+  auto& context = module->getContext();  // Of its own per compilation, so that they run concurrently.
+  llvm::IRBuilder<> builder(context);
+  auto* const i32Type = llvm::Type::getInt32Ty(context);
+  auto* const i64Type = llvm::Type::getInt64Ty(context);
+  const auto& mod = *rtIns->module;
 
-  // Create function
-  std::string funcName = "wasm_func_" + std::to_string(funcIdx);
-  llvm::FunctionType* funcType = createFunctionType(*descriptor.funcType, *context);
-  llvm::Function* func = llvm::Function::Create(funcType, llvm::Function::ExternalLinkage,
-                                                 funcName, module);
+  // Create function, or define the one declared by the functions calling it.
+  const auto declare = [&](uint32_t idx) {
+    const auto name = funcSymbol(idx);
+    auto* const declared = module->getFunction(name);
+    return declared != nullptr ? declared : llvm::Function::Create(
+      createFunctionType(mod.funcTypes.at(mod.funcTypesIndices.at(idx)), context),
+      llvm::Function::ExternalLinkage, name, module);
+  };
+  llvm::Function* func = !osr ? declare(funcIdx) : llvm::Function::Create(
+    llvm::FunctionType::get(i64Type, { builder.getInt8PtrTy(), i64Type->getPointerTo(), i32Type }, false),
+    llvm::Function::ExternalLinkage, "wasm_osr_" + std::to_string(funcIdx), module);
+  const auto trap = module->getOrInsertFunction(
+    JIT_TRAP_SYMBOL, llvm::FunctionType::get(builder.getVoidTy(), { i32Type }, false));
+  const auto memoryGrow = module->getOrInsertFunction(
+    JIT_MEMORY_GROW_SYMBOL, llvm::FunctionType::get(i32Type, { builder.getInt8PtrTy(), i32Type }, false));
 
   // Create entry basic block
-  llvm::BasicBlock* entry = llvm::BasicBlock::Create(*context, "entry", func);
+  llvm::BasicBlock* entry = llvm::BasicBlock::Create(context, "entry", func);
   builder.SetInsertPoint(entry);
 
   // Allocate locals (parameters + local variables)
@@ -120,204 +447,560 @@ llvm::Function* JITCompiler::translateToIR(uint32_t funcIdx,
 
   // Set up parameters
   size_t paramCount = descriptor.funcType->first.size();
-  size_t idx = 0;
-  for (auto& arg : func->args()) {
-    llvm::AllocaInst* alloca = builder.CreateAlloca(arg.getType(), nullptr, "param_" + std::to_string(idx));
-    builder.CreateStore(&arg, alloca);
+  func->getArg(0)->setName("ctx");
+  // Of the on-stack replacement, the locals then the operands of the interpreted frame.
+  auto* const slotsArg = osr ? func->getArg(1) : nullptr;
+  for (size_t i = 0; i < paramCount; ++i) {
+    auto* const paramType = toLLVMType(descriptor.funcType->first[i], context);
+    llvm::AllocaInst* alloca = builder.CreateAlloca(paramType, nullptr, "param_" + std::to_string(i));
+    builder.CreateStore(osr ? loadSlot(builder, slotsArg, i, paramType) : func->getArg(i + 1), alloca);
     locals.push_back(alloca);
-    idx++;
-  }
-
-  // Allocate additional locals from descriptor.localsDefault
-  for (size_t i = paramCount; i < descriptor.localsDefault.size(); ++i) {
-    const auto& localVal = descriptor.localsDefault[i];
-    llvm::Type* localType = nullptr;
-
-    if (std::holds_alternative<Runtime::rt_i32_t>(localVal)) {
-      localType = llvm::Type::getInt32Ty(*context);
-    } else if (std::holds_alternative<Runtime::rt_i64_t>(localVal)) {
-      localType = llvm::Type::getInt64Ty(*context);
-    } else if (std::holds_alternative<Runtime::rt_f32_t>(localVal)) {
-      localType = llvm::Type::getFloatTy(*context);
-    } else if (std::holds_alternative<Runtime::rt_f64_t>(localVal)) {
-      localType = llvm::Type::getDoubleTy(*context);
-    } else {
-      localType = llvm::Type::getInt32Ty(*context);
-    }
+  }
 
-    llvm::AllocaInst* alloca = builder.CreateAlloca(localType, nullptr, "local_" + std::to_string(i));
+  // Allocate additional locals, runtime values are untagged so take the types from the module.
+  const auto& localTypes = rtIns->module->funcDefs.at(funcIdx).locals;
+  for (size_t i = 0; i < localTypes.size(); ++i) {
+    llvm::Type* localType = toLLVMType(localTypes[i], context);
+    llvm::AllocaInst* alloca =
+      builder.CreateAlloca(localType, nullptr, "local_" + std::to_string(paramCount + i));
     // Initialize to zero
-    builder.CreateStore(llvm::Constant::getNullValue(localType), alloca);
+    builder.CreateStore(osr ?
+      loadSlot(builder, slotsArg, paramCount + i, localType) : llvm::Constant::getNullValue(localType), alloca);
     locals.push_back(alloca);
   }
 
-  // WebAssembly stack simulation (for now, use simple vector)
+  // Parse bytecode and translate to LLVM IR
+  const uint8_t* pc = rtIns->module->funcDefs.at(funcIdx).body.data();
+
+  // WebAssembly stack simulation, the values are SSA registers.
   std::vector<llvm::Value*> stack;
+  const auto pop = [&stack]() {
+    auto* const val = stack.back();
+    stack.pop_back();
+    return val;
+  };
+  const auto newBlock = [&](const char* name) {
+    return llvm::BasicBlock::Create(context, name, func);
+  };
 
-  // Parse bytecode and translate to LLVM IR
-  uint8_t* pc = descriptor.codeEntry;
-  bool running = true;
+  // Structured control flow, the function body is the outermost frame.
+  std::vector<CtrlFrame> ctrlStack;
+  const auto enter = [&](llvm::BasicBlock* header, llvm::BasicBlock* cont, uint8_t blockType) {
+    llvm::PHINode* result = nullptr;
+    if (blockType != BLOCK_TYPE_EMPTY) {
+      result = llvm::PHINode::Create(toLLVMType(blockType, context), 2, "result", cont);
+    }
+    ctrlStack.push_back({ header, cont, nullptr, result, stack.size(), false });
+  };
+  // Leaves the frame through its continuation, with the result on top of the stack.
+  const auto exitTo = [&](CtrlFrame& frame) {
+    if (frame.result != nullptr) {
+      frame.result->addIncoming(stack.back(), builder.GetInsertBlock());
+    }
+    builder.CreateBr(frame.cont);
+  };
+  const auto branch = [&](uint32_t depth) {
+    auto& frame = ctrlStack.at(ctrlStack.size() - 1 - depth);
+    if (frame.header != nullptr) {
+      builder.CreateBr(frame.header);  // No loop takes parameters in MVP.
+    } else {
+      exitTo(frame);
+    }
+  };
+  const auto compare = [&](llvm::CmpInst::Predicate pred) {
+    auto* const rhs = pop();
+    auto* const lhs = pop();
+    stack.push_back(builder.CreateZExt(builder.CreateICmp(pred, lhs, rhs), i32Type));
+  };
+  const auto binop = [&](llvm::Instruction::BinaryOps opcode) {
+    auto* const rhs = pop();
+    auto* const lhs = pop();
+    stack.push_back(builder.CreateBinOp(opcode, lhs, rhs));
+  };
+  const auto intrinsic = [&](llvm::Intrinsic::ID id, std::vector<llvm::Value*> args) {
+    stack.push_back(builder.CreateIntrinsic(id, { args.front()->getType() }, args));
+  };
+  const auto emitTrap = [&](llvm::Value* type) {
+    builder.CreateCall(trap, { type });
+    builder.CreateUnreachable();
+  };
+  const auto trapIf = [&](llvm::Value* cond, Exception::ErrorType type) {
+    auto* const trapped = newBlock("trap");
+    auto* const next = newBlock("trap_next");
+    builder.CreateCondBr(cond, trapped, next);
+    builder.SetInsertPoint(trapped);
+    emitTrap(builder.getInt32(static_cast<uint32_t>(type)));
+    builder.SetInsertPoint(next);
+  };
 
-  while (running) {
+  // The fields of the `RTJITContext`, which is not typed in IR.
+  auto* const ctxArg = func->getArg(0);
+  const auto loadContext = [&](size_t offset, llvm::Type* type) {
+    auto* const field = builder.CreateConstInBoundsGEP1_64(builder.getInt8Ty(), ctxArg, offset);
+    return builder.CreateLoad(type, builder.CreateBitCast(field, type->getPointerTo()));
+  };
+  // Of a memory access of `memType`, out of bounds accesses fault on the guard pages if any.
+  const bool guarded = !rtIns->rtMems.empty() && rtIns->rtMems.front().guarded;
+  const auto address = [&](llvm::Type* memType) {
+    Decoder::decodeVaruint<uint32_t>(pc);  // The alignment hint.
+    const auto offset = Decoder::decodeVaruint<uint32_t>(pc);
+    auto* const ea = builder.CreateAdd(builder.CreateZExt(pop(), i64Type), builder.getInt64(offset));
+    if (!guarded) {
+      auto* const end = builder.CreateAdd(ea, builder.getInt64(memType->getPrimitiveSizeInBits() / 8));
+      trapIf(builder.CreateICmpUGT(end, loadContext(offsetof(Runtime::RTJITContext, memBytes), i64Type)),
+        Exception::ErrorType::MEM_ACCESS_OOB);
+    }
+    auto* const base = loadContext(offsetof(Runtime::RTJITContext, memBase), builder.getInt8PtrTy());
+    return builder.CreateBitCast(builder.CreateInBoundsGEP(builder.getInt8Ty(), base, ea), memType->getPointerTo());
+  };
+  const auto load = [&](llvm::Type* valType, llvm::Type* memType, bool isSigned) {
+    llvm::Value* val = builder.CreateAlignedLoad(memType, address(memType), llvm::MaybeAlign(1));
+    if (memType != valType) {
+      val = isSigned ? builder.CreateSExt(val, valType) : builder.CreateZExt(val, valType);
+    }
+    stack.push_back(val);
+  };
+  const auto store = [&](llvm::Type* memType) {
+    llvm::Value* val = pop();
+    if (val->getType() != memType) {
+      val = builder.CreateTrunc(val, memType);
+    }
+    builder.CreateAlignedStore(val, address(memType), llvm::MaybeAlign(1));
+  };
+  const auto global = [&](uint32_t idx) {
+    auto* const type = toLLVMType(mod.globals.at(idx).globalType.valType, context);
+    auto* const globals = loadContext(offsetof(Runtime::RTJITContext, globals), i64Type->getPointerTo());
+    return builder.CreateBitCast(builder.CreateConstInBoundsGEP1_32(i64Type, globals, idx), type->getPointerTo());
+  };
+  const auto popArgs = [&](llvm::FunctionType* type) {
+    std::vector<llvm::Value*> args(type->getNumParams());
+    args[0] = ctxArg;
+    for (size_t i = args.size() - 1; i > 0; --i) {
+      args[i] = pop();
+    }
+    return args;
+  };
+  const uint8_t funcBlockType = descriptor.funcType->second.empty() ?
+    BLOCK_TYPE_EMPTY : descriptor.funcType->second.front();
+  enter(nullptr, newBlock("exit"), funcBlockType);
+
+  // The on-stack replacement enters at the header of a loop only, the code before it is left dead.
+  llvm::SwitchInst* osrEntries = nullptr;
+  if (osr) {
+    auto* const start = newBlock("start");
+    auto* const invalid = newBlock("osr_invalid");
+    osrEntries = builder.CreateSwitch(func->getArg(2), invalid);
+    builder.SetInsertPoint(invalid);
+    builder.CreateUnreachable();
+    builder.SetInsertPoint(start);
+  }
+  uint32_t loopCount = 0;  // As indexed by the `Translator`.
+  // An entry for the OSR has no callers, so that a failed one is left out of the module.
+  const auto fail = [&]() -> llvm::Function* {
+    if (osr) {
+      func->eraseFromParent();
+    }
+    return nullptr;
+  };
+
+  uint32_t deadDepth = 0;  // Of the structured instructions nested in unreachable code.
+
+  while (!ctrlStack.empty()) {
     OpCodes op = static_cast<OpCodes>(*pc++);
 
+    // After a branch, only the `Else` or `End` of the frame is translated.
+    if (ctrlStack.back().unreachable) {
+      if (op == OpCodes::Block || op == OpCodes::Loop || op == OpCodes::If) {
+        if (op == OpCodes::Loop) {
+          loopCount++;
+        }
+        deadDepth++;
+      } else if (op == OpCodes::End && deadDepth > 0) {
+        deadDepth--;
+        continue;
+      }
+      if (deadDepth > 0 || (op != OpCodes::Else && op != OpCodes::End)) {
+        skipImmediates(op, pc);
+        continue;
+      }
+    }
+
     switch (op) {
-      case OpCodes::End:
-        running = false;
+      case OpCodes::Unreachable: {
+        emitTrap(builder.getInt32(static_cast<uint32_t>(Exception::ErrorType::UNREACHABLE)));
+        ctrlStack.back().unreachable = true;
+        break;
+      }
+
+      case OpCodes::Nop:
         break;
 
-      case OpCodes::Return: {
-        if (funcType->getReturnType()->isVoidTy()) {
-          builder.CreateRetVoid();
-        } else if (!stack.empty()) {
-          llvm::Value* retVal = stack.back();
-          stack.pop_back();
-          builder.CreateRet(retVal);
-        } else {
-          builder.CreateRet(llvm::Constant::getNullValue(funcType->getReturnType()));
-        }
-        running = false;
+      case OpCodes::Block: {
+        enter(nullptr, newBlock("block_end"), *pc++);
         break;
       }
 
-      case OpCodes::LocalGet: {
-        uint32_t localIdx = Decoder::decodeVaruint<uint32_t>(pc);
-        if (localIdx < locals.size()) {
-          llvm::Value* val = builder.CreateLoad(locals[localIdx]->getAllocatedType(), locals[localIdx]);
-          stack.push_back(val);
+      case OpCodes::Loop: {
+        if (osr) {
+          // Joined by the entry from the interpreter, with the operands below the loop in the slots.
+          auto* const from = builder.GetInsertBlock();
+          auto* const osrEntry = newBlock("osr_entry");
+          auto* const join = newBlock("osr_join");
+          builder.CreateBr(join);
+          builder.SetInsertPoint(osrEntry);
+          std::vector<llvm::Value*> operands;
+          for (size_t i = 0; i < stack.size(); ++i) {
+            operands.push_back(loadSlot(builder, slotsArg, locals.size() + i, stack[i]->getType()));
+          }
+          builder.CreateBr(join);
+          builder.SetInsertPoint(join);
+          for (size_t i = 0; i < stack.size(); ++i) {
+            auto* const phi = builder.CreatePHI(stack[i]->getType(), 2);
+            phi->addIncoming(stack[i], from);
+            phi->addIncoming(operands[i], osrEntry);
+            stack[i] = phi;
+          }
+          osrEntries->addCase(builder.getInt32(loopCount), osrEntry);
         }
+        loopCount++;
+        auto* const header = newBlock("loop");
+        builder.CreateBr(header);
+        builder.SetInsertPoint(header);
+        enter(header, newBlock("loop_end"), *pc++);
         break;
       }
 
-      case OpCodes::LocalSet: {
-        uint32_t localIdx = Decoder::decodeVaruint<uint32_t>(pc);
-        if (localIdx < locals.size() && !stack.empty()) {
-          llvm::Value* val = stack.back();
-          stack.pop_back();
-          builder.CreateStore(val, locals[localIdx]);
+      case OpCodes::If: {
+        const uint8_t blockType = *pc++;
+        auto* const cond = builder.CreateICmpNE(pop(), builder.getInt32(0));
+        auto* const thenArm = newBlock("then");
+        auto* const elseArm = newBlock("else");
+        builder.CreateCondBr(cond, thenArm, elseArm);
+        builder.SetInsertPoint(thenArm);
+        enter(nullptr, newBlock("if_end"), blockType);
+        ctrlStack.back().elseArm = elseArm;
+        break;
+      }
+
+      case OpCodes::Else: {
+        auto& frame = ctrlStack.back();
+        if (!frame.unreachable) {
+          exitTo(frame);
         }
+        builder.SetInsertPoint(frame.elseArm);
+        frame.elseArm = nullptr;
+        frame.unreachable = false;
+        stack.resize(frame.height);
         break;
       }
 
-      case OpCodes::LocalTee: {
-        uint32_t localIdx = Decoder::decodeVaruint<uint32_t>(pc);
-        if (localIdx < locals.size() && !stack.empty()) {
-          llvm::Value* val = stack.back();  // Keep on stack
-          builder.CreateStore(val, locals[localIdx]);
+      case OpCodes::End: {
+        auto& frame = ctrlStack.back();
+        if (!frame.unreachable) {
+          exitTo(frame);
+        }
+        if (frame.elseArm != nullptr) {
+          // An `If` without the else arm, whose type is empty.
+          builder.SetInsertPoint(frame.elseArm);
+          builder.CreateBr(frame.cont);
         }
+        builder.SetInsertPoint(frame.cont);
+        stack.resize(frame.height);
+        if (frame.result != nullptr) {
+          stack.push_back(frame.result);
+        }
+        ctrlStack.pop_back();
         break;
       }
 
-      case OpCodes::I32Const: {
-        int32_t constVal = Decoder::decodeVarint<int32_t>(pc);
-        stack.push_back(llvm::ConstantInt::get(llvm::Type::getInt32Ty(*context), constVal, true));
+      case OpCodes::Br: {
+        branch(Decoder::decodeVaruint<uint32_t>(pc));
+        ctrlStack.back().unreachable = true;
         break;
       }
 
-      case OpCodes::I32Add: {
-        if (stack.size() >= 2) {
-          llvm::Value* rhs = stack.back(); stack.pop_back();
-          llvm::Value* lhs = stack.back(); stack.pop_back();
-          llvm::Value* result = builder.CreateAdd(lhs, rhs);
-          stack.push_back(result);
-        }
+      case OpCodes::BrIf: {
+        const auto depth = Decoder::decodeVaruint<uint32_t>(pc);
+        auto* const cond = builder.CreateICmpNE(pop(), builder.getInt32(0));
+        // Through a block of its own, so that the continuation sees a single edge from it.
+        auto* const taken = newBlock("br_if");
+        auto* const next = newBlock("br_if_next");
+        builder.CreateCondBr(cond, taken, next);
+        builder.SetInsertPoint(taken);
+        branch(depth);
+        builder.SetInsertPoint(next);
         break;
       }
 
-      case OpCodes::I32Sub: {
-        if (stack.size() >= 2) {
-          llvm::Value* rhs = stack.back(); stack.pop_back();
-          llvm::Value* lhs = stack.back(); stack.pop_back();
-          llvm::Value* result = builder.CreateSub(lhs, rhs);
-          stack.push_back(result);
+      case OpCodes::BrTable: {
+        const auto targetCount = Decoder::decodeVaruint<uint32_t>(pc);
+        std::vector<uint32_t> depths(targetCount + 1);  // Include `default_target`.
+        for (auto& depth : depths) {
+          depth = Decoder::decodeVaruint<uint32_t>(pc);
         }
+        auto* const index = pop();
+        // A block per distinct target, as for `BrIf`.
+        std::vector<llvm::BasicBlock*> targets(ctrlStack.size(), nullptr);
+        auto* const from = builder.GetInsertBlock();
+        const auto targetOf = [&](uint32_t depth) {
+          if (targets.at(depth) == nullptr) {
+            targets[depth] = newBlock("br_table");
+            builder.SetInsertPoint(targets[depth]);
+            branch(depth);
+          }
+          return targets[depth];
+        };
+        auto* const defaultTarget = targetOf(depths.back());
+        builder.SetInsertPoint(from);
+        auto* const switchInst = builder.CreateSwitch(index, defaultTarget, targetCount);
+        for (uint32_t i = 0; i < targetCount; ++i) {
+          switchInst->addCase(builder.getInt32(i), targetOf(depths[i]));
+        }
+        ctrlStack.back().unreachable = true;
         break;
       }
 
-      case OpCodes::I32Mul: {
-        if (stack.size() >= 2) {
-          llvm::Value* rhs = stack.back(); stack.pop_back();
-          llvm::Value* lhs = stack.back(); stack.pop_back();
-          llvm::Value* result = builder.CreateMul(lhs, rhs);
-          stack.push_back(result);
-        }
+      case OpCodes::Return: {
+        branch(ctrlStack.size() - 1);
+        ctrlStack.back().unreachable = true;
         break;
       }
 
-      case OpCodes::I32LtS: {
-        if (stack.size() >= 2) {
-          llvm::Value* rhs = stack.back(); stack.pop_back();
-          llvm::Value* lhs = stack.back(); stack.pop_back();
-          llvm::Value* cmp = builder.CreateICmpSLT(lhs, rhs);
-          llvm::Value* result = builder.CreateZExt(cmp, llvm::Type::getInt32Ty(*context));
+      // Linked directly within the module, including the recursive calls, through the VM otherwise.
+      case OpCodes::Call: {
+        auto* const callee = declare(Decoder::decodeVaruint<uint32_t>(pc));
+        auto* const result = builder.CreateCall(callee, popArgs(callee->getFunctionType()));
+        if (!callee->getReturnType()->isVoidTy()) {
           stack.push_back(result);
         }
         break;
       }
 
-      case OpCodes::I32GtS: {
-        if (stack.size() >= 2) {
-          llvm::Value* rhs = stack.back(); stack.pop_back();
-          llvm::Value* lhs = stack.back(); stack.pop_back();
-          llvm::Value* cmp = builder.CreateICmpSGT(lhs, rhs);
-          llvm::Value* result = builder.CreateZExt(cmp, llvm::Type::getInt32Ty(*context));
+      case OpCodes::CallIndirect: {
+        const auto typeIdx = Decoder::decodeVaruint<uint32_t>(pc);
+        pc++;  // Reserved.
+        auto* const calleeType = createFunctionType(mod.funcTypes.at(typeIdx), context);
+        auto* const elemIdx = builder.CreateZExt(pop(), i64Type);
+        trapIf(builder.CreateICmpUGE(elemIdx, loadContext(offsetof(Runtime::RTJITContext, tableSize), i64Type)),
+          Exception::ErrorType::TBL_ACCESS_OOB);
+        // An entry is the pair of its type and function indices.
+        auto* const table = loadContext(offsetof(Runtime::RTJITContext, table), i32Type->getPointerTo());
+        auto* const entry = builder.CreateInBoundsGEP(i32Type, table, builder.CreateShl(elemIdx, 1));
+        auto* const elemType = builder.CreateLoad(i32Type, entry);
+        auto* const mismatch = newBlock("call_indirect_mismatch");
+        auto* const next = newBlock("call_indirect");
+        builder.CreateCondBr(
+          builder.CreateICmpNE(elemType, builder.getInt32(canonicalTypeIdx(mod, typeIdx))), mismatch, next);
+        builder.SetInsertPoint(mismatch);
+        emitTrap(builder.CreateSelect(
+          builder.CreateICmpEQ(elemType, builder.getInt32(JIT_TABLE_ELEM_UNINITIALIZED)),
+          builder.getInt32(static_cast<uint32_t>(Exception::ErrorType::UNINITIALIZED_TBL_ELEM)),
+          builder.getInt32(static_cast<uint32_t>(Exception::ErrorType::FUNC_TYPE_MISMATCH))));
+        builder.SetInsertPoint(next);
+        auto* const calleeIdx = builder.CreateLoad(i32Type, builder.CreateConstInBoundsGEP1_32(i32Type, entry, 1));
+        auto args = popArgs(calleeType);
+        auto* const result = callThroughVM(builder, ctxArg, calleeIdx, calleeType->getReturnType(),
+          llvm::makeArrayRef(args).drop_front());
+        if (result != nullptr) {
           stack.push_back(result);
         }
         break;
       }
 
-      case OpCodes::I32Eq: {
-        if (stack.size() >= 2) {
-          llvm::Value* rhs = stack.back(); stack.pop_back();
-          llvm::Value* lhs = stack.back(); stack.pop_back();
-          llvm::Value* cmp = builder.CreateICmpEQ(lhs, rhs);
-          llvm::Value* result = builder.CreateZExt(cmp, llvm::Type::getInt32Ty(*context));
-          stack.push_back(result);
+      case OpCodes::Drop: {
+        pop();
+        break;
+      }
+
+      case OpCodes::Select: {
+        auto* const cond = builder.CreateICmpNE(pop(), builder.getInt32(0));
+        auto* const rhs = pop();
+        auto* const lhs = pop();
+        stack.push_back(builder.CreateSelect(cond, lhs, rhs));
+        break;
+      }
+
+      case OpCodes::LocalGet: {
+        uint32_t localIdx = Decoder::decodeVaruint<uint32_t>(pc);
+        llvm::Value* val = builder.CreateLoad(locals[localIdx]->getAllocatedType(), locals[localIdx]);
+        stack.push_back(val);
+        break;
+      }
+
+      case OpCodes::LocalSet: {
+        uint32_t localIdx = Decoder::decodeVaruint<uint32_t>(pc);
+        builder.CreateStore(pop(), locals[localIdx]);
+        break;
+      }
+
+      case OpCodes::LocalTee: {
+        uint32_t localIdx = Decoder::decodeVaruint<uint32_t>(pc);
+        builder.CreateStore(stack.back(), locals[localIdx]);  // Keep on stack
+        break;
+      }
+
+      // Immutable globals have been initialized with constants.
+      case OpCodes::GlobalGet: {
+        const auto idx = Decoder::decodeVaruint<uint32_t>(pc);
+        const auto& globalType = mod.globals.at(idx).globalType;
+        auto* const type = toLLVMType(globalType.valType, context);
+        if (!globalType.mutability) {
+          const auto bitWidth = type->getPrimitiveSizeInBits();
+          stack.push_back(builder.CreateBitCast(
+            builder.getIntN(bitWidth, rtIns->rtGlobals.at(idx).bits & (~uint64_t { 0 } >> (64 - bitWidth))), type));
+        } else {
+          stack.push_back(builder.CreateLoad(type, global(idx)));
         }
         break;
       }
 
-      // For PoC, skip complex control flow (If/Loop/Br) - will just interpret those
-      case OpCodes::If:
-      case OpCodes::Loop:
-      case OpCodes::Block:
-      case OpCodes::Br:
-      case OpCodes::BrIf:
-        // Cannot JIT compile functions with complex control flow yet
-        std::cout << "[JIT] Skipping function " << funcIdx << " - contains unsupported control flow\n";
-        return nullptr;
+      case OpCodes::GlobalSet: {
+        auto* const ptr = global(Decoder::decodeVaruint<uint32_t>(pc));
+        builder.CreateStore(pop(), ptr);
+        break;
+      }
+
+      #define LOWER_LOAD_MEMOP(NAME, VAL_TYPE, MEM_TYPE) \
+        case OpCodes::NAME: \
+          load(toLLVMType<Runtime::VAL_TYPE>(context), toLLVMType<MEM_TYPE>(context), std::is_signed_v<MEM_TYPE>); \
+          break;
+      #define LOWER_STORE_MEMOP(NAME, VAL_TYPE, MEM_TYPE) \
+        case OpCodes::NAME: store(toLLVMType<MEM_TYPE>(context)); break;
+      ITERATE_LOAD_MEMOP(LOWER_LOAD_MEMOP)
+      ITERATE_STORE_MEMOP(LOWER_STORE_MEMOP)
+      #undef LOWER_STORE_MEMOP
+      #undef LOWER_LOAD_MEMOP
+
+      case OpCodes::MemorySize: {
+        pc++;  // Reserved.
+        auto* const bytes = loadContext(offsetof(Runtime::RTJITContext, memBytes), i64Type);
+        stack.push_back(builder.CreateTrunc(builder.CreateUDiv(bytes, builder.getInt64(WASM_PAGE_SIZE_IN_BYTE)), i32Type));
+        break;
+      }
+
+      case OpCodes::MemoryGrow: {
+        pc++;  // Reserved.
+        stack.push_back(builder.CreateCall(memoryGrow, { ctxArg, pop() }));
+        break;
+      }
+
+      case OpCodes::I32Const: {
+        int32_t constVal = Decoder::decodeVarint<int32_t>(pc);
+        stack.push_back(llvm::ConstantInt::get(i32Type, constVal, true));
+        break;
+      }
+
+      case OpCodes::I64Const: {
+        stack.push_back(builder.getInt64(Decoder::decodeVarint<int64_t>(pc)));
+        break;
+      }
+
+      case OpCodes::F32Const:
+      case OpCodes::F64Const: {
+        const auto bitWidth = op == OpCodes::F32Const ? 32 : 64;
+        uint64_t bits = 0;
+        std::memcpy(&bits, pc, bitWidth / 8);  // Little endian.
+        pc += bitWidth / 8;
+        stack.push_back(builder.CreateBitCast(builder.getIntN(bitWidth, bits),
+          op == OpCodes::F32Const ? builder.getFloatTy() : builder.getDoubleTy()));
+        break;
+      }
+
+      case OpCodes::I32Eqz: {
+        stack.push_back(builder.CreateZExt(builder.CreateICmpEQ(pop(), builder.getInt32(0)), i32Type));
+        break;
+      }
+      case OpCodes::I32Eq: compare(llvm::CmpInst::ICMP_EQ); break;
+      case OpCodes::I32Ne: compare(llvm::CmpInst::ICMP_NE); break;
+      case OpCodes::I32LtS: compare(llvm::CmpInst::ICMP_SLT); break;
+      case OpCodes::I32LtU: compare(llvm::CmpInst::ICMP_ULT); break;
+      case OpCodes::I32GtS: compare(llvm::CmpInst::ICMP_SGT); break;
+      case OpCodes::I32GtU: compare(llvm::CmpInst::ICMP_UGT); break;
+      case OpCodes::I32LeS: compare(llvm::CmpInst::ICMP_SLE); break;
+      case OpCodes::I32LeU: compare(llvm::CmpInst::ICMP_ULE); break;
+      case OpCodes::I32GeS: compare(llvm::CmpInst::ICMP_SGE); break;
+      case OpCodes::I32GeU: compare(llvm::CmpInst::ICMP_UGE); break;
+
+      case OpCodes::I32Clz: intrinsic(llvm::Intrinsic::ctlz, { pop(), builder.getFalse() }); break;
+      case OpCodes::I32Ctz: intrinsic(llvm::Intrinsic::cttz, { pop(), builder.getFalse() }); break;
+      case OpCodes::I32Popcnt: intrinsic(llvm::Intrinsic::ctpop, { pop() }); break;
+      case OpCodes::I32Add: binop(llvm::Instruction::Add); break;
+      case OpCodes::I32Sub: binop(llvm::Instruction::Sub); break;
+      case OpCodes::I32Mul: binop(llvm::Instruction::Mul); break;
+      case OpCodes::I32And: binop(llvm::Instruction::And); break;
+      case OpCodes::I32Or: binop(llvm::Instruction::Or); break;
+      case OpCodes::I32Xor: binop(llvm::Instruction::Xor); break;
+      // The shift counts are taken modulo 32, which LLVM leaves undefined past 31.
+      case OpCodes::I32Shl:
+      case OpCodes::I32ShrS:
+      case OpCodes::I32ShrU: {
+        stack.back() = builder.CreateAnd(stack.back(), builder.getInt32(31));
+        binop(op == OpCodes::I32Shl ? llvm::Instruction::Shl :
+          op == OpCodes::I32ShrS ? llvm::Instruction::AShr : llvm::Instruction::LShr);
+        break;
+      }
+      case OpCodes::I32Rotl:
+      case OpCodes::I32Rotr: {
+        auto* const rhs = pop();
+        auto* const lhs = pop();
+        intrinsic(op == OpCodes::I32Rotl ? llvm::Intrinsic::fshl : llvm::Intrinsic::fshr, { lhs, lhs, rhs });
+        break;
+      }
 
       default:
         // Unsupported opcode for JIT - skip this function
-        std::cout << "[JIT] Skipping function " << funcIdx << " - unsupported opcode: "
-                  << static_cast<int>(op) << "\n";
-        return nullptr;
+        llvm::errs() << "[JIT] Skipping function " << funcIdx << " - unsupported opcode: "
+                     << static_cast<int>(op) << "\n";
+        return fail();
     }
   }
 
-  // If we reached natural end without return, add return
-  if (!builder.GetInsertBlock()->getTerminator()) {
-    if (funcType->getReturnType()->isVoidTy()) {
-      builder.CreateRetVoid();
-    } else if (!stack.empty()) {
-      llvm::Value* retVal = stack.back();
-      builder.CreateRet(retVal);
-    } else {
-      builder.CreateRet(llvm::Constant::getNullValue(funcType->getReturnType()));
+  if (osr && loopCount == 0) {
+    if (noLoops != nullptr) {
+      *noLoops = true;
     }
+    return fail();
+  }
+  // The results of every exit meet in the block of the outermost frame.
+  if (osr) {
+    builder.CreateRet(descriptor.funcType->second.empty() ? builder.getInt64(0) : toSlot(builder, stack.back()));
+  } else if (func->getReturnType()->isVoidTy()) {
+    builder.CreateRetVoid();
+  } else {
+    builder.CreateRet(stack.back());
   }
 
   // Verify function
   std::string errorStr;
   llvm::raw_string_ostream errorStream(errorStr);
   if (llvm::verifyFunction(*func, &errorStream)) {
-    std::cerr << "[JIT] Function verification failed: " << errorStr << "\n";
-    return nullptr;
+    llvm::errs() << "[JIT] Function verification failed: " << errorStr << "\n";
+    return fail();
   }
 
   return func;
 }
 
+llvm::Function* JITCompiler::createEntry(uint32_t funcIdx, llvm::Function* func, llvm::Module* module) {
+  auto& context = module->getContext();
+  llvm::IRBuilder<> builder(context);
+  auto* const slotType = builder.getInt64Ty();
+  auto* const entryType = llvm::FunctionType::get(
+    slotType, { builder.getInt8PtrTy(), slotType->getPointerTo() }, false);
+  auto* const entry = llvm::Function::Create(
+    entryType, llvm::Function::ExternalLinkage, "wasm_entry_" + std::to_string(funcIdx), module);
+  auto* const slots = entry->getArg(1);
+  builder.SetInsertPoint(llvm::BasicBlock::Create(context, "entry", entry));
+
+  std::vector<llvm::Value*> args = { entry->getArg(0) };
+  for (auto& param : llvm::drop_begin(func->args())) {
+    args.push_back(loadSlot(builder, slots, args.size() - 1, param.getType()));
+  }
+  auto* const result = builder.CreateCall(func, args);
+  builder.CreateRet(func->getReturnType()->isVoidTy() ? builder.getInt64(0) : toSlot(builder, result));
+  return entry;
+}
+
 bool JITCompiler::compileFunction(uint32_t funcIdx,
                                  Runtime::RTFuncDescriptor& descriptor,
                                  shared_module_runtime_t rtIns) {
@@ -325,49 +1008,157 @@ bool JITCompiler::compileFunction(uint32_t funcIdx,
     initialize();
   }
 
-  std::cout << "[JIT] Compiling function " << funcIdx << " (execution count: "
-            << descriptor.executionCount << ")\n";
-
-  // Create a new module for this function
-  auto module = std::make_unique<llvm::Module>("wasm_jit_module_" + std::to_string(funcIdx), *context);
+  // Create a new module for this function, named after the cache entry of the wasm module if any.
+  auto since = std::chrono::steady_clock::now();
+  const auto& cacheKey = rtIns->module->cached.key;
+  const auto optLevel = rtIns->options.jitOptLevel;
+  const bool guarded = !rtIns->rtMems.empty() && rtIns->rtMems.front().guarded;
+  auto context = std::make_unique<llvm::LLVMContext>();
+  auto module = std::make_unique<llvm::Module>(
+    cacheKey.empty() ? "wasm_jit_module_" + std::to_string(funcIdx) :
+      cacheKey + "-" + std::to_string(funcIdx) + "-O" + std::to_string(static_cast<int>(optLevel)) +
+      (guarded ? "-guarded" : ""),
+    *context);
+  module->setSourceFileName(
+    cacheKey.empty() ? "" : rtIns->options.cacheDir + "/" + module->getModuleIdentifier() + ".o");
+  module->setDataLayout(jit->getDataLayout());
 
   // Translate bytecode to LLVM IR
   llvm::Function* func = translateToIR(funcIdx, descriptor, rtIns, module.get());
   if (!func) {
-    std::cout << "[JIT] Failed to translate function " << funcIdx << " to IR\n";
+    llvm::errs() << "[JIT] Failed to translate function " << funcIdx << " to IR\n";
     return false;
   }
+  createEntry(funcIdx, func, module.get());
+  bool noLoops = false;
+  const bool hasLoops = translateToIR(funcIdx, descriptor, rtIns, module.get(), true, &noLoops) != nullptr;
+  if (!hasLoops && !noLoops) {
+    llvm::errs() << "[JIT] Failed to translate the OSR entry of function " << funcIdx << "\n";
+    return false;
+  }
+  defineThunks(module.get());
+  CompileStats stats { funcIdx, optLevel };
+  stats.translateMs = elapsedMs(since);
+  optimize(*module, optLevel);
+  stats.irInsts = module->getInstructionCount();
+  stats.optimizeMs = elapsedMs(since);
 
-  // Print IR for debugging
-  std::cout << "[JIT] Generated IR for function " << funcIdx << ":\n";
-  func->print(llvm::outs());
-  std::cout << "\n";
-
-  // Add module to JIT
-  auto tsm = llvm::orc::ThreadSafeModule(std::move(module), std::make_unique<llvm::LLVMContext>());
-  auto err = jit->addIRModule(std::move(tsm));
+  // Add module to JIT, the same function of another instance has the same name.
+  auto lib = createLib("wasm_jit_");
+  if (!lib) {
+    llvm::errs() << "[JIT] Failed to create a library: " << llvm::toString(lib.takeError()) << "\n";
+    return false;
+  }
+  auto tsm = llvm::orc::ThreadSafeModule(std::move(module), std::move(context));
+  auto err = jit->addIRModule(*lib, std::move(tsm));
   if (err) {
     llvm::errs() << "[JIT] Failed to add IR module: " << llvm::toString(std::move(err)) << "\n";
     return false;
   }
 
-  // Lookup compiled function
-  std::string funcName = "wasm_func_" + std::to_string(funcIdx);
-  auto symOrErr = jit->lookup(funcName);
+  // Lookup compiled function, through its entry, which compiles the module on this thread.
+  std::string funcName = "wasm_entry_" + std::to_string(funcIdx);
+  auto symOrErr = jit->lookup(*lib, funcName);
   if (!symOrErr) {
     llvm::errs() << "[JIT] Failed to lookup function: " << llvm::toString(symOrErr.takeError()) << "\n";
     return false;
   }
+  stats.codegenMs = elapsedMs(since);
+  stats.codeBytes = lastObject.codeBytes;
+  stats.cached = lastObject.cached;
 
-  // Store compiled function pointer
-  descriptor.jitCompiledPtr = reinterpret_cast<void*>(symOrErr->getValue());
-  descriptor.isJitCompiled = true;
+  if (hasLoops) {
+    auto osrSym = jit->lookup(*lib, "wasm_osr_" + std::to_string(funcIdx));
+    if (!osrSym) {
+      llvm::errs() << "[JIT] Failed to lookup function: " << llvm::toString(osrSym.takeError()) << "\n";
+      return false;
+    }
+    descriptor.osrEntryPtr.store(reinterpret_cast<void*>(osrSym->getValue()), std::memory_order_release);
+  }
 
-  std::cout << "[JIT] Successfully compiled function " << funcIdx << " at address "
-            << descriptor.jitCompiledPtr << "\n";
+  // Published to the executing thread, which switches to it on the next call, or loop iteration.
+  descriptor.jitCompiledPtr.store(reinterpret_cast<void*>(symOrErr->getValue()), std::memory_order_release);
+  std::lock_guard<std::mutex> lock(statsMutex);
+  compiled.push_back(stats);
   return true;
 }
 
+void JITCompiler::schedule(uint32_t funcIdx, shared_module_runtime_t rtIns) {
+  if (!initialize()) {
+    return;
+  }
+  buildTable(*rtIns);  // Read by the executing thread only.
+  const auto threads = rtIns->options.jitThreads;
+  if (threads == 0) {
+    compileFunction(funcIdx, rtIns->rtFuncDescriptor.at(funcIdx), rtIns);
+    return;
+  }
+  // The threads leave once the queue is empty, so that none is left idle, e.g. across a fork.
+  std::lock_guard<std::mutex> lock(queueMutex);
+  queue.push_back({ std::move(rtIns), funcIdx });
+  if (workers < threads) {
+    workers++;
+    std::thread(&JITCompiler::work, this).detach();
+  }
+}
+
+void JITCompiler::drain() {
+  std::unique_lock<std::mutex> lock(queueMutex);
+  idle.wait(lock, [this]() { return workers == 0; });
+}
+
+void JITCompiler::work() {
+  std::unique_lock<std::mutex> lock(queueMutex);
+  while (!queue.empty() && !stopping) {
+    // The function called most so far, its count still grows while it waits.
+    const auto next = std::max_element(queue.begin(), queue.end(), [](const auto& x, const auto& y) {
+      return x.rtIns->rtFuncDescriptor[x.funcIdx].executionCount.load(std::memory_order_relaxed) <
+        y.rtIns->rtFuncDescriptor[y.funcIdx].executionCount.load(std::memory_order_relaxed);
+    });
+    auto task = std::move(*next);
+    queue.erase(next);
+    lock.unlock();
+    compileFunction(task.funcIdx, task.rtIns->rtFuncDescriptor[task.funcIdx], task.rtIns);
+    task.rtIns.reset();  // Which may be the last reference.
+    lock.lock();
+  }
+  workers--;
+  idle.notify_all();
+}
+
+std::vector<JITCompiler::CompileStats> JITCompiler::stats() {
+  std::lock_guard<std::mutex> lock(statsMutex);
+  return compiled;
+}
+
+void JITCompiler::reportStats(std::ostream& os) {
+  const auto records = stats();
+  os << "[twvm] JIT compiled " << records.size() << " functions:\n";
+  os << std::setw(10) << "function" << std::setw(7) << "level" << std::setw(10) << "IR insts"
+    << std::setw(12) << "code bytes" << std::setw(15) << "translate ms" << std::setw(14) << "optimize ms"
+    << std::setw(13) << "codegen ms" << '\n';
+  CompileStats total {};
+  const auto flags = os.flags();
+  const auto precision = os.precision();
+  os << std::fixed << std::setprecision(3);
+  for (const auto& record : records) {
+    os << std::setw(10) << record.funcIdx << std::setw(7) << static_cast<int>(record.optLevel)
+      << std::setw(10) << record.irInsts << std::setw(12) << record.codeBytes
+      << std::setw(15) << record.translateMs << std::setw(14) << record.optimizeMs
+      << std::setw(13) << record.codegenMs << (record.cached ? "  (cached)" : "") << '\n';
+    total.irInsts += record.irInsts;
+    total.codeBytes += record.codeBytes;
+    total.translateMs += record.translateMs;
+    total.optimizeMs += record.optimizeMs;
+    total.codegenMs += record.codegenMs;
+  }
+  os << std::setw(17) << "total" << std::setw(10) << total.irInsts << std::setw(12) << total.codeBytes
+    << std::setw(15) << total.translateMs << std::setw(14) << total.optimizeMs
+    << std::setw(13) << total.codegenMs << '\n';
+  os.flags(flags);
+  os.precision(precision);
+}
+
 void* JITCompiler::lookupCompiledFunction(const std::string& funcName) {
   if (!jitInitialized) {
     return nullptr;
@@ -382,4 +1173,118 @@ void* JITCompiler::lookupCompiledFunction(const std::string& funcName) {
   return reinterpret_cast<void*>(symOrErr->getValue());
 }
 
+std::optional<uint32_t> JITCompiler::compileModule(shared_module_runtime_t rtIns, const std::string& path) {
+  if (!initialize()) {
+    return std::nullopt;
+  }
+  auto jtmb = llvm::orc::JITTargetMachineBuilder::detectHost();
+  if (!jtmb) {
+    llvm::errs() << "[JIT] Failed to detect the host: " << llvm::toString(jtmb.takeError()) << "\n";
+    return std::nullopt;
+  }
+  jtmb->setRelocationModel(llvm::Reloc::PIC_);
+  auto tm = jtmb->createTargetMachine();
+  if (!tm) {
+    llvm::errs() << "[JIT] Failed to create the target machine: " << llvm::toString(tm.takeError()) << "\n";
+    return std::nullopt;
+  }
+  llvm::LLVMContext context;
+  auto module = std::make_unique<llvm::Module>("wasm_aot_module", context);
+  module->setDataLayout((*tm)->createDataLayout());
+  module->setTargetTriple((*tm)->getTargetTriple().str());
+
+  // Internal, only reached through the table.
+  auto* const ptrType = llvm::Type::getInt8PtrTy(context);
+  std::vector<llvm::Constant*> funcs;
+  uint32_t compiled = 0;
+  for (uint32_t i = 0; i < rtIns->rtFuncDescriptor.size(); ++i) {
+    const auto& descriptor = rtIns->rtFuncDescriptor[i];
+    auto* func = translateToIR(i, descriptor, rtIns, module.get());
+    if (func == nullptr) {
+      // Still called by the others, through the VM.
+      if (auto* partial = module->getFunction(funcSymbol(i))) {
+        partial->deleteBody();
+      }
+      funcs.push_back(llvm::ConstantPointerNull::get(ptrType));
+      continue;
+    }
+    func->setLinkage(llvm::Function::InternalLinkage);
+    auto* const entry = createEntry(i, func, module.get());
+    entry->setLinkage(llvm::Function::InternalLinkage);
+    funcs.push_back(llvm::ConstantExpr::getBitCast(entry, ptrType));
+    compiled++;
+  }
+  defineThunks(module.get());
+  optimize(*module, rtIns->options.jitOptLevel);
+  auto* const tableType = llvm::ArrayType::get(ptrType, funcs.size());
+  new llvm::GlobalVariable(*module, tableType, true, llvm::GlobalValue::ExternalLinkage,
+    llvm::ConstantArray::get(tableType, funcs), AOT_FUNCS_SYMBOL);
+  auto* const key = llvm::ConstantDataArray::getString(context, artifactKey(*rtIns));
+  new llvm::GlobalVariable(*module, key->getType(), true, llvm::GlobalValue::ExternalLinkage, key, AOT_KEY_SYMBOL);
+
+  llvm::SmallVector<char, 0> object;
+  llvm::raw_svector_ostream out(object);
+  llvm::legacy::PassManager passes;
+  if ((*tm)->addPassesToEmitFile(passes, out, nullptr, llvm::CGFT_ObjectFile)) {
+    llvm::errs() << "[JIT] The target machine cannot emit object files\n";
+    return std::nullopt;
+  }
+  passes.run(*module);
+  if (!CodeCache::writeFile(path, reinterpret_cast<const uint8_t*>(object.data()), object.size())) {
+    return std::nullopt;
+  }
+  return compiled;
+}
+
+bool JITCompiler::loadModule(shared_module_runtime_t rtIns, const std::string& path) {
+  if (!initialize()) {
+    return false;
+  }
+  auto buffer = llvm::MemoryBuffer::getFile(path, false, false);
+  if (!buffer) {
+    return false;
+  }
+  auto lib = createLib("wasm_aot_");
+  if (!lib) {
+    llvm::consumeError(lib.takeError());
+    return false;
+  }
+  if (auto err = jit->addObjectFile(*lib, std::move(*buffer))) {
+    llvm::consumeError(std::move(err));
+    return false;
+  }
+  auto keySym = jit->lookup(*lib, AOT_KEY_SYMBOL);
+  if (!keySym) {
+    llvm::consumeError(keySym.takeError());
+    return false;
+  }
+  const auto key = artifactKey(*rtIns);
+  if (std::strcmp(reinterpret_cast<const char*>(keySym->getValue()), key.c_str()) != 0) {
+    return false;
+  }
+  auto funcsSym = jit->lookup(*lib, AOT_FUNCS_SYMBOL);
+  if (!funcsSym) {
+    llvm::consumeError(funcsSym.takeError());
+    return false;
+  }
+  // The module matches, so the table has an entry per function.
+  auto* const funcs = reinterpret_cast<void* const*>(funcsSym->getValue());
+  auto& descriptors = rtIns->rtFuncDescriptor;
+  for (size_t i = 0; i < descriptors.size(); ++i) {
+    if (funcs[i] != nullptr) {
+      descriptors[i].jitCompiledPtr.store(funcs[i], std::memory_order_release);
+    }
+  }
+  buildTable(*rtIns);
+  return true;
+}
+
+llvm::Expected<llvm::orc::JITDylib&> JITCompiler::createLib(const std::string& prefix) {
+  auto lib = jit->createJITDylib(prefix + std::to_string(libCount++));
+  if (lib) {
+    lib->addToLinkOrder(jit->getMainJITDylib());  // For the runtime symbols.
+  }
+  return lib;
+}
+
 }  // namespace TWVM
@@ -1,14 +1,18 @@
 // Copyright 2020 YHSPY. All rights reserved.
+#include <algorithm>
 #include <fstream>
 #include <iostream>
-#include <thread>
+#include <iterator>
 #include <utility>
 #include "lib/include/constants.hh"
 #include "lib/include/loader.hh"
+#include "lib/include/code_cache.hh"
 #include "lib/include/decoder.hh"
 #include "lib/include/util.hh"
 #include "lib/include/exception.hh"
 #include "lib/include/opcodes.hh"
+#include "lib/include/validator.hh"
+#include "lib/include/virtual_mem.hh"
 
 namespace TWVM {
 
@@ -64,38 +68,47 @@ void Loader::walkExtMeta(Reader& reader, Module::external_kind_t& extMetaRef, ui
   }
 }
 
-shared_module_t Loader::load(const std::string& fileName) {
-  std::ifstream in {fileName, std::ifstream::binary};
+shared_module_t Loader::load(const std::string& fileName, const EngineOptions& options) {
   auto wasmModule = std::make_shared<Module>();
-  if (in.is_open() && in.good()) {
-    preamble(in, wasmModule);
-#if defined(OPT_PAR_LOADING)
-    // TODO(Jason Yu): loading with multi-threading.
-#else
-    // Loading within the current thread.
-    while (!in.eof()) {
-      Loader::parse(in, wasmModule);
+  auto& source = wasmModule->source;
+  source.ptr = VirtualMem::mapFile(fileName, source.size);
+  source.mapped = source.ptr != nullptr;
+  if (!source.mapped) {
+    // Read in one go where the file can not be mapped, e.g. an empty file or a pipe.
+    std::ifstream in {fileName, std::ifstream::binary};
+    if (!in.is_open() || !in.good()) {
+      Exception::terminate(Exception::ErrorType::BAD_FSTREAM);
     }
-    in.close();
-#endif
-  } else {
-    Exception::terminate(Exception::ErrorType::BAD_FSTREAM);
+    source.buffer.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    source.ptr = source.buffer.data();
+    source.size = source.buffer.size();
   }
+  ByteSpan in { source.ptr, source.size };
+  preamble(in, wasmModule);
+  // Sections are walked in order, which only records the span of each function body. The
+  // bodies are then decoded by the validation and translation of each function, in parallel.
+  while (!in.empty()) {
+    Loader::parse(in, wasmModule, in.data() - source.ptr);
+  }
+  if (!options.cacheDir.empty() && CodeCache::lookup(*wasmModule, options)) {
+    return wasmModule;  // Validated before it was cached.
+  }
+  Validator::validate(wasmModule, options);
   return wasmModule;
 }
 
-void Loader::parse(std::ifstream& in, shared_module_t mod) {
-  auto reader = Reader(in, mod);
+void Loader::parse(ByteSpan& in, shared_module_t mod, size_t startPos) {
+  auto reader = Reader(in, mod, startPos);
   const auto sectionId = reader.currentSectionId();
   if (sectionId >= 0) {
     handlers.at(sectionId)(reader, mod);
   }
 }
 
-void Loader::preamble(std::ifstream& in, shared_module_t mod) {
-  auto reader = Reader(in, mod);
+void Loader::preamble(ByteSpan& in, shared_module_t mod) {
+  auto reader = Reader(in, mod, 0);
   constexpr size_t totalHeaderBytes = MAGIC_BYTES_COUNT + VER_BYTES_COUNT;
-  auto v = reader.retrieveBytes(totalHeaderBytes);
+  const auto v = reader.retrieveBytes(std::min(in.size(), totalHeaderBytes));
   const auto vSize = v.size();
 
   // Incomplete magic bytes.
@@ -103,7 +116,7 @@ void Loader::preamble(std::ifstream& in, shared_module_t mod) {
     Exception::terminate(Exception::ErrorType::INVALID_MAGIC_CODE);
 
   // Validate magic code.
-  auto parsedMagic = *reinterpret_cast<uint32_t*>(v.data());
+  auto parsedMagic = *reinterpret_cast<const uint32_t*>(v.data());
   if (parsedMagic != VALID_MAGIC) {
     Exception::terminate(Exception::ErrorType::INVALID_MAGIC_CODE, reader.pos());
   }
@@ -113,7 +126,7 @@ void Loader::preamble(std::ifstream& in, shared_module_t mod) {
     Exception::terminate(Exception::ErrorType::INVALID_VER_NUM);
 
   // Validate version code.
-  auto parsedVersion = *reinterpret_cast<uint32_t*>(v.data() + MAGIC_BYTES_COUNT);
+  auto parsedVersion = *reinterpret_cast<const uint32_t*>(v.data() + MAGIC_BYTES_COUNT);
   if (parsedVersion != VALID_VERSION) {
     Exception::terminate(Exception::ErrorType::INVALID_VER_NUM, reader.pos());
   }
@@ -179,9 +192,7 @@ void Loader::parseExportSection(Reader& reader, shared_module_t mod) {
 void Loader::parseFunctionSection(Reader& reader, shared_module_t mod) {
   [[maybe_unused]] const auto sectionSize = reader.walkU32();
   const auto funcIndexCount = reader.walkU32();
-  for (uint32_t i = 0; i < funcIndexCount; ++i) {
-    mod->funcTypesIndices.push_back(reader.walkU32());
-  }
+  reader.walkU32s(mod->funcTypesIndices, funcIndexCount);
 }
 
 void Loader::parseTableSection(Reader& reader, shared_module_t mod) {
@@ -212,6 +223,7 @@ void Loader::parseMemorySection(Reader& reader, shared_module_t mod) {
 }
 
 void Loader::parseStartSection(Reader& reader, shared_module_t mod) {
+  [[maybe_unused]] const auto sectionSize = reader.walkU32();
   mod->startFuncIdx = reader.walkU32();
 }
 
@@ -230,20 +242,24 @@ void Loader::parseCodeSection(Reader& reader, shared_module_t mod) {
   [[maybe_unused]] const auto sectionSize = reader.walkU32();
   const auto funcDefCount = reader.walkU32();
   for (uint32_t i = 0; i < funcDefCount; ++i) {
-    const auto bodySize = reader.walkU32();
-    const auto startPos = reader.pos();
-    const auto locCount = reader.walkU32();
-    std::vector<uint8_t> locVarTypeVec = {};
-    for (uint32_t j = 0; j < locCount; ++j) {
-      const auto locVarCount = reader.walkU32();
-      const auto locVarType = reader.walkByte();
-      locVarTypeVec.insert(locVarTypeVec.end(), locVarCount, locVarType);
-    }
-    auto body = reader.retrieveBytes(bodySize - (reader.pos() - startPos));
-    mod->funcDefs.emplace_back(locVarTypeVec, body);
+    parseFuncDef(reader, mod);
   }
 }
 
+void Loader::parseFuncDef(Reader& reader, shared_module_t mod) {
+  const auto bodySize = reader.walkU32();
+  const auto startPos = reader.pos();
+  const auto locCount = reader.walkU32();
+  std::vector<uint8_t> locVarTypeVec = {};
+  for (uint32_t j = 0; j < locCount; ++j) {
+    const auto locVarCount = reader.walkU32();
+    const auto locVarType = reader.walkByte();
+    locVarTypeVec.insert(locVarTypeVec.end(), locVarCount, locVarType);
+  }
+  const auto body = reader.retrieveBytes(bodySize - (reader.pos() - startPos));
+  mod->funcDefs.emplace_back(locVarTypeVec, body);
+}
+
 void Loader::parseElementSection(Reader& reader, shared_module_t mod) {
   [[maybe_unused]] const auto sectionSize = reader.walkU32();
   const auto elemSegCount = reader.walkU32();
@@ -252,9 +268,7 @@ void Loader::parseElementSection(Reader& reader, shared_module_t mod) {
     auto initExprOps = reader.getBytesTillDelim(Util::asInteger(OpCodes::End));
     const auto funcIndicesCount = reader.walkU32();
     std::vector<uint32_t> funcIndices = {};
-    for (uint32_t j = 0; j < funcIndicesCount; ++j) {
-      funcIndices.push_back(reader.walkU32());
-    }
+    reader.walkU32s(funcIndices, funcIndicesCount);
     mod->elements.emplace_back(tblIdx, initExprOps, funcIndices);
   }
 }
@@ -266,7 +280,7 @@ void Loader::parseDataSection(Reader& reader, shared_module_t mod) {
     const auto memIdx = reader.walkU32();
     auto initExprOps = reader.getBytesTillDelim(Util::asInteger(OpCodes::End));
     const auto size = reader.walkU32();
-    auto data = reader.retrieveBytes(size);
+    const auto data = reader.retrieveBytes(size);
     mod->data.emplace_back(memIdx, initExprOps, data);
   }
 }
@@ -0,0 +1,34 @@
+// Copyright 2021 YHSPY. All rights reserved.
+#include <array>
+#include <algorithm>
+#include <iomanip>
+#include <utility>
+#include <vector>
+#include "lib/include/opcode_stats.hh"
+
+#define DECLARE_OPCODE_NAME(NAME, OP, _) \
+  names[OP] = #NAME;
+
+namespace TWVM {
+
+void OpcodeStats::report(std::ostream& os, size_t limit) const {
+  static const auto opNames = []() {
+    std::array<const char*, 1 << 8> names = {};
+    ITERATE_ALL_OPCODE(DECLARE_OPCODE_NAME)
+    return names;
+  }();
+  for (size_t len = 2; len <= n; ++len) {
+    std::vector<std::pair<uint64_t, size_t>> sorted(counts[len].begin(), counts[len].end());
+    std::sort(sorted.begin(), sorted.end(), [](auto& x, auto& y) { return x.second > y.second; });
+    os << "[twvm] Top " << len << "-grams:\n";
+    for (size_t i = 0; i < std::min(limit, sorted.size()); ++i) {
+      os << std::setw(14) << sorted[i].second << ' ';
+      for (size_t k = len; k > 0; --k) {
+        os << ' ' << opNames[(sorted[i].first >> ((k - 1) * 8)) & 0xff];
+      }
+      os << '\n';
+    }
+  }
+}
+
+}  // namespace TWVM
@@ -9,7 +9,7 @@ void Options::parse(int argc, const char* argv[]) {
   for (size_t i = 1; i < argc; ++i) {
     const auto arg = argv[i];
     auto cmd = std::string_view(arg);
-    if (cmd.at(0) == '-') {
+    if (cmd.size() > 1 && cmd.at(0) == '-') {  // A lone "-" is stdin.
       const auto equal = cmd.find_first_of('=');
       const auto _cb = [&](const std::string& key, const std::optional<const char*> val) {
         const auto& op = commands.find(key);
@@ -3,14 +3,11 @@
 
 namespace TWVM {
 
-std::vector<uint8_t> Reader::retrieveBytes(size_t n) {
-  std::vector<char> arr(n);
-  std::vector<uint8_t> v = {};
-  in.read(arr.data(), n);
-  for (auto i = 0; i < n; ++i) {
-    v.emplace_back(static_cast<uint8_t>(arr[i]));
-  }
-  return v;
+ByteSpan Reader::retrieveBytes(size_t n) {
+  require(n);
+  const ByteSpan bytes { in.data(), n };
+  in.removePrefix(n);
+  return bytes;
 }
 std::vector<uint8_t> Reader::getBytesTillDelim(uint8_t delim) {
   std::vector<uint8_t> v;
@@ -0,0 +1,249 @@
+// Copyright 2021 YHSPY. All rights reserved.
+#include <algorithm>
+#include <cstring>
+#include <vector>
+#include "lib/include/reg_interpreter.hh"
+#include "lib/include/reg_translator.hh"
+#include "lib/include/kernels.hh"
+#include "lib/include/executor.hh"
+#include "lib/include/instantiator.hh"
+#include "lib/include/interpreter.hh"
+#include "lib/include/exception.hh"
+#include "lib/include/constants.hh"
+
+#define CONCAT_PREFIX(X) Runtime:: X
+#define REG(N) fp[pc[N].as<uint32_t>()]
+#define IMME(T, N) pc[N].as<T>()
+#define REF_REG_HANDLER_LABEL(NAME, ...) &&op_##NAME,
+#if defined(__GNUC__) || defined(__clang__)
+#define REG_HANDLER(NAME) op_##NAME
+#define REG_DISPATCH(N) do { \
+    pc += (N); \
+    goto *dispatchTable[pc->as<uint32_t>()]; \
+  } while (0)
+#else
+#define REG_HANDLER(NAME) case RegOpCodes::NAME
+#define REG_DISPATCH(N) do { \
+    pc += (N); \
+    goto dispatch; \
+  } while (0)
+#endif
+// A taken branch carries its offset relative to the slot at `N`.
+#define REG_JUMP(N) do { \
+    pc += (N) + IMME(int32_t, N); \
+    REG_DISPATCH(0); \
+  } while (0)
+#define REG_RETURN() do { \
+    const auto frame = frames.back(); \
+    frames.pop_back(); \
+    if (!frame.cont) { \
+      return; \
+    } \
+    pc = frame.cont; \
+    fp = frame.fp; \
+    REG_DISPATCH(0); \
+  } while (0)
+// The callee compiled by the JIT, or loaded with `--aot`, takes the arguments in its frame, and
+// leaves the result in the first slot as on returning.
+#define REG_CALL_NATIVE(FUNC_IDX, CALLEE_FP, N) do { \
+    if (auto* const nativeEntry = Interpreter::prepareCall(executor, (FUNC_IDX))) { \
+      (CALLEE_FP)[0] = Runtime::RTValue::from(Interpreter::callNative(executor, nativeEntry, (CALLEE_FP))); \
+      REG_DISPATCH(N); \
+    } \
+  } while (0)
+#define REG_SIMPLE_BINOP_HANDLER(NAME, VAL_TYPE, RET_TYPE, OP_CAST_TYPE, OP) \
+  REG_HANDLER(NAME): \
+    REG(1) = Runtime::RTValue::from(static_cast<CONCAT_PREFIX(RET_TYPE)>( \
+      static_cast<CONCAT_PREFIX(OP_CAST_TYPE)>(REG(2).as<CONCAT_PREFIX(VAL_TYPE)>()) OP \
+      static_cast<CONCAT_PREFIX(OP_CAST_TYPE)>(REG(3).as<CONCAT_PREFIX(VAL_TYPE)>()))); \
+    REG_DISPATCH(4);
+#define REG_BINOP_HANDLER(NAME, VAL_TYPE, RET_TYPE, KERNEL) \
+  REG_HANDLER(NAME): \
+    REG(1) = Runtime::RTValue::from(static_cast<CONCAT_PREFIX(RET_TYPE)>( \
+      Kernels::KERNEL(REG(2).as<CONCAT_PREFIX(VAL_TYPE)>(), REG(3).as<CONCAT_PREFIX(VAL_TYPE)>()))); \
+    REG_DISPATCH(4);
+#define REG_UNOP_HANDLER(NAME, PARAM_TYPE, RET_TYPE, KERNEL) \
+  REG_HANDLER(NAME): \
+    REG(1) = Runtime::RTValue::from(static_cast<CONCAT_PREFIX(RET_TYPE)>( \
+      Kernels::KERNEL(REG(2).as<CONCAT_PREFIX(PARAM_TYPE)>()))); \
+    REG_DISPATCH(3);
+#define REG_LOAD_HANDLER(NAME, VAL_TYPE, MEM_TYPE) \
+  REG_HANDLER(NAME): { \
+    const auto& mem = rt->rtMems.front(); \
+    const auto ea = static_cast<uint64_t>(REG(2).as<uint32_t>()) + IMME(uint32_t, 3); \
+    if (ea + sizeof(MEM_TYPE) > mem.size * WASM_PAGE_SIZE_IN_BYTE) { \
+      Exception::terminate(Exception::ErrorType::MEM_ACCESS_OOB); \
+    } \
+    MEM_TYPE v; \
+    std::memcpy(&v, mem.ptr + ea, sizeof(MEM_TYPE)); \
+    REG(1) = Runtime::RTValue::from(static_cast<CONCAT_PREFIX(VAL_TYPE)>(v)); \
+    REG_DISPATCH(4); \
+  }
+#define REG_STORE_HANDLER(NAME, VAL_TYPE, MEM_TYPE) \
+  REG_HANDLER(NAME): { \
+    const auto& mem = rt->rtMems.front(); \
+    const auto ea = static_cast<uint64_t>(REG(1).as<uint32_t>()) + IMME(uint32_t, 3); \
+    if (ea + sizeof(MEM_TYPE) > mem.size * WASM_PAGE_SIZE_IN_BYTE) { \
+      Exception::terminate(Exception::ErrorType::MEM_ACCESS_OOB); \
+    } \
+    const auto v = static_cast<MEM_TYPE>(REG(2).as<CONCAT_PREFIX(VAL_TYPE)>()); \
+    std::memcpy(mem.ptr + ea, &v, sizeof(MEM_TYPE)); \
+    REG_DISPATCH(4); \
+  }
+
+namespace TWVM {
+
+const Runtime::RTCodeSlot* RegInterpreter::enterFrame(
+  Runtime& rt, uint32_t funcIdx, Runtime::RTValue* fp, const Runtime::RTValue* end) {
+  const auto& descriptor = rt.rtFuncDescriptor[funcIdx];
+  if (descriptor.codeEntry == nullptr) {
+    Instantiator::translateLazily(rt, funcIdx);  // Fills `descriptor` in place.
+  }
+  if (fp + descriptor.regFrameSize > end) {
+    Exception::terminate(Exception::ErrorType::STACK_OVERFLOW);
+  }
+  // Arguments are already in place, the remaining locals are zeroed and constants copied in.
+  const auto paramCount = descriptor.funcType->first.size();
+  const auto localCount = descriptor.localsDefault.size();
+  std::fill(fp + paramCount, fp + localCount, Runtime::RTValue {});
+  std::copy(descriptor.regConsts.begin(), descriptor.regConsts.end(), fp + localCount);
+  return descriptor.regCode.data();
+}
+
+void RegInterpreter::execute(Executor& executor, uint32_t funcIdx) {
+  const auto rt = executor.getEngineData().get();
+  if (rt->regStack.empty()) {
+    rt->regStack.resize(REG_STACK_SLOTS);
+  }
+  const auto* const stackEnd = rt->regStack.data() + rt->regStack.size();
+  auto* const globals = rt->rtGlobals.data();
+  const auto& funcs = rt->rtFuncDescriptor;
+  std::vector<CallFrame> frames = { { nullptr, nullptr } };  // Returning to the driver.
+  auto* fp = rt->regStack.data();
+  // Entry arguments have been pushed onto the operand stack by the instantiator.
+  auto& args = rt->stack;
+  const auto paramCount = funcs.at(funcIdx).funcType->first.size();
+  std::copy(args.end() - paramCount, args.end(), fp);
+  args.resize(args.size() - paramCount);
+  if (auto* const nativeEntry = Interpreter::prepareCall(executor, funcIdx)) {
+    fp[0] = Runtime::RTValue::from(Interpreter::callNative(executor, nativeEntry, fp));
+    return;
+  }
+  const auto* pc = enterFrame(*rt, funcIdx, fp, stackEnd);
+
+#if defined(__GNUC__) || defined(__clang__)
+  static void* const dispatchTable[] = {
+    ITERATE_REG_CONTROL_OPCODE(REF_REG_HANDLER_LABEL)
+    ITERATE_SIMPLE_BINOP(REF_REG_HANDLER_LABEL)
+    ITERATE_BINOP(REF_REG_HANDLER_LABEL)
+    ITERATE_UNOP(REF_REG_HANDLER_LABEL)
+    ITERATE_TRUNCOP(REF_REG_HANDLER_LABEL)
+    ITERATE_CONVERTOP(REF_REG_HANDLER_LABEL)
+    ITERATE_REINTERPRETOP(REF_REG_HANDLER_LABEL)
+    ITERATE_LOAD_MEMOP(REF_REG_HANDLER_LABEL)
+    ITERATE_STORE_MEMOP(REF_REG_HANDLER_LABEL)
+  };
+  static_assert(sizeof(dispatchTable) / sizeof(void*) == static_cast<size_t>(RegOpCodes::Count));
+  REG_DISPATCH(0);
+#else
+  #warning "Computed goto not supported by this compiler, falling back to slower dispatch"
+dispatch:
+  switch (static_cast<RegOpCodes>(pc->as<uint32_t>())) {
+#endif
+
+  REG_HANDLER(Unreachable):
+    Exception::terminate(Exception::ErrorType::UNREACHABLE);
+
+  REG_HANDLER(Br):
+    REG_JUMP(1);
+
+  REG_HANDLER(BrIfEqz):
+    if (REG(1).as<Runtime::rt_i32_t>() == 0) {
+      REG_JUMP(2);
+    }
+    REG_DISPATCH(3);
+
+  REG_HANDLER(BrIfNez):
+    if (REG(1).as<Runtime::rt_i32_t>() != 0) {
+      REG_JUMP(2);
+    }
+    REG_DISPATCH(3);
+
+  REG_HANDLER(BrTable):
+    REG_JUMP(3 + std::min(REG(1).as<uint32_t>(), IMME(uint32_t, 2)));
+
+  REG_HANDLER(Return):
+    fp[0] = REG(1);
+    REG_RETURN();
+
+  REG_HANDLER(ReturnVoid):
+    REG_RETURN();
+
+  REG_HANDLER(Call): {
+    auto* calleeFp = &REG(2);
+    REG_CALL_NATIVE(IMME(uint32_t, 1), calleeFp, 3);
+    frames.push_back({ pc + 3, fp });
+    pc = enterFrame(*rt, IMME(uint32_t, 1), calleeFp, stackEnd);
+    fp = calleeFp;
+    REG_DISPATCH(0);
+  }
+
+  REG_HANDLER(CallIndirect): {
+    const auto& defaultTable = rt->rtTables.front();  // Restricted to only 1 table in MVP.
+    const auto elemIdx = REG(2).as<uint32_t>();
+    if (elemIdx >= defaultTable.size()) {
+      Exception::terminate(Exception::ErrorType::TBL_ACCESS_OOB);
+    }
+    const auto calleeIdx = defaultTable[elemIdx];
+    if (!calleeIdx.has_value()) {
+      Exception::terminate(Exception::ErrorType::UNINITIALIZED_TBL_ELEM);
+    }
+    executor.validateTypeWithFuncIdx(rt->module->funcTypes[IMME(uint32_t, 1)], *calleeIdx);  // May throw.
+    auto* calleeFp = &REG(3);
+    REG_CALL_NATIVE(*calleeIdx, calleeFp, 4);
+    frames.push_back({ pc + 4, fp });
+    pc = enterFrame(*rt, *calleeIdx, calleeFp, stackEnd);
+    fp = calleeFp;
+    REG_DISPATCH(0);
+  }
+
+  REG_HANDLER(Mov):
+    REG(1) = REG(2);
+    REG_DISPATCH(3);
+
+  REG_HANDLER(Select):
+    REG(1) = REG(4).as<Runtime::rt_i32_t>() != 0 ? REG(2) : REG(3);
+    REG_DISPATCH(5);
+
+  REG_HANDLER(GlobalGet):
+    REG(1) = globals[IMME(uint32_t, 2)];
+    REG_DISPATCH(3);
+
+  REG_HANDLER(GlobalSet):
+    globals[IMME(uint32_t, 1)] = REG(2);
+    REG_DISPATCH(3);
+
+  REG_HANDLER(MemorySize):
+    REG(1) = Runtime::RTValue::from(static_cast<Runtime::rt_i32_t>(rt->rtMems.front().size));
+    REG_DISPATCH(2);
+
+  REG_HANDLER(MemoryGrow):
+    REG(1) = Runtime::RTValue::from(static_cast<Runtime::rt_i32_t>(executor.resizeMem(REG(2).as<uint32_t>())));
+    REG_DISPATCH(3);
+
+  ITERATE_SIMPLE_BINOP(REG_SIMPLE_BINOP_HANDLER)
+  ITERATE_BINOP(REG_BINOP_HANDLER)
+  ITERATE_UNOP(REG_UNOP_HANDLER)
+  ITERATE_TRUNCOP(REG_UNOP_HANDLER)
+  ITERATE_CONVERTOP(REG_UNOP_HANDLER)
+  ITERATE_REINTERPRETOP(REG_UNOP_HANDLER)
+  ITERATE_LOAD_MEMOP(REG_LOAD_HANDLER)
+  ITERATE_STORE_MEMOP(REG_STORE_HANDLER)
+
+#if !(defined(__GNUC__) || defined(__clang__))
+    default: Exception::terminate(Exception::ErrorType::INVALID_OPCODE);
+  }
+#endif
+}
+
+}  // namespace TWVM
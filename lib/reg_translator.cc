@@ -0,0 +1,465 @@
+// Copyright 2021 YHSPY. All rights reserved.
+#include "lib/include/reg_translator.hh"
+#include "lib/include/opcodes.hh"
+#include "lib/include/exception.hh"
+
+// Slot references are tagged until the layout of the frame is known.
+#define REG_CONST_TAG (1u << 30)
+#define REG_TEMP_TAG (1u << 31)
+#define REG_CANON(HEIGHT) (REG_TEMP_TAG | static_cast<uint32_t>(HEIGHT))
+
+namespace TWVM {
+
+void RegTranslator::emitOp(FuncState& s, RegOpCodes op) {
+  s.code.push_back(Runtime::RTCodeSlot::from(static_cast<uint32_t>(op)));
+  s.lastDstSlot.reset();
+}
+void RegTranslator::emitReg(FuncState& s, uint32_t reg) {
+  s.regSlots.push_back(s.code.size());
+  s.code.push_back(Runtime::RTCodeSlot::from(reg));
+}
+void RegTranslator::emitDst(FuncState& s) {
+  const auto reg = REG_CANON(s.opds.size());
+  s.opds.push_back(reg);
+  s.lastDstSlot = s.code.size();
+  emitReg(s, reg);
+}
+size_t RegTranslator::emitTarget(FuncState& s) {
+  s.code.emplace_back();
+  return s.code.size() - 1;
+}
+void RegTranslator::patchTarget(FuncState& s, size_t slotIdx, size_t targetIdx) {
+  // Relative to the slot itself, as the stack-machine stream does.
+  s.code.at(slotIdx) = Runtime::RTCodeSlot::from(static_cast<int32_t>(targetIdx - slotIdx));
+}
+uint32_t RegTranslator::popOpd(FuncState& s) {
+  const auto reg = s.opds.back();
+  s.opds.pop_back();
+  return reg;
+}
+uint32_t RegTranslator::refConst(FuncState& s, Runtime::RTValue v) {
+  const auto it = s.constIndices.find(v.bits);
+  if (it != s.constIndices.end()) {
+    return REG_CONST_TAG | it->second;
+  }
+  const auto idx = static_cast<uint32_t>(s.descriptor.regConsts.size());
+  s.descriptor.regConsts.push_back(v);
+  s.constIndices[v.bits] = idx;
+  return REG_CONST_TAG | idx;
+}
+void RegTranslator::spill(FuncState& s, size_t from, bool withConsts) {
+  for (auto i = from; i < s.opds.size(); ++i) {
+    const auto reg = s.opds[i];
+    if (reg != REG_CANON(i) && (withConsts || !(reg & REG_CONST_TAG))) {
+      emitOp(s, RegOpCodes::Mov);
+      emitReg(s, REG_CANON(i));
+      emitReg(s, reg);
+      s.opds[i] = REG_CANON(i);
+    }
+  }
+}
+void RegTranslator::assignLocal(FuncState& s, uint32_t localIdx, uint32_t src) {
+  // Pending reads of the old value must not observe the new one.
+  for (size_t i = 0; i < s.opds.size(); ++i) {
+    if (s.opds[i] == localIdx) {
+      emitOp(s, RegOpCodes::Mov);
+      emitReg(s, REG_CANON(i));
+      emitReg(s, localIdx);
+      s.opds[i] = REG_CANON(i);
+    }
+  }
+  if (src == localIdx) {
+    return;
+  }
+  if (s.lastDstSlot.has_value() && s.code[*s.lastDstSlot].as<uint32_t>() == src) {
+    // The producer writes the local directly.
+    s.code[*s.lastDstSlot] = Runtime::RTCodeSlot::from(localIdx);
+    s.lastDstSlot.reset();
+  } else {
+    emitOp(s, RegOpCodes::Mov);
+    emitReg(s, localIdx);
+    emitReg(s, src);
+  }
+}
+void RegTranslator::moveResult(FuncState& s, const CtrlFrame& label, uint32_t arity) {
+  if (arity > 0 && s.opds.back() != REG_CANON(label.height)) {
+    emitOp(s, RegOpCodes::Mov);
+    emitReg(s, REG_CANON(label.height));
+    emitReg(s, s.opds.back());
+  }
+}
+void RegTranslator::emitReturn(FuncState& s) {
+  if (s.descriptor.funcType->second.size() > 0) {
+    emitOp(s, RegOpCodes::Return);
+    emitReg(s, s.opds.back());
+  } else {
+    emitOp(s, RegOpCodes::ReturnVoid);
+  }
+}
+void RegTranslator::emitBranch(FuncState& s, uint32_t depth) {
+  if (depth + 1 == s.ctrls.size()) {
+    emitReturn(s);  // To the function level.
+    return;
+  }
+  auto& label = *(s.ctrls.rbegin() + depth);
+  moveResult(s, label, label.arity);
+  emitOp(s, RegOpCodes::Br);
+  linkBranch(s, depth, emitTarget(s));
+}
+bool RegTranslator::isDirectBranch(FuncState& s, uint32_t depth) {
+  // No values have to be moved before jumping.
+  if (depth + 1 == s.ctrls.size()) {
+    return false;
+  }
+  const auto& label = *(s.ctrls.rbegin() + depth);
+  return label.arity == 0 || s.opds.back() == REG_CANON(label.height);
+}
+void RegTranslator::linkBranch(FuncState& s, uint32_t depth, size_t slotIdx) {
+  auto& label = *(s.ctrls.rbegin() + depth);
+  if (label.op == OpCodes::Loop) {
+    patchTarget(s, slotIdx, label.loopEntry);
+  } else {
+    label.patchSlots.push_back(slotIdx);
+  }
+}
+
+void RegTranslator::translate(const Module& module, Runtime::RTFuncDescriptor& descriptor) {
+  FuncState s(module, descriptor);
+  const auto& in = descriptor.code;
+  const auto funcArity = static_cast<uint32_t>(descriptor.funcType->second.size());
+  s.code.reserve(in.size());
+  s.ctrls.push_back({ OpCodes::Block, funcArity, funcArity, 0, 0, {}, std::nullopt });
+  // Code following an unconditional transfer is skipped up to the enclosing `Else` or `End`.
+  auto unreachable = false;
+  size_t unreachableDepth = 0;
+  size_t i = 0;
+  const auto immeAt = [&in, &i]() { return in[i++]; };
+  const auto collectArity = [&immeAt]() -> uint32_t {
+    return static_cast<LangTypes>(immeAt().as<uint8_t>()) == LangTypes::Void ? 0 : 1;
+  };
+  while (i < in.size()) {
+    const auto op = static_cast<OpCodes>(in[i++].as<uint32_t>());
+    switch (op) {
+      case OpCodes::Block:
+      case OpCodes::Loop:
+      case OpCodes::If: {
+        const auto arity = collectArity();
+        i += op == OpCodes::Block ? 1 : 2;  // Stack-machine continuations, or the index and count of a loop.
+        if (unreachable) {
+          unreachableDepth++;
+          break;
+        }
+        const auto cond = op == OpCodes::If ? popOpd(s) : 0;
+        // Values below a label are never rewritten within it, keep them in canonical slots.
+        spill(s, 0, false);
+        s.lastDstSlot.reset();
+        CtrlFrame frame = { op, arity, arity, static_cast<uint32_t>(s.opds.size()), s.code.size(), {}, std::nullopt };
+        if (op == OpCodes::Loop) {
+          frame.arity = 0;  // Branching to a loop carries no values in MVP.
+        } else if (op == OpCodes::If) {
+          emitOp(s, RegOpCodes::BrIfEqz);
+          emitReg(s, cond);
+          frame.elseSlot = emitTarget(s);
+        }
+        s.ctrls.push_back(std::move(frame));
+        break;
+      }
+      case OpCodes::Else: {
+        if (unreachable && unreachableDepth > 0) {
+          break;
+        }
+        auto& frame = s.ctrls.back();
+        if (!unreachable) {
+          moveResult(s, frame, frame.resultArity);
+          emitOp(s, RegOpCodes::Br);
+          frame.patchSlots.push_back(emitTarget(s));
+        }
+        patchTarget(s, *frame.elseSlot, s.code.size());
+        frame.elseSlot.reset();
+        s.opds.resize(frame.height);
+        s.lastDstSlot.reset();
+        unreachable = false;
+        break;
+      }
+      case OpCodes::End: {
+        if (unreachable && unreachableDepth > 0) {
+          unreachableDepth--;
+          break;
+        }
+        auto& frame = s.ctrls.back();
+        if (s.ctrls.size() == 1) {
+          if (!unreachable) {
+            emitReturn(s);
+          }
+          s.ctrls.pop_back();
+          break;
+        }
+        if (!unreachable) {
+          moveResult(s, frame, frame.resultArity);
+        }
+        if (frame.elseSlot.has_value()) {
+          patchTarget(s, *frame.elseSlot, s.code.size());
+        }
+        for (const auto slotIdx : frame.patchSlots) {
+          patchTarget(s, slotIdx, s.code.size());
+        }
+        s.opds.resize(frame.height);
+        if (frame.resultArity > 0) {
+          s.opds.push_back(REG_CANON(frame.height));
+        }
+        s.ctrls.pop_back();
+        s.lastDstSlot.reset();
+        unreachable = false;
+        break;
+      }
+      case OpCodes::Br: {
+        const auto depth = immeAt().as<uint32_t>();
+        if (unreachable) break;
+        emitBranch(s, depth);
+        unreachable = true;
+        break;
+      }
+      case OpCodes::BrIf: {
+        const auto depth = immeAt().as<uint32_t>();
+        if (unreachable) break;
+        const auto cond = popOpd(s);
+        if (isDirectBranch(s, depth)) {
+          emitOp(s, RegOpCodes::BrIfNez);
+          emitReg(s, cond);
+          linkBranch(s, depth, emitTarget(s));
+        } else {
+          // The carried value may only be moved once the branch is taken.
+          emitOp(s, RegOpCodes::BrIfEqz);
+          emitReg(s, cond);
+          const auto skipSlot = emitTarget(s);
+          emitBranch(s, depth);
+          patchTarget(s, skipSlot, s.code.size());
+        }
+        s.lastDstSlot.reset();
+        break;
+      }
+      case OpCodes::BrTable: {
+        const auto targetCount = immeAt().as<uint32_t>();
+        const auto depths = i;
+        i += targetCount + 1;
+        if (unreachable) break;
+        emitOp(s, RegOpCodes::BrTable);
+        emitReg(s, popOpd(s));
+        s.code.push_back(Runtime::RTCodeSlot::from(targetCount));
+        const auto tableIdx = s.code.size();
+        s.code.resize(tableIdx + targetCount + 1);
+        // Targets requiring value movement are routed through a stub following the table.
+        std::vector<std::pair<size_t, uint32_t>> stubs;
+        for (uint32_t k = 0; k <= targetCount; ++k) {
+          const auto depth = in[depths + k].as<uint32_t>();
+          if (isDirectBranch(s, depth)) {
+            linkBranch(s, depth, tableIdx + k);
+          } else {
+            stubs.emplace_back(tableIdx + k, depth);
+          }
+        }
+        for (const auto& [slotIdx, depth] : stubs) {
+          patchTarget(s, slotIdx, s.code.size());
+          emitBranch(s, depth);
+        }
+        unreachable = true;
+        break;
+      }
+      case OpCodes::Return: {
+        if (unreachable) break;
+        emitReturn(s);
+        unreachable = true;
+        break;
+      }
+      case OpCodes::Unreachable: {
+        if (unreachable) break;
+        emitOp(s, RegOpCodes::Unreachable);
+        unreachable = true;
+        break;
+      }
+      case OpCodes::Call:
+      case OpCodes::CallIndirect: {
+        const auto idx = immeAt().as<uint32_t>();
+        if (op == OpCodes::CallIndirect) {
+          i++;  // Reserved.
+        }
+        if (unreachable) break;
+        const auto& funcType = op == OpCodes::Call
+          ? module.funcTypes.at(module.funcTypesIndices.at(idx))
+          : module.funcTypes.at(idx);
+        const auto elemIdx = op == OpCodes::CallIndirect ? popOpd(s) : 0;
+        // Arguments are passed in canonical slots, where the frame of the callee starts.
+        const auto argBase = s.opds.size() - funcType.first.size();
+        spill(s, argBase, true);
+        emitOp(s, op == OpCodes::Call ? RegOpCodes::Call : RegOpCodes::CallIndirect);
+        s.code.push_back(Runtime::RTCodeSlot::from(idx));
+        if (op == OpCodes::CallIndirect) {
+          emitReg(s, elemIdx);
+        }
+        emitReg(s, REG_CANON(argBase));
+        s.opds.resize(argBase);
+        if (funcType.second.size() > 0) {
+          s.opds.push_back(REG_CANON(argBase));
+        }
+        break;
+      }
+      case OpCodes::Drop: {
+        if (unreachable) break;
+        popOpd(s);
+        s.lastDstSlot.reset();
+        break;
+      }
+      case OpCodes::Select: {
+        if (unreachable) break;
+        const auto cond = popOpd(s);
+        const auto y = popOpd(s);
+        const auto x = popOpd(s);
+        emitOp(s, RegOpCodes::Select);
+        emitDst(s);
+        emitReg(s, x);
+        emitReg(s, y);
+        emitReg(s, cond);
+        break;
+      }
+      case OpCodes::LocalGet: {
+        const auto localIdx = immeAt().as<uint32_t>();
+        if (unreachable) break;
+        s.opds.push_back(localIdx);
+        break;
+      }
+      case OpCodes::LocalSet:
+      case OpCodes::LocalTee: {
+        const auto localIdx = immeAt().as<uint32_t>();
+        if (unreachable) break;
+        assignLocal(s, localIdx, popOpd(s));
+        if (op == OpCodes::LocalTee) {
+          s.opds.push_back(localIdx);
+        }
+        break;
+      }
+      case OpCodes::GlobalGet: {
+        const auto globalIdx = immeAt();
+        if (unreachable) break;
+        emitOp(s, RegOpCodes::GlobalGet);
+        emitDst(s);
+        s.code.push_back(globalIdx);
+        break;
+      }
+      case OpCodes::GlobalSet: {
+        const auto globalIdx = immeAt();
+        if (unreachable) break;
+        const auto src = popOpd(s);
+        emitOp(s, RegOpCodes::GlobalSet);
+        s.code.push_back(globalIdx);
+        emitReg(s, src);
+        break;
+      }
+      case OpCodes::MemorySize: {
+        if (unreachable) break;
+        emitOp(s, RegOpCodes::MemorySize);
+        emitDst(s);
+        break;
+      }
+      case OpCodes::MemoryGrow: {
+        if (unreachable) break;
+        const auto src = popOpd(s);
+        emitOp(s, RegOpCodes::MemoryGrow);
+        emitDst(s);
+        emitReg(s, src);
+        break;
+      }
+      case OpCodes::I32Const: {
+        const auto v = immeAt().as<Runtime::rt_i32_t>();
+        if (unreachable) break;
+        s.opds.push_back(refConst(s, Runtime::RTValue::from(v)));
+        break;
+      }
+      case OpCodes::I64Const: {
+        const auto v = immeAt().as<Runtime::rt_i64_t>();
+        if (unreachable) break;
+        s.opds.push_back(refConst(s, Runtime::RTValue::from(v)));
+        break;
+      }
+      case OpCodes::F32Const: {
+        const auto v = immeAt().as<Runtime::rt_f32_t>();
+        if (unreachable) break;
+        s.opds.push_back(refConst(s, Runtime::RTValue::from(v)));
+        break;
+      }
+      case OpCodes::F64Const: {
+        const auto v = immeAt().as<Runtime::rt_f64_t>();
+        if (unreachable) break;
+        s.opds.push_back(refConst(s, Runtime::RTValue::from(v)));
+        break;
+      }
+      case OpCodes::Nop: break;
+#define TRANSLATE_REG_BINOP(NAME, ...) \
+      case OpCodes::NAME: { \
+        if (unreachable) break; \
+        const auto y = popOpd(s); \
+        const auto x = popOpd(s); \
+        emitOp(s, RegOpCodes::NAME); \
+        emitDst(s); \
+        emitReg(s, x); \
+        emitReg(s, y); \
+        break; \
+      }
+#define TRANSLATE_REG_UNOP(NAME, ...) \
+      case OpCodes::NAME: { \
+        if (unreachable) break; \
+        const auto src = popOpd(s); \
+        emitOp(s, RegOpCodes::NAME); \
+        emitDst(s); \
+        emitReg(s, src); \
+        break; \
+      }
+#define TRANSLATE_REG_LOADOP(NAME, ...) \
+      case OpCodes::NAME: { \
+        const auto offset = immeAt(); \
+        if (unreachable) break; \
+        const auto addr = popOpd(s); \
+        emitOp(s, RegOpCodes::NAME); \
+        emitDst(s); \
+        emitReg(s, addr); \
+        s.code.push_back(offset); \
+        break; \
+      }
+#define TRANSLATE_REG_STOREOP(NAME, ...) \
+      case OpCodes::NAME: { \
+        const auto offset = immeAt(); \
+        if (unreachable) break; \
+        const auto src = popOpd(s); \
+        const auto addr = popOpd(s); \
+        emitOp(s, RegOpCodes::NAME); \
+        emitReg(s, addr); \
+        emitReg(s, src); \
+        s.code.push_back(offset); \
+        break; \
+      }
+      ITERATE_SIMPLE_BINOP(TRANSLATE_REG_BINOP)
+      ITERATE_BINOP(TRANSLATE_REG_BINOP)
+      ITERATE_UNOP(TRANSLATE_REG_UNOP)
+      ITERATE_TRUNCOP(TRANSLATE_REG_UNOP)
+      ITERATE_CONVERTOP(TRANSLATE_REG_UNOP)
+      ITERATE_REINTERPRETOP(TRANSLATE_REG_UNOP)
+      ITERATE_LOAD_MEMOP(TRANSLATE_REG_LOADOP)
+      ITERATE_STORE_MEMOP(TRANSLATE_REG_STOREOP)
+      default: Exception::terminate(Exception::ErrorType::INVALID_OPCODE);
+    }
+  }
+  // Lay out the frame: [params | locals | constants | temporaries].
+  const auto localCount = static_cast<uint32_t>(descriptor.localsDefault.size());
+  const auto constCount = static_cast<uint32_t>(descriptor.regConsts.size());
+  for (const auto slotIdx : s.regSlots) {
+    const auto reg = s.code[slotIdx].as<uint32_t>();
+    if (reg & REG_TEMP_TAG) {
+      s.code[slotIdx] = Runtime::RTCodeSlot::from(localCount + constCount + (reg & ~REG_TEMP_TAG));
+    } else if (reg & REG_CONST_TAG) {
+      s.code[slotIdx] = Runtime::RTCodeSlot::from(localCount + (reg & ~REG_CONST_TAG));
+    }
+  }
+  descriptor.regFrameSize = localCount + constCount + descriptor.maxStackDepth;
+  descriptor.regCode = std::move(s.code);
+}
+
+}  // namespace TWVM
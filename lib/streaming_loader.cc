@@ -0,0 +1,232 @@
+// Copyright 2021 YHSPY. All rights reserved.
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <utility>
+#include "lib/include/streaming_loader.hh"
+#include "lib/include/loader.hh"
+#include "lib/include/reader.hh"
+#include "lib/include/validator.hh"
+#include "lib/include/instantiator.hh"
+#include "lib/include/constants.hh"
+
+namespace TWVM {
+
+namespace {
+
+// Whether the LEB128 value at the front is complete, an over-long one is left to the reader.
+bool hasLEB128(const ByteSpan& in) {
+  const auto n = std::min(in.size(), static_cast<size_t>(READER_LEB128_MAX_BYTES));
+  return n == READER_LEB128_MAX_BYTES || std::any_of(in.begin(), in.begin() + n, [](uint8_t b) {
+    return !(b & 0x80);
+  });
+}
+
+}  // namespace
+
+void StreamingLoader::push(const uint8_t* bytes, size_t n) {
+  // Errors exit the process, which must not happen while the compile thread uses the module.
+  const auto deferred = std::exchange(Exception::deferred, true);
+  try {
+    consume(bytes, n);
+  } catch (const Exception::Deferred& e) {
+    Exception::deferred = deferred;
+    stopCompiler();
+    Exception::terminate(e.type, e.pos);
+  }
+  Exception::deferred = deferred;
+}
+
+void StreamingLoader::consume(const uint8_t* bytes, size_t n) {
+  while (n > 0) {
+    size_t taken = 0;
+    switch (stage) {
+      case Stage::Preamble: {
+        taken = std::min(n, static_cast<size_t>(MAGIC_BYTES_COUNT + VER_BYTES_COUNT) - header.size());
+        header.insert(header.end(), bytes, bytes + taken);
+        if (header.size() == MAGIC_BYTES_COUNT + VER_BYTES_COUNT) {
+          ByteSpan in { header.data(), header.size() };
+          Loader::preamble(in, mod);
+          header.clear();
+          stage = Stage::SectionHeader;
+        }
+        break;
+      }
+      case Stage::SectionHeader: {
+        taken = 1;
+        if (header.empty()) {
+          sectionPos = streamPos;
+        }
+        header.push_back(*bytes);
+        // The id, then the section size up to its last byte.
+        if (header.size() > 1 && (!(header.back() & 0x80) || header.size() > READER_LEB128_MAX_BYTES)) {
+          beginSection();
+        }
+        break;
+      }
+      case Stage::SectionBody: {
+        auto& section = mod->source.sections.back();
+        taken = std::min(n, section.size() - sectionFilled);
+        std::copy_n(bytes, taken, section.data() + sectionFilled);
+        sectionFilled += taken;
+        if (sectionId == CODE_SECTION_ID) {
+          parseFuncDefs();
+        }
+        if (sectionFilled == section.size()) {
+          endSection();
+        }
+        break;
+      }
+    }
+    bytes += taken;
+    n -= taken;
+    streamPos += taken;
+  }
+}
+
+void StreamingLoader::beginSection() {
+  ByteSpan in { header.data(), header.size() };
+  Reader reader(in, mod, sectionPos);  // Checks the order of the sections.
+  sectionId = reader.currentSectionId();
+  if (sectionId < 0 || static_cast<size_t>(sectionId) >= Loader::handlers.size()) {
+    Exception::terminate(Exception::ErrorType::INVALID_SECTION_ID, sectionPos);
+  }
+  const auto sectionSize = reader.walkU32();
+  // Kept whole, so that the spans into it stay valid when the following sections arrive.
+  auto& section = mod->source.sections.emplace_back(header.size() + sectionSize);
+  std::copy(header.begin(), header.end(), section.begin());
+  sectionFilled = codeParsed = header.size();
+  header.clear();
+  stage = Stage::SectionBody;
+  if (sectionFilled == section.size()) {
+    endSection();
+  }
+}
+
+void StreamingLoader::parseFuncDefs() {
+  const auto& section = mod->source.sections.back();
+  while (true) {
+    ByteSpan in { section.data() + codeParsed, sectionFilled - codeParsed };
+    if (!funcDefCount.has_value()) {
+      if (!hasLEB128(in)) {
+        return;
+      }
+      Reader reader(in, sectionPos + codeParsed);
+      const auto count = reader.walkU32();
+      if (count > section.size()) {  // Every body takes at least a byte.
+        Exception::terminate(Exception::ErrorType::UNEXPECTED_END, sectionPos + section.size());
+      }
+      // The compile thread looks up the types of the bodies, declared in the function section.
+      if (count != mod->funcTypesIndices.size()) {
+        Exception::terminate(Exception::ErrorType::ILLEGAL_FUNC_IDX);
+      }
+      Validator::validateModule(mod);  // The sections it checks have all arrived.
+      // The compile thread reads the definitions in place, so they must never be reallocated.
+      funcDefCount = count;
+      mod->funcDefs.reserve(count);
+      if (!options.lazy) {  // Otherwise left to the first calls.
+        translated.resize(count);
+        compiler = std::thread(&StreamingLoader::compile, this);
+      }
+    } else {
+      if (mod->funcDefs.size() == *funcDefCount || !hasLEB128(in)) {
+        return;
+      }
+      auto peek = in;
+      const auto bodySize = Reader(peek, 0).walkU32();
+      if (peek.size() < bodySize) {
+        return;
+      }
+      Reader reader(in, sectionPos + codeParsed);
+      Loader::parseFuncDef(reader, mod);
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        ready = mod->funcDefs.size();
+      }
+      arrived.notify_one();
+    }
+    codeParsed = in.data() - section.data();
+  }
+}
+
+void StreamingLoader::endSection() {
+  auto& section = mod->source.sections.back();
+  if (sectionId != CODE_SECTION_ID) {
+    ByteSpan in { section.data() + 1, section.size() - 1 };  // After the id.
+    Reader reader(in, sectionPos + 1);
+    Loader::handlers[sectionId](reader, mod);
+  } else if (!funcDefCount.has_value() || mod->funcDefs.size() != *funcDefCount) {
+    Exception::terminate(Exception::ErrorType::UNEXPECTED_END, sectionPos + section.size());
+  }
+  stage = Stage::SectionHeader;
+}
+
+void StreamingLoader::compile() {
+  Exception::deferred = true;
+  for (uint32_t i = 0; i < translated.size(); ++i) {
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      arrived.wait(lock, [&]() { return ready > i || closed; });
+      if (ready <= i) {
+        return;
+      }
+    }
+    try {
+      Validator::validateFunc(mod, i);
+      translated[i] = Instantiator::translateFunc(*mod, i, options);
+    } catch (const Exception::Deferred& e) {
+      failure = e;
+      return;
+    }
+  }
+}
+
+void StreamingLoader::stopCompiler() {
+  if (compiler.joinable()) {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      closed = true;
+    }
+    arrived.notify_one();
+    compiler.join();
+  }
+}
+
+shared_module_runtime_t StreamingLoader::finish() {
+  stopCompiler();
+  if (stage == Stage::Preamble) {
+    ByteSpan in { header.data(), header.size() };
+    Loader::preamble(in, mod);  // Reports the incomplete header.
+  }
+  if (stage != Stage::SectionHeader || !header.empty()) {
+    Exception::terminate(Exception::ErrorType::UNEXPECTED_END, streamPos);
+  }
+  if (failure.has_value()) {
+    Exception::terminate(failure->type, failure->pos);
+  }
+  if (mod->funcDefs.size() != mod->funcTypesIndices.size()) {
+    Exception::terminate(Exception::ErrorType::ILLEGAL_FUNC_IDX);
+  }
+  return Instantiator::instantiate(mod, options, std::move(translated));
+}
+
+shared_module_runtime_t StreamingLoader::load(int fd, const EngineOptions& options) {
+  StreamingLoader loader(options);
+  std::vector<uint8_t> chunk(STREAMING_CHUNK_BYTES);
+  while (true) {
+    const auto n = read(fd, chunk.data(), chunk.size());
+    if (n == 0) {
+      break;
+    }
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      Exception::terminate(Exception::ErrorType::BAD_FSTREAM);
+    }
+    loader.push(chunk.data(), static_cast<size_t>(n));
+  }
+  return loader.finish();
+}
+
+}  // namespace TWVM
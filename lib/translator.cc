@@ -0,0 +1,223 @@
+// Copyright 2021 YHSPY. All rights reserved.
+#include <cstring>
+#include <utility>
+#include "lib/include/translator.hh"
+#include "lib/include/decoder.hh"
+#include "lib/include/opcodes.hh"
+#include "lib/include/exception.hh"
+
+namespace TWVM {
+
+Runtime::code_seq_t Translator::translate(const ByteSpan& body) {
+  Runtime::code_seq_t code = {};
+  code.reserve(body.size());
+  const auto emit = [&code](auto v) {
+    code.push_back(Runtime::RTCodeSlot::from(v));
+  };
+  // Slots waiting for the continuation offsets of the enclosing structured instructions.
+  std::vector<CtrlEntry> ctrlStack = { {} };  // The function body itself.
+  uint32_t loops = 0;
+  const auto reserve = [&code]() {
+    code.emplace_back();
+    return code.size() - 1;
+  };
+  const auto patch = [&code](size_t slotIdx, size_t targetIdx) {
+    code.at(slotIdx) = Runtime::RTCodeSlot::from(static_cast<int32_t>(targetIdx - slotIdx));
+  };
+  auto* pc = body.data();
+  const auto* end = pc + body.size();
+  while (pc < end) {
+    const auto op = static_cast<OpCodes>(*pc++);
+    emit(static_cast<uint32_t>(op));
+    switch (op) {
+      case OpCodes::Block: {
+        emit(static_cast<uint32_t>(*pc++));  // Block type.
+        ctrlStack.push_back({ { reserve() } });  // [end].
+        break;
+      }
+      case OpCodes::Loop: {
+        emit(static_cast<uint32_t>(*pc++));
+        emit(loops++);
+        emit(uint64_t { 0 });  // Count.
+        ctrlStack.push_back({});  // Continuation is the loop itself.
+        break;
+      }
+      case OpCodes::If: {
+        emit(static_cast<uint32_t>(*pc++));
+        const auto elseSlot = reserve();
+        ctrlStack.push_back({ { reserve() }, elseSlot });  // [else, end].
+        break;
+      }
+      case OpCodes::Else: {
+        auto& entry = ctrlStack.back();
+        if (entry.elseSlot.has_value()) {
+          patch(*entry.elseSlot, code.size());  // The first instruction of the else arm.
+          entry.elseSlot.reset();
+        } else {
+          Exception::terminate(Exception::ErrorType::ILLFORMED_STRUCTURE);
+        }
+        break;
+      }
+      case OpCodes::End: {
+        if (ctrlStack.empty()) {
+          Exception::terminate(Exception::ErrorType::ILLFORMED_STRUCTURE);
+        }
+        const auto& entry = ctrlStack.back();
+        if (entry.elseSlot.has_value()) {
+          // No else arm, the label will be consumed by this `End`.
+          patch(*entry.elseSlot, code.size() - 1);
+        }
+        for (const auto slotIdx : entry.endSlots) {
+          patch(slotIdx, code.size());
+        }
+        ctrlStack.pop_back();
+        break;
+      }
+      case OpCodes::Br:
+      case OpCodes::BrIf:
+      case OpCodes::Call:
+      case OpCodes::LocalGet:
+      case OpCodes::LocalSet:
+      case OpCodes::LocalTee:
+      case OpCodes::GlobalGet:
+      case OpCodes::GlobalSet: {
+        emit(Decoder::decodeVaruint<Runtime::imme_u32_t>(pc));
+        break;
+      }
+      case OpCodes::BrTable: {
+        const auto targetCount = Decoder::decodeVaruint<Runtime::imme_u32_t>(pc);
+        emit(targetCount);
+        for (uint32_t i = 0; i <= targetCount; ++i) {  // Include `default_target`.
+          emit(Decoder::decodeVaruint<Runtime::relative_depth_t>(pc));
+        }
+        break;
+      }
+      case OpCodes::CallIndirect: {
+        emit(Decoder::decodeVaruint<Runtime::index_t>(pc));
+        emit(static_cast<uint32_t>(*pc++));  // Reserved.
+        break;
+      }
+      case OpCodes::I32LoadMem:
+      case OpCodes::I64LoadMem:
+      case OpCodes::F32LoadMem:
+      case OpCodes::F64LoadMem:
+      case OpCodes::I32LoadMem8S:
+      case OpCodes::I32LoadMem8U:
+      case OpCodes::I32LoadMem16S:
+      case OpCodes::I32LoadMem16U:
+      case OpCodes::I64LoadMem8S:
+      case OpCodes::I64LoadMem8U:
+      case OpCodes::I64LoadMem16S:
+      case OpCodes::I64LoadMem16U:
+      case OpCodes::I64LoadMem32S:
+      case OpCodes::I64LoadMem32U:
+      case OpCodes::I32StoreMem:
+      case OpCodes::I64StoreMem:
+      case OpCodes::F32StoreMem:
+      case OpCodes::F64StoreMem:
+      case OpCodes::I32StoreMem8:
+      case OpCodes::I32StoreMem16:
+      case OpCodes::I64StoreMem8:
+      case OpCodes::I64StoreMem16:
+      case OpCodes::I64StoreMem32: {
+        [[maybe_unused]] const auto flags = Decoder::decodeVaruint<Runtime::imme_u32_t>(pc);  // Alignment hint.
+        emit(Decoder::decodeVaruint<Runtime::imme_u32_t>(pc));  // Offset.
+        break;
+      }
+      case OpCodes::MemorySize:
+      case OpCodes::MemoryGrow: {
+        pc++;  // Reserved.
+        break;
+      }
+      case OpCodes::I32Const: {
+        emit(Decoder::decodeVarint<Runtime::rt_i32_t>(pc));
+        break;
+      }
+      case OpCodes::I64Const: {
+        emit(Decoder::decodeVarint<Runtime::rt_i64_t>(pc));
+        break;
+      }
+      case OpCodes::F32Const: {
+        Runtime::rt_f32_t v;
+        std::memcpy(&v, pc, sizeof(v));
+        pc += sizeof(v);
+        emit(v);
+        break;
+      }
+      case OpCodes::F64Const: {
+        Runtime::rt_f64_t v;
+        std::memcpy(&v, pc, sizeof(v));
+        pc += sizeof(v);
+        emit(v);
+        break;
+      }
+      default: break;
+    }
+  }
+  if (!ctrlStack.empty()) {
+    Exception::terminate(Exception::ErrorType::ILLFORMED_STRUCTURE);
+  }
+  return code;
+}
+
+size_t Translator::immeCount(const Runtime::code_seq_t& code, size_t idx) {
+  switch (static_cast<OpCodes>(code[idx].as<uint32_t>())) {
+    case OpCodes::Block: return 2;
+    case OpCodes::If: return 3;
+    case OpCodes::Loop: return 3;
+    case OpCodes::BrTable: return code[idx + 1].as<uint32_t>() + 2;
+    case OpCodes::CallIndirect: return 2;
+    case OpCodes::Br:
+    case OpCodes::BrIf:
+    case OpCodes::Call:
+    case OpCodes::LocalGet:
+    case OpCodes::LocalSet:
+    case OpCodes::LocalTee:
+    case OpCodes::GlobalGet:
+    case OpCodes::GlobalSet:
+    case OpCodes::I32Const:
+    case OpCodes::I64Const:
+    case OpCodes::F32Const:
+    case OpCodes::F64Const: return 1;
+    default: {
+      const auto op = static_cast<OpCodes>(code[idx].as<uint32_t>());
+      return op >= OpCodes::I32LoadMem && op <= OpCodes::I64StoreMem32 ? 1 : 0;  // Offset.
+    }
+  }
+}
+
+size_t Translator::matchSeq(const Runtime::code_seq_t& code, size_t idx, std::initializer_list<OpCodes> ops) {
+  const auto start = idx;
+  for (const auto op : ops) {
+    if (idx >= code.size() || static_cast<OpCodes>(code[idx].as<uint32_t>()) != op) {
+      return 0;
+    }
+    idx += 1 + immeCount(code, idx);
+  }
+  return idx - start;
+}
+
+void Translator::fuse(Runtime::code_seq_t& code) {
+  // Longer sequences first.
+  static const std::vector<std::pair<OpCodes, std::initializer_list<OpCodes>>> patterns = {
+    { OpCodes::LocalGetLocalGetI32LtSBrIf, { OpCodes::LocalGet, OpCodes::LocalGet, OpCodes::I32LtS, OpCodes::BrIf } },
+    { OpCodes::LocalGetI32ConstI32Add, { OpCodes::LocalGet, OpCodes::I32Const, OpCodes::I32Add } },
+    { OpCodes::LocalGetI32ConstI32Sub, { OpCodes::LocalGet, OpCodes::I32Const, OpCodes::I32Sub } },
+    { OpCodes::LocalGetI32ConstI32LtS, { OpCodes::LocalGet, OpCodes::I32Const, OpCodes::I32LtS } },
+    { OpCodes::I32ConstI32LoadMem, { OpCodes::I32Const, OpCodes::I32LoadMem } },
+  };
+  // Continuations only point to `Loop`, `End`, or the instruction following `End` and `Else`,
+  // so a sequence without structured instructions can only be entered through its first opcode.
+  size_t idx = 0;
+  while (idx < code.size()) {
+    size_t len = 0;
+    for (const auto& [fused, ops] : patterns) {
+      if ((len = matchSeq(code, idx, ops)) > 0) {
+        code[idx] = Runtime::RTCodeSlot::from(static_cast<uint32_t>(fused));
+        break;
+      }
+    }
+    idx += len > 0 ? len : 1 + immeCount(code, idx);
+  }
+}
+}  // namespace TWVM
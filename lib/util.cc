@@ -1,4 +1,5 @@
 // Copyright 2021 YHSPY. All rights reserved.
+#include <cstring>
 #include <iostream>
 #include "lib/include/util.hh"
 
@@ -23,4 +24,35 @@ void Util::printAssistantInfo(bool simplify) {
   }
 }
 
+// Two lanes of MurmurHash64A over alternate words, mixed together at the end.
+std::pair<uint64_t, uint64_t> Util::hash128(const uint8_t* data, size_t size, uint64_t seed) {
+  constexpr uint64_t m = 0xc6a4a7935bd1e995;
+  constexpr int r = 47;
+  const auto mix = [](uint64_t k) {
+    k *= m;
+    k ^= k >> r;
+    return k * m;
+  };
+  uint64_t h1 = seed ^ (size * m);
+  uint64_t h2 = ~seed ^ (size * 0x9e3779b97f4a7c15);
+  const auto absorb = [&](const uint8_t* p) {
+    uint64_t k[2];
+    std::memcpy(k, p, sizeof(k));
+    h1 = (h1 ^ mix(k[0])) * m;
+    h2 = (h2 ^ mix(k[1])) * m;
+  };
+  size_t i = 0;
+  for (; i + 16 <= size; i += 16) {
+    absorb(data + i);
+  }
+  uint8_t tail[16] = {};
+  std::memcpy(tail, data + i, size - i);
+  absorb(tail);
+  h1 ^= mix(h2);
+  h2 ^= mix(h1);
+  h1 ^= h1 >> r;
+  h2 ^= h2 >> r;
+  return { h1, h2 };
+}
+
 }  // namespace TWVM
@@ -0,0 +1,448 @@
+// Copyright 2021 YHSPY. All rights reserved.
+#include <array>
+#include <algorithm>
+#include "lib/include/validator.hh"
+#include "lib/include/constants.hh"
+#include "lib/include/decoder.hh"
+#include "lib/include/exception.hh"
+#include "lib/include/util.hh"
+
+// (FIRST, LAST, PARAM_0, PARAM_1, RESULT), for operators without control or index immediates.
+#define ITERATE_OPERATOR_SIGS(V) \
+  V(I32LoadMem, I32LoadMem, I32, NONE, I32) \
+  V(I64LoadMem, I64LoadMem, I32, NONE, I64) \
+  V(F32LoadMem, F32LoadMem, I32, NONE, F32) \
+  V(F64LoadMem, F64LoadMem, I32, NONE, F64) \
+  V(I32LoadMem8S, I32LoadMem16U, I32, NONE, I32) \
+  V(I64LoadMem8S, I64LoadMem32U, I32, NONE, I64) \
+  V(I32StoreMem, I32StoreMem, I32, I32, NONE) \
+  V(I64StoreMem, I64StoreMem, I32, I64, NONE) \
+  V(F32StoreMem, F32StoreMem, I32, F32, NONE) \
+  V(F64StoreMem, F64StoreMem, I32, F64, NONE) \
+  V(I32StoreMem8, I32StoreMem16, I32, I32, NONE) \
+  V(I64StoreMem8, I64StoreMem32, I32, I64, NONE) \
+  V(MemorySize, MemorySize, NONE, NONE, I32) \
+  V(MemoryGrow, MemoryGrow, I32, NONE, I32) \
+  V(I32Const, I32Const, NONE, NONE, I32) \
+  V(I64Const, I64Const, NONE, NONE, I64) \
+  V(F32Const, F32Const, NONE, NONE, F32) \
+  V(F64Const, F64Const, NONE, NONE, F64) \
+  V(I32Eqz, I32Eqz, I32, NONE, I32) \
+  V(I32Eq, I32GeU, I32, I32, I32) \
+  V(I64Eqz, I64Eqz, I64, NONE, I32) \
+  V(I64Eq, I64GeU, I64, I64, I32) \
+  V(F32Eq, F32Ge, F32, F32, I32) \
+  V(F64Eq, F64Ge, F64, F64, I32) \
+  V(I32Clz, I32Popcnt, I32, NONE, I32) \
+  V(I32Add, I32Rotr, I32, I32, I32) \
+  V(I64Clz, I64Popcnt, I64, NONE, I64) \
+  V(I64Add, I64Rotr, I64, I64, I64) \
+  V(F32Abs, F32Sqrt, F32, NONE, F32) \
+  V(F32Add, F32CopySign, F32, F32, F32) \
+  V(F64Abs, F64Sqrt, F64, NONE, F64) \
+  V(F64Add, F64CopySign, F64, F64, F64) \
+  V(I32WrapI64, I32WrapI64, I64, NONE, I32) \
+  V(I32TruncF32S, I32TruncF32U, F32, NONE, I32) \
+  V(I32TruncF64S, I32TruncF64U, F64, NONE, I32) \
+  V(I64ExtendI32S, I64ExtendI32U, I32, NONE, I64) \
+  V(I64TruncF32S, I64TruncF32U, F32, NONE, I64) \
+  V(I64TruncF64S, I64TruncF64U, F64, NONE, I64) \
+  V(F32SConvertI32, F32UConvertI32, I32, NONE, F32) \
+  V(F32SConvertI64, F32UConvertI64, I64, NONE, F32) \
+  V(F32DemoteF64, F32DemoteF64, F64, NONE, F32) \
+  V(F64SConvertI32, F64UConvertI32, I32, NONE, F64) \
+  V(F64SConvertI64, F64UConvertI64, I64, NONE, F64) \
+  V(F64PromoteF32, F64PromoteF32, F32, NONE, F64) \
+  V(I32ReinterpretF32, I32ReinterpretF32, F32, NONE, I32) \
+  V(I64ReinterpretF64, I64ReinterpretF64, F64, NONE, I64) \
+  V(F32ReinterpretI32, F32ReinterpretI32, I32, NONE, F32) \
+  V(F64ReinterpretI64, F64ReinterpretI64, I64, NONE, F64)
+
+// (NAME, ALIGNMENT), the natural alignment (log2 of the access width) of the memory operators.
+#define ITERATE_MEMOP_ALIGNMENT(V) \
+  V(I32LoadMem, 2) \
+  V(I64LoadMem, 3) \
+  V(F32LoadMem, 2) \
+  V(F64LoadMem, 3) \
+  V(I32LoadMem8S, 0) \
+  V(I32LoadMem8U, 0) \
+  V(I32LoadMem16S, 1) \
+  V(I32LoadMem16U, 1) \
+  V(I64LoadMem8S, 0) \
+  V(I64LoadMem8U, 0) \
+  V(I64LoadMem16S, 1) \
+  V(I64LoadMem16U, 1) \
+  V(I64LoadMem32S, 2) \
+  V(I64LoadMem32U, 2) \
+  V(I32StoreMem, 2) \
+  V(I64StoreMem, 3) \
+  V(F32StoreMem, 2) \
+  V(F64StoreMem, 3) \
+  V(I32StoreMem8, 0) \
+  V(I32StoreMem16, 1) \
+  V(I64StoreMem8, 0) \
+  V(I64StoreMem16, 1) \
+  V(I64StoreMem32, 2)
+
+namespace TWVM {
+
+namespace {
+
+constexpr uint8_t TYPE_NONE = 0;  // Also stands for the "unknown" operand type of the spec.
+constexpr auto TYPE_VOID = static_cast<uint8_t>(LangTypes::Void);
+constexpr auto TYPE_I32 = static_cast<uint8_t>(ValueTypes::I32);
+constexpr auto TYPE_I64 = static_cast<uint8_t>(ValueTypes::I64);
+constexpr auto TYPE_F32 = static_cast<uint8_t>(ValueTypes::F32);
+constexpr auto TYPE_F64 = static_cast<uint8_t>(ValueTypes::F64);
+
+struct OpSig {
+  uint8_t params[2];
+  uint8_t result;
+  bool valid;
+};
+
+const std::array<OpSig, 1 << 8>& retrieveOpSigs() {
+  static const auto sigs = []() {
+    std::array<OpSig, 1 << 8> sigs = {};
+#define SET_OPERATOR_SIG(FIRST, LAST, PARAM_0, PARAM_1, RESULT) \
+    for (auto i = Util::asInteger(OpCodes::FIRST); i <= Util::asInteger(OpCodes::LAST); ++i) { \
+      sigs[i] = { { TYPE_##PARAM_0, TYPE_##PARAM_1 }, TYPE_##RESULT, true }; \
+    }
+    ITERATE_OPERATOR_SIGS(SET_OPERATOR_SIG)
+#undef SET_OPERATOR_SIG
+    return sigs;
+  }();
+  return sigs;
+}
+
+uint32_t naturalAlignment(OpCodes op) {
+  switch (op) {
+#define DECLARE_MEMOP_ALIGNMENT_CASE(NAME, ALIGNMENT) \
+    case OpCodes::NAME: return ALIGNMENT;
+    ITERATE_MEMOP_ALIGNMENT(DECLARE_MEMOP_ALIGNMENT_CASE)
+#undef DECLARE_MEMOP_ALIGNMENT_CASE
+    default: return 0;
+  }
+}
+
+bool isValidBlockType(uint8_t type) {
+  return type == TYPE_VOID || (type >= TYPE_F64 && type <= TYPE_I32);
+}
+
+}  // namespace
+
+void Validator::pushOpd(FuncState& state, uint8_t type) {
+  state.opds.push_back(type);
+  state.maxDepth = std::max(state.maxDepth, state.opds.size());
+}
+uint8_t Validator::popOpd(FuncState& state) {
+  const auto& frame = state.ctrls.back();
+  if (state.opds.size() == frame.height) {
+    if (frame.unreachable) {
+      return TYPE_NONE;
+    }
+    Exception::terminate(Exception::ErrorType::EXHAUSTED_STACK_ACCESS);
+  }
+  const auto type = state.opds.back();
+  state.opds.pop_back();
+  return type;
+}
+uint8_t Validator::popOpd(FuncState& state, uint8_t expected) {
+  const auto actual = popOpd(state);
+  if (actual == TYPE_NONE) return expected;
+  if (expected == TYPE_NONE) return actual;
+  if (actual != expected) {
+    Exception::terminate(Exception::ErrorType::STACK_VAL_TYPE_MISMATCH);
+  }
+  return actual;
+}
+void Validator::pushCtrl(FuncState& state, OpCodes op, uint8_t resultType) {
+  state.ctrls.push_back({ op, resultType, state.opds.size(), false });
+}
+Validator::CtrlFrame Validator::popCtrl(FuncState& state) {
+  if (state.ctrls.empty()) {
+    Exception::terminate(Exception::ErrorType::ILLFORMED_STRUCTURE);
+  }
+  const auto frame = state.ctrls.back();
+  if (frame.resultType != TYPE_VOID) {
+    popOpd(state, frame.resultType);
+  }
+  if (state.opds.size() != frame.height) {
+    Exception::terminate(Exception::ErrorType::ARITY_TYPE_MISMATCH);
+  }
+  state.ctrls.pop_back();
+  return frame;
+}
+uint8_t Validator::labelType(const CtrlFrame& frame) {
+  // Branching to a loop re-enters it, which takes no values in MVP.
+  return frame.op == OpCodes::Loop ? TYPE_VOID : frame.resultType;
+}
+void Validator::markUnreachable(FuncState& state) {
+  auto& frame = state.ctrls.back();
+  state.opds.resize(frame.height);
+  frame.unreachable = true;
+}
+
+void Validator::validateFunc(shared_module_t mod, uint32_t funcIdx) {
+  // Not `at()`, the streaming loader may be appending the definitions that follow.
+  auto& funcDef = mod->funcDefs[funcIdx];
+  const auto& funcType = mod->funcTypes.at(mod->funcTypesIndices.at(funcIdx));
+  if (funcType.second.size() > 1) {
+    Exception::terminate(Exception::ErrorType::ARITY_TYPE_MISMATCH);
+  }
+  const auto funcResultType = funcType.second.empty() ? TYPE_VOID : funcType.second.front();
+  const auto localsCount = funcType.first.size() + funcDef.locals.size();
+  const auto localType = [&](uint32_t idx) {
+    if (idx >= localsCount) {
+      Exception::terminate(Exception::ErrorType::ILLEGAL_LOCAL_IDX);
+    }
+    return idx < funcType.first.size() ? funcType.first[idx] : funcDef.locals[idx - funcType.first.size()];
+  };
+  const auto checkBranchDepth = [](FuncState& state, uint32_t depth) -> const CtrlFrame& {
+    if (depth >= state.ctrls.size()) {
+      Exception::terminate(Exception::ErrorType::ILLEGAL_BREAK_LVL);
+    }
+    return *(state.ctrls.rbegin() + depth);
+  };
+  const auto& opSigs = retrieveOpSigs();
+
+  FuncState state;
+  pushCtrl(state, OpCodes::Block, funcResultType);  // The function body itself.
+  auto* pc = funcDef.body.data();
+  const auto* end = pc + funcDef.body.size();
+  // Of the fixed-size immediates, which may run past the end of a truncated body like the LEB128 ones.
+  const auto skip = [&pc, &end](size_t n) {
+    if (static_cast<size_t>(end - pc) < n) {
+      Exception::terminate(Exception::ErrorType::UNEXPECTED_END);
+    }
+    const auto* const at = pc;
+    pc += n;
+    return at;
+  };
+  while (pc < end) {
+    if (state.ctrls.empty()) {
+      // Trailing bytes after the `End` of the function body.
+      Exception::terminate(Exception::ErrorType::ILLFORMED_STRUCTURE);
+    }
+    const auto op = static_cast<OpCodes>(*pc++);
+    switch (op) {
+      case OpCodes::Unreachable: {
+        markUnreachable(state);
+        break;
+      }
+      case OpCodes::Nop: break;
+      case OpCodes::Block:
+      case OpCodes::Loop:
+      case OpCodes::If: {
+        const auto blockType = *skip(1);
+        if (!isValidBlockType(blockType)) {
+          Exception::terminate(Exception::ErrorType::INVALID_VAL_TYPE);
+        }
+        if (op == OpCodes::If) {
+          popOpd(state, TYPE_I32);
+        }
+        pushCtrl(state, op, blockType);
+        break;
+      }
+      case OpCodes::Else: {
+        const auto frame = popCtrl(state);
+        if (frame.op != OpCodes::If) {
+          Exception::terminate(Exception::ErrorType::ILLFORMED_STRUCTURE);
+        }
+        pushCtrl(state, OpCodes::Else, frame.resultType);
+        break;
+      }
+      case OpCodes::End: {
+        const auto frame = popCtrl(state);
+        if (frame.op == OpCodes::If && frame.resultType != TYPE_VOID) {
+          // The missing else arm cannot produce the result.
+          Exception::terminate(Exception::ErrorType::ARITY_TYPE_MISMATCH);
+        }
+        if (frame.resultType != TYPE_VOID) {
+          pushOpd(state, frame.resultType);
+        }
+        break;
+      }
+      case OpCodes::Br: {
+        const auto& target = checkBranchDepth(state, Decoder::decodeVaruint<Runtime::relative_depth_t>(pc, end));
+        const auto type = labelType(target);
+        if (type != TYPE_VOID) popOpd(state, type);
+        markUnreachable(state);
+        break;
+      }
+      case OpCodes::BrIf: {
+        const auto& target = checkBranchDepth(state, Decoder::decodeVaruint<Runtime::relative_depth_t>(pc, end));
+        const auto type = labelType(target);
+        popOpd(state, TYPE_I32);
+        if (type != TYPE_VOID) {
+          popOpd(state, type);
+          pushOpd(state, type);
+        }
+        break;
+      }
+      case OpCodes::BrTable: {
+        const auto targetCount = Decoder::decodeVaruint<Runtime::imme_u32_t>(pc, end);
+        std::vector<uint8_t> targetTypes = {};
+        for (uint32_t i = 0; i <= targetCount; ++i) {  // Include `default_target`.
+          targetTypes.push_back(
+            labelType(checkBranchDepth(state, Decoder::decodeVaruint<Runtime::relative_depth_t>(pc, end))));
+        }
+        const auto defaultType = targetTypes.back();
+        if (std::any_of(targetTypes.begin(), targetTypes.end(), [=](auto t) { return t != defaultType; })) {
+          Exception::terminate(Exception::ErrorType::ARITY_TYPE_MISMATCH);
+        }
+        popOpd(state, TYPE_I32);
+        if (defaultType != TYPE_VOID) popOpd(state, defaultType);
+        markUnreachable(state);
+        break;
+      }
+      case OpCodes::Return: {
+        if (funcResultType != TYPE_VOID) popOpd(state, funcResultType);
+        markUnreachable(state);
+        break;
+      }
+      case OpCodes::Call:
+      case OpCodes::CallIndirect: {
+        const Module::func_type_t* calleeType = nullptr;
+        if (op == OpCodes::Call) {
+          const auto calleeIdx = Decoder::decodeVaruint<Runtime::index_t>(pc, end);
+          if (calleeIdx >= mod->funcTypesIndices.size()) {  // Matching `funcDefs` once loaded.
+            Exception::terminate(Exception::ErrorType::ILLEGAL_FUNC_IDX);
+          }
+          calleeType = &mod->funcTypes.at(mod->funcTypesIndices[calleeIdx]);
+        } else {
+          const auto typeIdx = Decoder::decodeVaruint<Runtime::index_t>(pc, end);
+          skip(1);  // Reserved.
+          if (mod->tables.empty()) {
+            Exception::terminate(Exception::ErrorType::NO_AVAILABLE_TABLES_EXIST);
+          }
+          if (typeIdx >= mod->funcTypes.size()) {
+            Exception::terminate(Exception::ErrorType::FUNC_TYPE_ACCESS_OOB);
+          }
+          calleeType = &mod->funcTypes[typeIdx];
+          popOpd(state, TYPE_I32);
+        }
+        for (auto it = calleeType->first.rbegin(); it != calleeType->first.rend(); ++it) {
+          popOpd(state, *it);
+        }
+        for (const auto type : calleeType->second) {
+          pushOpd(state, type);
+        }
+        break;
+      }
+      case OpCodes::Drop: {
+        popOpd(state);
+        break;
+      }
+      case OpCodes::Select: {
+        popOpd(state, TYPE_I32);
+        const auto t1 = popOpd(state);
+        const auto t2 = popOpd(state, t1);
+        pushOpd(state, t1 == TYPE_NONE ? t2 : t1);
+        break;
+      }
+      case OpCodes::LocalGet: {
+        pushOpd(state, localType(Decoder::decodeVaruint<Runtime::index_t>(pc, end)));
+        break;
+      }
+      case OpCodes::LocalSet:
+      case OpCodes::LocalTee: {
+        const auto type = localType(Decoder::decodeVaruint<Runtime::index_t>(pc, end));
+        popOpd(state, type);
+        if (op == OpCodes::LocalTee) pushOpd(state, type);
+        break;
+      }
+      case OpCodes::GlobalGet:
+      case OpCodes::GlobalSet: {
+        const auto idx = Decoder::decodeVaruint<Runtime::index_t>(pc, end);
+        if (idx >= mod->globals.size()) {
+          Exception::terminate(Exception::ErrorType::GLOBAL_ACCESS_OOB);
+        }
+        const auto& globalType = mod->globals[idx].globalType;
+        if (op == OpCodes::GlobalGet) {
+          pushOpd(state, globalType.valType);
+        } else if (globalType.mutability) {
+          popOpd(state, globalType.valType);
+        } else {
+          Exception::terminate(Exception::ErrorType::IMMUTABLE_GLOBAL_MUTATION);
+        }
+        break;
+      }
+      default: {
+        const auto& sig = opSigs[Util::asInteger(op)];
+        if (!sig.valid) {
+          Exception::terminate(Exception::ErrorType::INVALID_OPCODE);
+        }
+        // Immediates.
+        if (op >= OpCodes::I32LoadMem && op <= OpCodes::MemoryGrow) {
+          if (mod->mems.empty()) {
+            Exception::terminate(Exception::ErrorType::NO_AVAILABLE_MEM);
+          }
+          if (op >= OpCodes::MemorySize) {
+            skip(1);  // Reserved.
+          } else {
+            const auto align = Decoder::decodeVaruint<Runtime::imme_u32_t>(pc, end);
+            if (align > naturalAlignment(op)) {
+              Exception::terminate(Exception::ErrorType::ILLEGAL_ALIGNMENT);
+            }
+            Decoder::decodeVaruint<Runtime::imme_u32_t>(pc, end);  // Offset.
+          }
+        } else if (op == OpCodes::I32Const) {
+          Decoder::decodeVarint<Runtime::rt_i32_t>(pc, end);
+        } else if (op == OpCodes::I64Const) {
+          Decoder::decodeVarint<Runtime::rt_i64_t>(pc, end);
+        } else if (op == OpCodes::F32Const) {
+          skip(sizeof(Runtime::rt_f32_t));
+        } else if (op == OpCodes::F64Const) {
+          skip(sizeof(Runtime::rt_f64_t));
+        }
+        // Operands, the second one is on the top.
+        if (sig.params[1] != TYPE_NONE) popOpd(state, sig.params[1]);
+        if (sig.params[0] != TYPE_NONE) popOpd(state, sig.params[0]);
+        if (sig.result != TYPE_NONE) pushOpd(state, sig.result);
+        break;
+      }
+    }
+  }
+  if (!state.ctrls.empty()) {
+    Exception::terminate(Exception::ErrorType::ILLFORMED_STRUCTURE);
+  }
+  funcDef.maxStackDepth = state.maxDepth;
+}
+
+void Validator::validateModule(shared_module_t mod) {
+  const auto funcCount = mod->funcTypesIndices.size();  // No functions are imported.
+  for (const auto typeIdx : mod->funcTypesIndices) {
+    if (typeIdx >= mod->funcTypes.size()) {
+      Exception::terminate(Exception::ErrorType::FUNC_TYPE_ACCESS_OOB);
+    }
+  }
+  for (const auto& exportSeg : mod->exports) {
+    if (exportSeg.extKind == EXT_KIND_FUNC && exportSeg.extIdx >= funcCount) {
+      Exception::terminate(Exception::ErrorType::ILLEGAL_FUNC_IDX);
+    }
+  }
+  if (mod->startFuncIdx.has_value() && *mod->startFuncIdx >= funcCount) {
+    Exception::terminate(Exception::ErrorType::ILLEGAL_FUNC_IDX);
+  }
+  for (const auto& elem : mod->elements) {
+    if (std::any_of(elem.funcIndices.begin(), elem.funcIndices.end(), [&](uint32_t idx) { return idx >= funcCount; })) {
+      Exception::terminate(Exception::ErrorType::TBL_ELEM_EXCEED_MAX);
+    }
+  }
+}
+
+void Validator::validate(shared_module_t mod, const EngineOptions& options) {
+  if (mod->funcDefs.size() != mod->funcTypesIndices.size()) {
+    Exception::terminate(Exception::ErrorType::ILLEGAL_FUNC_IDX);
+  }
+  validateModule(mod);
+  if (options.lazy) {
+    return;  // Left to `Instantiator::translateLazily`.
+  }
+  Util::parallelFor(mod->funcDefs.size(), options.threads, [&mod](size_t i) {
+    validateFunc(mod, static_cast<uint32_t>(i));
+  });
+}
+
+}  // namespace TWVM
@@ -0,0 +1,124 @@
+// Copyright 2021 YHSPY. All rights reserved.
+#include <algorithm>
+#include <array>
+#include <utility>
+#include "lib/include/virtual_mem.hh"
+#include "lib/include/constants.hh"
+#include "lib/include/exception.hh"
+#if defined(VIRTUAL_MEM_SUPPORTED)
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+namespace TWVM {
+
+#if defined(VIRTUAL_MEM_SUPPORTED)
+
+namespace {
+
+// Read by the fault handler, so kept in static storage.
+std::array<std::pair<uint8_t*, size_t>, GUARDED_MEM_MAX_REGIONS> regions = {};
+
+void handleFault(int sig, siginfo_t* info, void*) {
+  const auto* addr = static_cast<uint8_t*>(info->si_addr);
+  for (const auto& [base, reservedBytes] : regions) {
+    if (base && addr >= base && addr < base + reservedBytes) {
+      // The fault is synchronous to a guest access, so the engine state is consistent here.
+      Exception::terminate(Exception::ErrorType::MEM_ACCESS_OOB);
+    }
+  }
+  // Not ours, re-raise with the default action when returning to the faulting instruction.
+  signal(sig, SIG_DFL);
+}
+
+}  // namespace
+
+void VirtualMem::installTrapHandler() {
+  static const auto installed = []() {
+    struct sigaction action = {};
+    action.sa_sigaction = handleFault;
+    action.sa_flags = SA_SIGINFO;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGSEGV, &action, nullptr);
+    sigaction(SIGBUS, &action, nullptr);  // Reported for protected pages on macOS.
+    return true;
+  }();
+  static_cast<void>(installed);
+}
+
+uint8_t* VirtualMem::reserve(size_t reservedBytes, size_t pages) {
+  auto* base = mmap(nullptr, reservedBytes, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (base == MAP_FAILED) {
+    return nullptr;
+  }
+  if (!commit(static_cast<uint8_t*>(base), 0, pages)) {
+    munmap(base, reservedBytes);
+    return nullptr;
+  }
+  return static_cast<uint8_t*>(base);
+}
+
+bool VirtualMem::trapFaults(uint8_t* base, size_t reservedBytes) {
+  const auto slot = std::find_if(regions.begin(), regions.end(), [](auto& region) { return !region.first; });
+  if (slot == regions.end()) {
+    return false;
+  }
+  installTrapHandler();
+  *slot = { base, reservedBytes };
+  return true;
+}
+
+bool VirtualMem::commit(uint8_t* base, size_t prevPages, size_t pages) {
+  if (pages <= prevPages) {
+    return true;
+  }
+  return mprotect(
+    base + prevPages * WASM_PAGE_SIZE_IN_BYTE,
+    (pages - prevPages) * WASM_PAGE_SIZE_IN_BYTE,
+    PROT_READ | PROT_WRITE) == 0;
+}
+
+void VirtualMem::release(uint8_t* base, size_t reservedBytes) {
+  for (auto& region : regions) {
+    if (region.first == base) {
+      region = {};
+    }
+  }
+  munmap(base, reservedBytes);
+}
+
+const uint8_t* VirtualMem::mapFile(const std::string& path, size_t& size) {
+  const auto fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return nullptr;
+  }
+  struct stat info = {};
+  void* base = MAP_FAILED;
+  if (fstat(fd, &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0) {
+    size = static_cast<size_t>(info.st_size);
+    base = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  }
+  close(fd);  // The mapping keeps its own reference to the file.
+  return base == MAP_FAILED ? nullptr : static_cast<const uint8_t*>(base);
+}
+
+void VirtualMem::unmapFile(const uint8_t* base, size_t size) {
+  munmap(const_cast<uint8_t*>(base), size);
+}
+
+#else
+
+void VirtualMem::installTrapHandler() {}
+uint8_t* VirtualMem::reserve(size_t, size_t) { return nullptr; }
+bool VirtualMem::trapFaults(uint8_t*, size_t) { return false; }
+bool VirtualMem::commit(uint8_t*, size_t, size_t) { return false; }
+void VirtualMem::release(uint8_t*, size_t) {}
+const uint8_t* VirtualMem::mapFile(const std::string&, size_t&) { return nullptr; }
+void VirtualMem::unmapFile(const uint8_t*, size_t) {}
+
+#endif
+
+}  // namespace TWVM
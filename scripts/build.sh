@@ -8,6 +8,12 @@ if [ -n "$BUILD_VERSION" ] ; then
     cmake . -Bbuild -DCMAKE_BUILD_TYPE=Debug
     cd build
     make
+  elif [ "$1" = "--bench" ] ; then
+    export CMAKE_TARGET="BENCH"
+    export NDEBUG=1
+    cmake . -Bbuild -DCMAKE_BUILD_TYPE=Release
+    cd build
+    make
   elif [ "$1" = "--debug" ] ; then
     export CMAKE_TARGET="BUILD_DEBUG"
     cmake . -Bbuild -DCMAKE_BUILD_TYPE=Debug
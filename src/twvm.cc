@@ -1,10 +1,14 @@
 // Copyright 2021 YHSPY. All rights reserved.
+#include <unistd.h>
 #include <string>
 #include <iostream>
+#include <algorithm>
 #include "src/twvm.h"
 #include "lib/include/loader.hh"
+#include "lib/include/streaming_loader.hh"
 #include "lib/include/instantiator.hh"
 #include "lib/include/executor.hh"
+#include "lib/include/jit_compiler.hh"
 #include "lib/include/options.hh"
 #include "lib/include/state.hh"
 #include "lib/include/util.hh"
@@ -16,7 +20,7 @@ using namespace TWVM;
 int main(int argc, const char **argv) {
   // Setting up options.
   Options options { 
-    "TWVM - A tiny, lightweight and efficient WebAssembly virtual machine.\n\n> Usage: \n\n twvm <file> [<option>]*",
+    "TWVM - A tiny, lightweight and efficient WebAssembly virtual machine.\n\n> Usage: \n\n twvm <file | -> [<option>]*",
     [](auto* o, auto& v) {
       if (v.size() > 0) {
         State::createItem("path", v.front());  // Only using one path for now.
@@ -58,26 +62,210 @@ int main(int argc, const char **argv) {
   options.add(
     "--jit",
     std::nullopt,
-    "Enable JIT compilation (tiered compilation with threshold=100).",
+    "Compile the hot functions to native code with LLVM, see the --jit-* options.",
     Options::OptionTypes::COMMON,
     [](auto* o, auto& v) {
       State::createItem("jit_enabled", "true");
     });
+  options.add(
+    "--jit-calls",
+    "<n>",
+    "Compile a function on its n-th call, 100 by default.",
+    Options::OptionTypes::COMMON,
+    [](auto* o, auto& v) {
+      if (v.has_value()) {
+        State::createItem("jit_calls", *v);
+      }
+    });
+  options.add(
+    "--jit-loops",
+    "<n>",
+    "Compile a function once its loops have been entered n times, then run them natively, 1000 by default.",
+    Options::OptionTypes::COMMON,
+    [](auto* o, auto& v) {
+      if (v.has_value()) {
+        State::createItem("jit_loops", *v);
+      }
+    });
+  options.add(
+    "--jit-threads",
+    "<n>",
+    "Compile on n threads in the background, 1 by default, or on the executing thread by 0.",
+    Options::OptionTypes::COMMON,
+    [](auto* o, auto& v) {
+      if (v.has_value()) {
+        State::createItem("jit_threads", *v);
+      }
+    });
+  options.add(
+    "--jit-opt",
+    "<level>",
+    "Optimize the code of --jit and --compile with no passes (0), mem2reg (1, default), or GVN and loop passes (2).",
+    Options::OptionTypes::COMMON,
+    [](auto* o, auto& v) {
+      if (v.has_value()) {
+        State::createItem("jit_opt", *v);
+      }
+    });
+  options.add(
+    "--jit-stats",
+    std::nullopt,
+    "Print the compile time and code size of every function compiled, on exit.",
+    Options::OptionTypes::COMMON,
+    [](auto* o, auto& v) {
+      State::createItem("jit_stats", "true");
+    });
+  options.add(
+    "--reg",
+    std::nullopt,
+    "Execute with the register-based interpreter tier, calling the native code of --jit and --aot.",
+    Options::OptionTypes::COMMON,
+    [](auto* o, auto& v) {
+      State::createItem("reg_enabled", "true");
+    });
+  options.add(
+    "--guard-pages",
+    std::nullopt,
+    "Bounds check linear memory with guard pages instead of explicit compares.",
+    Options::OptionTypes::COMMON,
+    [](auto* o, auto& v) {
+      State::createItem("guarded_mem", "true");
+    });
+  options.add(
+    "--ngram",
+    "<n>",
+    "Collect statistics of executed opcode sequences up to length n (2-8), with fusion disabled, not with --reg.",
+    Options::OptionTypes::COMMON,
+    [](auto* o, auto& v) {
+      State::createItem("ngram_size", v.has_value() ? *v : "3");
+    });
+  options.add(
+    "--threads",
+    "<n>",
+    "Validate and translate functions on n threads, one per core by default.",
+    Options::OptionTypes::COMMON,
+    [](auto* o, auto& v) {
+      if (v.has_value()) {
+        State::createItem("threads", *v);
+      }
+    });
+  options.add(
+    "--lazy",
+    std::nullopt,
+    "Validate and translate each function on its first call.",
+    Options::OptionTypes::COMMON,
+    [](auto* o, auto& v) {
+      State::createItem("lazy", "true");
+    });
+  options.add(
+    "--cache",
+    "<dir>",
+    "Keep the translated and JIT-compiled code of modules in dir, shared between runs.",
+    Options::OptionTypes::COMMON,
+    [](auto* o, auto& v) {
+      if (v.has_value()) {
+        State::createItem("cache_dir", *v);
+      }
+    });
+  options.add(
+    "--compile",
+    "<file>",
+    "Compile the functions of the module ahead of time into the object file, without running it.",
+    Options::OptionTypes::COMMON,
+    [](auto* o, auto& v) {
+      if (v.has_value()) {
+        State::createItem("compile_path", *v);
+      }
+    });
+  options.add(
+    "--aot",
+    "<file>",
+    "Run the module with the native code of the object file compiled by --compile.",
+    Options::OptionTypes::COMMON,
+    [](auto* o, auto& v) {
+      if (v.has_value()) {
+        State::createItem("aot_path", *v);
+      }
+    });
   options.parse(argc, argv);
 
   // Running engine.
   const auto& inputPath = State::retrieveItem("path");
   if (inputPath.has_value()) {
-    // Check if JIT is enabled via command-line flag
+    // Collect engine settings from command-line flags.
+    EngineOptions engineOptions;
     const auto& jitFlag = State::retrieveItem("jit_enabled");
-    bool jitEnabled = jitFlag.has_value() && (*jitFlag)->toBool();
+    engineOptions.jitEnabled = jitFlag.has_value() && (*jitFlag)->toBool();
+    const auto& jitCalls = State::retrieveItem("jit_calls");
+    if (jitCalls.has_value()) {
+      engineOptions.jitThreshold = std::max((*jitCalls)->toInt(), 0);
+    }
+    const auto& jitLoops = State::retrieveItem("jit_loops");
+    if (jitLoops.has_value()) {
+      engineOptions.jitLoopThreshold = std::max((*jitLoops)->toInt(), 1);
+    }
+    const auto& jitThreads = State::retrieveItem("jit_threads");
+    if (jitThreads.has_value()) {
+      engineOptions.jitThreads = std::max((*jitThreads)->toInt(), 0);
+    }
+    const auto& jitOpt = State::retrieveItem("jit_opt");
+    if (jitOpt.has_value()) {
+      engineOptions.jitOptLevel = static_cast<JITOptLevel>(std::clamp((*jitOpt)->toInt(), 0, 2));
+    }
+    const auto& regFlag = State::retrieveItem("reg_enabled");
+    engineOptions.regEnabled = regFlag.has_value() && (*regFlag)->toBool();
+    const auto& guardedFlag = State::retrieveItem("guarded_mem");
+    engineOptions.guardedMem = guardedFlag.has_value() && (*guardedFlag)->toBool();
+    const auto& ngramSize = State::retrieveItem("ngram_size");
+    if (ngramSize.has_value()) {
+      engineOptions.ngramSize = std::clamp((*ngramSize)->toInt(), 2, 8);
+    }
+    if (engineOptions.regEnabled && engineOptions.ngramSize > 0) {
+      Exception::terminate(Exception::ErrorType::INCOMPATIBLE_OPTIONS);
+    }
+    const auto& lazyFlag = State::retrieveItem("lazy");
+    engineOptions.lazy = lazyFlag.has_value() && (*lazyFlag)->toBool();
+    const auto& cacheDir = State::retrieveItem("cache_dir");
+    if (cacheDir.has_value()) {
+      engineOptions.cacheDir = (*cacheDir)->toStr();
+    }
+    const auto& threads = State::retrieveItem("threads");
+    if (threads.has_value()) {
+      engineOptions.threads = std::max((*threads)->toInt(), 1);
+    }
+
+    const auto& compilePath = State::retrieveItem("compile_path");
+    if (compilePath.has_value()) {
+      engineOptions.lazy = false;  // The LLVM translation expects validated functions.
+    }
 
-    const auto ret = Executor::execute(
-      Instantiator::instantiate(
-        Loader::load((*inputPath)->toStr()), jitEnabled));
+    // The module is streamed from stdin for "-", and compiled while it arrives.
+    const auto path = (*inputPath)->toStr();
+    const auto rtIns = path == "-" ?
+      StreamingLoader::load(STDIN_FILENO, engineOptions) :
+      Instantiator::instantiate(Loader::load(path, engineOptions), engineOptions);
+    if (compilePath.has_value()) {
+      const auto compiled = JITCompiler::getInstance().compileModule(rtIns, (*compilePath)->toStr());
+      if (!compiled.has_value()) {
+        Exception::terminate(Exception::ErrorType::INVALID_AOT_ARTIFACT);
+      }
+      std::cout << "[twvm] Compiled " << *compiled << " of " << rtIns->rtFuncDescriptor.size() << " functions.\n";
+      return 0;
+    }
+    const auto& aotPath = State::retrieveItem("aot_path");
+    if (aotPath.has_value() && !JITCompiler::getInstance().loadModule(rtIns, (*aotPath)->toStr())) {
+      Exception::terminate(Exception::ErrorType::INVALID_AOT_ARTIFACT);
+    }
+    const auto ret = Executor::execute(rtIns);
     if (ret.has_value()) {
       std::visit([](auto&& arg){ std::cout << arg; }, *ret);
     }
+    const auto& jitStats = State::retrieveItem("jit_stats");
+    if (jitStats.has_value() && (*jitStats)->toBool()) {
+      auto& compiler = JITCompiler::getInstance();
+      compiler.drain();  // Those still compiling in the background.
+      compiler.reportStats(std::cerr);
+    }
   } else {
     Exception::terminate(Exception::ErrorType::INVALID_INPUT_PATH);
   }
@@ -1,16 +1,93 @@
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <new>
+#include <set>
+#include <string>
 #include <variant>
+#include <vector>
 #include "gtest/gtest.h"
 #include "lib/include/loader.hh"
+#include "lib/include/streaming_loader.hh"
 #include "lib/include/instantiator.hh"
 #include "lib/include/executor.hh"
+#include "lib/include/jit_compiler.hh"
 #include "lib/include/structs.hh"
 
 using namespace TWVM;
 
-auto run(const std::string& path) {
+// Counts every heap allocation of the process.
+static std::atomic<size_t> allocCount = 0;
+void* operator new(size_t n) {
+  allocCount++;
+  if (auto* p = std::malloc(n ? n : 1)) {
+    return p;
+  }
+  throw std::bad_alloc();
+}
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, size_t) noexcept { std::free(p); }
+
+// `forcedJIT` compiles every function on its first call.
+auto run(const std::string& path,
+  bool regEnabled = false, bool guardedMem = false, uint32_t threads = 0, bool forcedJIT = false) {
+  EngineOptions options;
+  options.regEnabled = regEnabled;
+  options.guardedMem = guardedMem;
+  options.threads = threads;
+  options.jitEnabled = forcedJIT;
+  options.jitThreshold = 0;
+  options.jitThreads = 0;
   return Executor::execute(
     Instantiator::instantiate(
-      Loader::load(path)));
+      Loader::load(path, options), options));
+}
+
+// Every function compiled on its first call, returning the instance with the result.
+auto runForcedJIT(const std::string& path) {
+  EngineOptions options;
+  options.jitEnabled = true;
+  options.jitThreshold = 0;
+  options.jitThreads = 0;
+  const auto rt = Instantiator::instantiate(Loader::load(path, options), options);
+  const auto ret = Executor::execute(rt);
+  return std::make_pair(rt, ret);
+}
+
+// The modules whose entry function is interpreted in the forced-JIT mode, as the JIT has no
+// lowering of the integer division, the i64, f32 and f64 arithmetic, nor of the conversions.
+const std::set<std::string> JIT_FALLBACK_MODULES = {
+  "f32_abs", "f32_add", "f32_ceil", "f32_convert_i32_s", "f32_convert_i32_u", "f32_convert_i64_s",
+  "f32_convert_i64_u", "f32_copysign", "f32_demote_f64", "f32_div", "f32_eq", "f32_floor",
+  "f32_le", "f32_max", "f32_min", "f32_mul", "f32_ne", "f32_nearest", "f32_neg",
+  "f32_reinterpret_i32", "f32_sqrt", "f32_sub", "f32_trunc", "f64_abs", "f64_add", "f64_ceil",
+  "f64_convert_i32_s", "f64_convert_i32_u", "f64_convert_i64_s", "f64_convert_i64_u",
+  "f64_copysign", "f64_div", "f64_eq", "f64_floor", "f64_le", "f64_max", "f64_min", "f64_mul",
+  "f64_ne", "f64_nearest", "f64_promote_f32", "f64_reinterpret_i64", "f64_sqrt", "f64_sub",
+  "f64_trunc", "i32_div_s", "i32_div_u", "i32_reinterpret_f32", "i32_rem_s", "i32_rem_u",
+  "i32_trunc_f32_s", "i32_trunc_f32_u", "i32_trunc_f64_s", "i32_trunc_f64_u", "i32_wrap_i64",
+  "i64_add", "i64_and", "i64_clz", "i64_ctz", "i64_div_s", "i64_div_u", "i64_eq", "i64_eqz",
+  "i64_extend_i32_s", "i64_extend_i32_u", "i64_ge_s", "i64_ge_u", "i64_gt_s", "i64_gt_u",
+  "i64_le_s", "i64_le_u", "i64_lt_s", "i64_lt_u", "i64_mul", "i64_ne", "i64_or", "i64_popcnt",
+  "i64_reinterpret_f64", "i64_rem_s", "i64_rem_u", "i64_rotl", "i64_rotr", "i64_shl", "i64_shr_s",
+  "i64_shr_u", "i64_sub", "i64_trunc_f32_s", "i64_trunc_f32_u", "i64_trunc_f64_s",
+  "i64_trunc_f64_u", "i64_xor",
+};
+
+// Pushes the module in chunks of `chunkBytes`, as if it arrived through a pipe.
+auto runStreamed(const std::string& path, size_t chunkBytes) {
+  std::ifstream in {path, std::ifstream::binary};
+  const std::vector<uint8_t> bytes { std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>() };
+  StreamingLoader loader;
+  for (size_t i = 0; i < bytes.size(); i += chunkBytes) {
+    loader.push(bytes.data() + i, std::min(chunkBytes, bytes.size() - i));
+  }
+  return Executor::execute(loader.finish());
 }
 
 #define COMMA ,
@@ -21,22 +98,40 @@ auto run(const std::string& path) {
   TEST(TWVM, MOD_NAME) { \
     CMP_OP(std::get<CONCAT_PREFIX(RET_TYPE)>(*run(CONCAT_LIT_STR(MOD_NAME) ".wasm")), RET_VAL); \
   }
+#define DECLARE_RETURNABLE_REG_TESTS(MOD_NAME, RET_TYPE, RET_VAL, CMP_OP) \
+  TEST(TWVM_REG, MOD_NAME) { \
+    CMP_OP(std::get<CONCAT_PREFIX(RET_TYPE)>(*run(CONCAT_LIT_STR(MOD_NAME) ".wasm", true)), RET_VAL); \
+  }
+// The entry function is compiled, unless it is listed in `JIT_FALLBACK_MODULES`.
+#define DECLARE_RETURNABLE_JIT_TESTS(MOD_NAME, RET_TYPE, RET_VAL, CMP_OP) \
+  TEST(TWVM_JIT, MOD_NAME) { \
+    const auto [rt, ret] = runForcedJIT(CONCAT_LIT_STR(MOD_NAME) ".wasm"); \
+    CMP_OP(std::get<CONCAT_PREFIX(RET_TYPE)>(*ret), RET_VAL); \
+    EXPECT_EQ(rt->rtFuncDescriptor[*rt->rtEntryIdx].isJitCompiled(), !JIT_FALLBACK_MODULES.count(#MOD_NAME)); \
+  }
 
 #define ITERATE_TESTCASES(V) \
   V(block, rt_i32_t, 10, EXPECT_EQ) \
   V(loop, rt_i32_t, 10, EXPECT_EQ) \
   V(if, rt_i32_t, 7, EXPECT_EQ) \
   V(else, rt_i32_t, 8, EXPECT_EQ) \
+  V(if_nested, rt_i32_t, 7, EXPECT_EQ) \
   V(br, rt_i32_t, 10, EXPECT_EQ) \
   V(br_if, rt_i32_t, 10, EXPECT_EQ) \
+  V(br_if_return, rt_i32_t, 42, EXPECT_EQ) \
   V(br_table, rt_i32_t, 22, EXPECT_EQ) \
   V(return, rt_i32_t, 10, EXPECT_EQ) \
   V(call_indirect, rt_i32_t, 10, EXPECT_EQ) \
+  V(call_indirect_args, rt_i32_t, 7, EXPECT_EQ) \
   V(drop, rt_i32_t, 10, EXPECT_EQ) \
   V(select, rt_i32_t, 20, EXPECT_EQ) \
   V(local, rt_f64_t, 10.123, EXPECT_DOUBLE_EQ) \
+  V(local_hazard, rt_i32_t, 11, EXPECT_EQ) \
+  V(fused, rt_i32_t, 53, EXPECT_EQ) \
   V(global, rt_i32_t, 10, EXPECT_EQ) \
   V(i32_load_store, rt_i32_t, 10, EXPECT_EQ) \
+  V(mem_bounds, rt_i32_t, 0x12345678, EXPECT_EQ) \
+  V(memory_grow_access, rt_i32_t, 1282, EXPECT_EQ) \
   V(i64_load_store, rt_i64_t, 10, EXPECT_EQ) \
   V(f32_load_store, rt_f32_t, 12.34, EXPECT_FLOAT_EQ) \
   V(f64_load_store, rt_f64_t, 12.34, EXPECT_DOUBLE_EQ) \
@@ -175,6 +270,8 @@ auto run(const std::string& path) {
   V(f64_reinterpret_i64, rt_f64_t, 2.1097938843731583e-300, EXPECT_DOUBLE_EQ) \
 
 ITERATE_TESTCASES(DECLARE_RETURNABLE_TESTS)
+ITERATE_TESTCASES(DECLARE_RETURNABLE_REG_TESTS)
+ITERATE_TESTCASES(DECLARE_RETURNABLE_JIT_TESTS)
 
 TEST(TWVM, EXPECT_EXIT) {
   EXPECT_EXIT(run(CONCAT_LIT_STR(unreachable.wasm)), testing::ExitedWithCode(1), Exception::getErrorMsg(Exception::ErrorType::UNREACHABLE));
@@ -183,5 +280,285 @@ TEST(TWVM, EXPECT_EXIT) {
   EXPECT_EXIT(run(CONCAT_LIT_STR(i32_trunc_f64_u_throw.wasm)), testing::ExitedWithCode(1), Exception::getErrorMsg(Exception::ErrorType::FLOAT_UNREPRESENTABLE));
   EXPECT_EXIT(run(CONCAT_LIT_STR(i64_trunc_f32_u_throw.wasm)), testing::ExitedWithCode(1), Exception::getErrorMsg(Exception::ErrorType::FLOAT_UNREPRESENTABLE));
   EXPECT_EXIT(run(CONCAT_LIT_STR(i64_trunc_f64_u_throw.wasm)), testing::ExitedWithCode(1), Exception::getErrorMsg(Exception::ErrorType::FLOAT_UNREPRESENTABLE));
+  EXPECT_EXIT(run(CONCAT_LIT_STR(invalid_type_mismatch.wasm)), testing::ExitedWithCode(1), Exception::getErrorMsg(Exception::ErrorType::STACK_VAL_TYPE_MISMATCH));
+  EXPECT_EXIT(run(CONCAT_LIT_STR(mem_oob.wasm)), testing::ExitedWithCode(1), Exception::getErrorMsg(Exception::ErrorType::MEM_ACCESS_OOB));
+  EXPECT_EXIT(run(CONCAT_LIT_STR(mem_oob_wrap.wasm)), testing::ExitedWithCode(1), Exception::getErrorMsg(Exception::ErrorType::MEM_ACCESS_OOB));
+  EXPECT_EXIT(run(CONCAT_LIT_STR(truncated.wasm)), testing::ExitedWithCode(1), Exception::getErrorMsg(Exception::ErrorType::UNEXPECTED_END));
+  EXPECT_EXIT(run(CONCAT_LIT_STR(truncated_block_type.wasm)), testing::ExitedWithCode(1), Exception::getErrorMsg(Exception::ErrorType::UNEXPECTED_END));
+  EXPECT_EXIT(run(CONCAT_LIT_STR(truncated_f64_const.wasm)), testing::ExitedWithCode(1), Exception::getErrorMsg(Exception::ErrorType::UNEXPECTED_END));
+  EXPECT_EXIT(run(CONCAT_LIT_STR(export_func_oob.wasm)), testing::ExitedWithCode(1), Exception::getErrorMsg(Exception::ErrorType::ILLEGAL_FUNC_IDX));
+  EXPECT_EXIT(run(CONCAT_LIT_STR(func_type_oob.wasm)), testing::ExitedWithCode(1), Exception::getErrorMsg(Exception::ErrorType::FUNC_TYPE_ACCESS_OOB));
+  EXPECT_EXIT(run(CONCAT_LIT_STR(elem_func_oob.wasm)), testing::ExitedWithCode(1), Exception::getErrorMsg(Exception::ErrorType::TBL_ELEM_EXCEED_MAX));
+  EXPECT_EXIT(run(CONCAT_LIT_STR(overlong_leb.wasm)), testing::ExitedWithCode(1), Exception::getErrorMsg(Exception::ErrorType::INVALID_LEB128));
   EXPECT_NO_FATAL_FAILURE(run(CONCAT_LIT_STR(nop.wasm)));
 }
+
+TEST(TWVM, PARALLEL_LOADING) {
+  // More functions than one chunk of `Util::parallelFor`, the invalid ones are 20 and 35.
+  EXPECT_EQ(std::get<Runtime::rt_i32_t>(*run(CONCAT_LIT_STR(par_calls.wasm), false, false, 4)), 39);
+  EXPECT_EQ(std::get<Runtime::rt_i32_t>(*run(CONCAT_LIT_STR(par_calls.wasm), true, false, 4)), 39);
+  EXPECT_EXIT(run(CONCAT_LIT_STR(par_invalid.wasm), false, false, 4), testing::ExitedWithCode(1), Exception::getErrorMsg(Exception::ErrorType::STACK_VAL_TYPE_MISMATCH));
+}
+
+TEST(TWVM, LAZY_TRANSLATION) {
+  EngineOptions options;
+  options.lazy = true;
+  // Only `main` is called, the invalid functions 20 and 35 are never validated.
+  const auto rt = Instantiator::instantiate(Loader::load(CONCAT_LIT_STR(par_invalid.wasm), options), options);
+  EXPECT_EQ(std::get<Runtime::rt_i32_t>(*Executor::execute(rt)), 0);
+  EXPECT_NE(rt->rtFuncDescriptor.front().codeEntry, nullptr);
+  EXPECT_TRUE(std::all_of(rt->rtFuncDescriptor.begin() + 1, rt->rtFuncDescriptor.end(), [](auto& descriptor) {
+    return descriptor.codeEntry == nullptr;
+  }));
+  for (const auto regEnabled : { false, true }) {
+    options.regEnabled = regEnabled;
+    EXPECT_EQ(std::get<Runtime::rt_i32_t>(*Executor::execute(
+      Instantiator::instantiate(Loader::load(CONCAT_LIT_STR(par_calls.wasm), options), options))), 39);
+  }
+  EXPECT_EXIT(Executor::execute(
+    Instantiator::instantiate(Loader::load(CONCAT_LIT_STR(invalid_type_mismatch.wasm), options), options)),
+    testing::ExitedWithCode(1), Exception::getErrorMsg(Exception::ErrorType::STACK_VAL_TYPE_MISMATCH));
+}
+
+TEST(TWVM, CODE_CACHE) {
+  char dir[] = "/tmp/twvm_cache_XXXXXX";
+  ASSERT_NE(mkdtemp(dir), nullptr);
+  EngineOptions options;
+  options.cacheDir = dir;
+  const auto runCached = [&](bool hit) {
+    const auto mod = Loader::load(CONCAT_LIT_STR(par_calls.wasm), options);
+    EXPECT_EQ(mod->cached.ptr != nullptr, hit);
+    EXPECT_EQ(std::get<Runtime::rt_i32_t>(*Executor::execute(Instantiator::instantiate(mod, options))), 39);
+    return std::string(dir) + "/" + mod->cached.key + ".twc";
+  };
+  runCached(false);
+  const auto path = runCached(true);
+  // A damaged entry is a miss, and is replaced.
+  {
+    std::fstream entry(path, std::ios::in | std::ios::out | std::ios::binary);
+    entry.seekg(-1, std::ios::end);
+    const auto last = static_cast<char>(entry.get());
+    entry.seekp(-1, std::ios::end);
+    entry.put(static_cast<char>(~last));
+  }
+  runCached(false);
+  runCached(true);
+  std::remove(path.c_str());
+  std::remove(dir);
+}
+
+TEST(TWVM_JIT, CODE_CACHE_GUARDED) {
+  char dir[] = "/tmp/twvm_cache_XXXXXX";
+  ASSERT_NE(mkdtemp(dir), nullptr);
+  EngineOptions options;
+  options.cacheDir = dir;
+  options.jitEnabled = true;
+  options.jitThreshold = 0;
+  options.jitThreads = 0;
+  // The objects compiled without the bounds checks are never linked for the unguarded memory.
+  for (const bool guarded : { true, false }) {
+    options.guardedMem = guarded;
+    EXPECT_EXIT(Executor::execute(
+      Instantiator::instantiate(Loader::load(CONCAT_LIT_STR(jit_memory_oob.wasm), options), options)),
+      testing::ExitedWithCode(1), Exception::getErrorMsg(Exception::ErrorType::MEM_ACCESS_OOB));
+  }
+  std::filesystem::remove_all(dir);
+}
+
+TEST(TWVM, AOT_COMPILE) {
+  char path[] = "/tmp/twvm_aot_XXXXXX";
+  const auto fd = mkstemp(path);
+  ASSERT_GE(fd, 0);
+  close(fd);
+  const auto compiled = JITCompiler::getInstance().compileModule(
+    Instantiator::instantiate(Loader::load(CONCAT_LIT_STR(jit_calls.wasm))), path);
+  ASSERT_TRUE(compiled.has_value());
+  EXPECT_EQ(*compiled, 2);  // Main calls the callee directly.
+  // Native from the first call, without the JIT.
+  const auto rt = Instantiator::instantiate(Loader::load(CONCAT_LIT_STR(jit_calls.wasm)));
+  ASSERT_TRUE(JITCompiler::getInstance().loadModule(rt, path));
+  EXPECT_TRUE(rt->rtFuncDescriptor.front().isJitCompiled());
+  EXPECT_TRUE(rt->rtFuncDescriptor.back().isJitCompiled());
+  EXPECT_EQ(std::get<Runtime::rt_i32_t>(*Executor::execute(rt)), 2646900);
+  EngineOptions regOptions;
+  regOptions.regEnabled = true;
+  const auto regRt = Instantiator::instantiate(Loader::load(CONCAT_LIT_STR(jit_calls.wasm), regOptions), regOptions);
+  ASSERT_TRUE(JITCompiler::getInstance().loadModule(regRt, path));
+  EXPECT_EQ(std::get<Runtime::rt_i32_t>(*Executor::execute(regRt)), 2646900);
+  // Compiled from another module.
+  EXPECT_FALSE(JITCompiler::getInstance().loadModule(
+    Instantiator::instantiate(Loader::load(CONCAT_LIT_STR(par_calls.wasm))), path));
+  std::remove(path);
+}
+
+TEST(TWVM_JIT, CONTROL_FLOW) {
+  EngineOptions options;
+  options.jitEnabled = true;
+  options.jitThreshold = 0;
+  options.jitThreads = 0;
+  const auto rt = Instantiator::instantiate(Loader::load(CONCAT_LIT_STR(jit_control.wasm)), options);
+  EXPECT_EQ(std::get<Runtime::rt_i32_t>(*Executor::execute(rt)), 12567);
+  // Loops, nested blocks with results, br_table, select, and unreachable, main makes calls.
+  for (size_t i = 0; i + 1 < rt->rtFuncDescriptor.size(); ++i) {
+    EXPECT_TRUE(rt->rtFuncDescriptor[i].isJitCompiled()) << "function " << i;
+  }
+  EXPECT_EQ(std::get<Runtime::rt_i32_t>(*run(CONCAT_LIT_STR(jit_control.wasm))), 12567);
+  EXPECT_EXIT(run(CONCAT_LIT_STR(jit_unreachable.wasm), false, false, 0, true), testing::ExitedWithCode(1), Exception::getErrorMsg(Exception::ErrorType::UNREACHABLE));
+  EXPECT_EXIT(run(CONCAT_LIT_STR(unreachable.wasm), false, false, 0, true), testing::ExitedWithCode(1), Exception::getErrorMsg(Exception::ErrorType::UNREACHABLE));
+  EXPECT_EXIT(run(CONCAT_LIT_STR(br_if_unreachable.wasm), false, false, 0, true), testing::ExitedWithCode(1), Exception::getErrorMsg(Exception::ErrorType::UNREACHABLE));
+}
+
+TEST(TWVM_JIT, REG_TIER) {
+  EngineOptions options;
+  options.regEnabled = true;
+  options.jitEnabled = true;
+  options.jitThreshold = 0;
+  options.jitThreads = 0;
+  // The register-based tier calls into the native code as the stack-based one does.
+  const auto rt = Instantiator::instantiate(Loader::load(CONCAT_LIT_STR(jit_control.wasm)), options);
+  EXPECT_EQ(std::get<Runtime::rt_i32_t>(*Executor::execute(rt)), 12567);
+  for (size_t i = 0; i + 1 < rt->rtFuncDescriptor.size(); ++i) {
+    EXPECT_TRUE(rt->rtFuncDescriptor[i].isJitCompiled()) << "function " << i;
+  }
+  const auto memRt = Instantiator::instantiate(Loader::load(CONCAT_LIT_STR(jit_memory.wasm)), options);
+  EXPECT_EQ(std::get<Runtime::rt_i32_t>(*Executor::execute(memRt)), 210);
+  EXPECT_TRUE(memRt->rtFuncDescriptor.front().isJitCompiled());
+}
+
+TEST(TWVM_JIT, SIGNATURES) {
+  EngineOptions options;
+  options.jitEnabled = true;
+  options.jitThreshold = 0;
+  options.jitThreads = 0;
+  const auto rt = Instantiator::instantiate(Loader::load(CONCAT_LIT_STR(jit_signatures.wasm)), options);
+  // i64(i64, i32), f64(f64, f32, i32), f32(f32, f64) and (i32), called by the interpreted main.
+  EXPECT_EQ(std::get<Runtime::rt_i64_t>(*Executor::execute(rt)), 0x123456789A + 4);
+  for (size_t i = 0; i + 1 < rt->rtFuncDescriptor.size(); ++i) {
+    EXPECT_TRUE(rt->rtFuncDescriptor[i].isJitCompiled()) << "function " << i;
+  }
+  EXPECT_EQ(rt->stack.size(), 2);  // Only the result of main is left, above the bottom slot.
+}
+
+TEST(TWVM_JIT, MEMORY_AND_CALLS) {
+  EngineOptions options;
+  options.jitEnabled = true;
+  options.jitThreshold = 0;
+  options.jitThreads = 0;
+  const auto rt = Instantiator::instantiate(Loader::load(CONCAT_LIT_STR(jit_memory.wasm)), options);
+  // Recursion, memory, globals, call_indirect and memory.grow, and an interpreted callee.
+  EXPECT_EQ(std::get<Runtime::rt_i32_t>(*Executor::execute(rt)), 210);
+  for (size_t i = 0; i < rt->rtFuncDescriptor.size(); ++i) {
+    EXPECT_EQ(rt->rtFuncDescriptor[i].isJitCompiled(), i != 6) << "function " << i;
+  }
+  EXPECT_EQ(rt->stack.size(), 2);
+  EXPECT_EQ(std::get<Runtime::rt_i32_t>(*run(CONCAT_LIT_STR(jit_memory.wasm))), 210);
+  for (const bool guarded : { false, true }) {
+    EXPECT_EXIT(run(CONCAT_LIT_STR(jit_memory_oob.wasm), false, guarded, 0, true), testing::ExitedWithCode(1), Exception::getErrorMsg(Exception::ErrorType::MEM_ACCESS_OOB));
+  }
+  EXPECT_EXIT(run(CONCAT_LIT_STR(jit_table_oob.wasm), false, false, 0, true), testing::ExitedWithCode(1), Exception::getErrorMsg(Exception::ErrorType::TBL_ACCESS_OOB));
+}
+
+TEST(TWVM_JIT, BACKGROUND) {
+  EngineOptions options;
+  options.jitEnabled = true;
+  options.jitThreshold = 1;
+  const auto rt = Instantiator::instantiate(Loader::load(CONCAT_LIT_STR(jit_calls.wasm)), options);
+  // Interpreted until the callee is published, at any point of the run.
+  EXPECT_EQ(std::get<Runtime::rt_i32_t>(*Executor::execute(rt)), 2646900);
+  JITCompiler::getInstance().drain();
+  EXPECT_TRUE(rt->rtFuncDescriptor.front().isJitCompiled());
+  EXPECT_TRUE(rt->rtFuncDescriptor.back().isJitCompiled());
+  EXPECT_EQ(std::get<Runtime::rt_i32_t>(*Executor::execute(rt)), 2646900);
+}
+
+TEST(TWVM_JIT, OSR) {
+  EngineOptions options;
+  options.jitEnabled = true;
+  options.jitThreshold = 1000000;
+  options.jitLoopThreshold = 10;
+  for (const auto threads : { 0, 1 }) {
+    options.jitThreads = threads;
+    const auto rt = Instantiator::instantiate(Loader::load(CONCAT_LIT_STR(jit_osr.wasm)), options);
+    // Main and its callee are called once, and leave their loops for the native code, with an
+    // operand below the loop of main. The function called in it stays interpreted.
+    EXPECT_EQ(std::get<Runtime::rt_i32_t>(*Executor::execute(rt)), 50993000);
+    JITCompiler::getInstance().drain();
+    EXPECT_FALSE(rt->rtFuncDescriptor[0].isJitCompiled());
+    EXPECT_TRUE(rt->rtFuncDescriptor[1].isJitCompiled());
+    EXPECT_TRUE(rt->rtFuncDescriptor[2].isJitCompiled());
+  }
+  EXPECT_EQ(std::get<Runtime::rt_i32_t>(*run(CONCAT_LIT_STR(jit_osr.wasm))), 50993000);
+}
+
+TEST(TWVM_JIT, OPT_LEVELS) {
+  EngineOptions options;
+  options.jitEnabled = true;
+  options.jitThreshold = 0;
+  options.jitThreads = 0;
+  auto& compiler = JITCompiler::getInstance();
+  for (const auto level : { JITOptLevel::None, JITOptLevel::Baseline, JITOptLevel::Optimizing }) {
+    options.jitOptLevel = level;
+    const auto before = compiler.stats().size();
+    EXPECT_EQ(std::get<Runtime::rt_i32_t>(*Executor::execute(
+      Instantiator::instantiate(Loader::load(CONCAT_LIT_STR(jit_control.wasm)), options))), 12567);
+    EXPECT_EQ(std::get<Runtime::rt_i32_t>(*Executor::execute(
+      Instantiator::instantiate(Loader::load(CONCAT_LIT_STR(jit_memory.wasm)), options))), 210);
+    const auto stats = compiler.stats();
+    ASSERT_GT(stats.size(), before);
+    for (auto it = stats.begin() + before; it != stats.end(); ++it) {
+      EXPECT_EQ(it->optLevel, level);
+      EXPECT_GT(it->irInsts, 0);
+      EXPECT_GT(it->codeBytes, 0);
+    }
+  }
+}
+
+TEST(TWVM_STREAMING, CHUNKS) {
+  for (const size_t chunkBytes : { 1, 7, 4096 }) {
+    EXPECT_EQ(std::get<Runtime::rt_i32_t>(*runStreamed(CONCAT_LIT_STR(par_calls.wasm), chunkBytes)), 39);
+    EXPECT_EQ(std::get<Runtime::rt_i32_t>(*runStreamed(CONCAT_LIT_STR(call_indirect.wasm), chunkBytes)), 10);
+    EXPECT_EQ(std::get<Runtime::rt_i32_t>(*runStreamed(CONCAT_LIT_STR(memory_grow_access.wasm), chunkBytes)), 1282);
+  }
+  EXPECT_EXIT(runStreamed(CONCAT_LIT_STR(truncated.wasm), 7), testing::ExitedWithCode(1), Exception::getErrorMsg(Exception::ErrorType::UNEXPECTED_END));
+  EXPECT_EXIT(runStreamed(CONCAT_LIT_STR(par_invalid.wasm), 7), testing::ExitedWithCode(1), Exception::getErrorMsg(Exception::ErrorType::STACK_VAL_TYPE_MISMATCH));
+  EXPECT_EXIT(runStreamed(CONCAT_LIT_STR(code_without_funcs.wasm), 7), testing::ExitedWithCode(1), Exception::getErrorMsg(Exception::ErrorType::ILLEGAL_FUNC_IDX));
+  EXPECT_EXIT(runStreamed(CONCAT_LIT_STR(export_func_oob.wasm), 7), testing::ExitedWithCode(1), Exception::getErrorMsg(Exception::ErrorType::ILLEGAL_FUNC_IDX));
+  EXPECT_EXIT(runStreamed(CONCAT_LIT_STR(elem_func_oob.wasm), 7), testing::ExitedWithCode(1), Exception::getErrorMsg(Exception::ErrorType::TBL_ELEM_EXCEED_MAX));
+}
+
+TEST(TWVM, ZERO_ALLOC_CALLS) {
+  const auto allocsOfFib = [](Runtime::rt_i32_t n) {
+    const auto rt = Instantiator::instantiate(Loader::load(CONCAT_LIT_STR(fib_global.wasm)));
+    rt->rtGlobals.front() = Runtime::RTValue::from(n);
+    const auto before = allocCount.load();
+    const auto ret = Executor::execute(rt);
+    const auto allocs = allocCount.load() - before;
+    return std::make_pair(std::get<Runtime::rt_i32_t>(*ret), allocs);
+  };
+  const auto [fib10, allocs10] = allocsOfFib(10);
+  const auto [fib20, allocs20] = allocsOfFib(20);
+  EXPECT_EQ(fib10, 55);
+  EXPECT_EQ(fib20, 6765);
+  // fib(20) makes about 21k more calls than fib(10).
+  EXPECT_EQ(allocs10, allocs20);
+}
+
+TEST(TWVM_REG, EXPECT_EXIT) {
+  EXPECT_EXIT(run(CONCAT_LIT_STR(unreachable.wasm), true), testing::ExitedWithCode(1), Exception::getErrorMsg(Exception::ErrorType::UNREACHABLE));
+  EXPECT_EXIT(run(CONCAT_LIT_STR(br_if_unreachable.wasm), true), testing::ExitedWithCode(1), Exception::getErrorMsg(Exception::ErrorType::UNREACHABLE));
+  EXPECT_EXIT(run(CONCAT_LIT_STR(i32_trunc_f32_u_throw.wasm), true), testing::ExitedWithCode(1), Exception::getErrorMsg(Exception::ErrorType::FLOAT_UNREPRESENTABLE));
+  EXPECT_EXIT(run(CONCAT_LIT_STR(mem_oob.wasm), true), testing::ExitedWithCode(1), Exception::getErrorMsg(Exception::ErrorType::MEM_ACCESS_OOB));
+  EXPECT_NO_FATAL_FAILURE(run(CONCAT_LIT_STR(nop.wasm), true));
+}
+
+TEST(TWVM_GUARDED, LOAD_STORE) {
+  EXPECT_EQ(std::get<Runtime::rt_i32_t>(*run(CONCAT_LIT_STR(i32_load_store.wasm), false, true)), 10);
+  EXPECT_EQ(std::get<Runtime::rt_i64_t>(*run(CONCAT_LIT_STR(i64_load_store.wasm), false, true)), 10);
+  EXPECT_EQ(std::get<Runtime::rt_i32_t>(*run(CONCAT_LIT_STR(mem_bounds.wasm), false, true)), 0x12345678);
+  EXPECT_EQ(std::get<Runtime::rt_i32_t>(*run(CONCAT_LIT_STR(memory_grow_access.wasm), false, true)), 1282);
+}
+
+TEST(TWVM_GUARDED, EXPECT_EXIT) {
+  EXPECT_EXIT(run(CONCAT_LIT_STR(mem_oob.wasm), false, true), testing::ExitedWithCode(1), Exception::getErrorMsg(Exception::ErrorType::MEM_ACCESS_OOB));
+  EXPECT_EXIT(run(CONCAT_LIT_STR(mem_oob_wrap.wasm), false, true), testing::ExitedWithCode(1), Exception::getErrorMsg(Exception::ErrorType::MEM_ACCESS_OOB));
+}